@@ -64,21 +64,26 @@ node_t* bind_neighbor_by_degree(
 binding_func_t binding_funcs[] = {
     {
         .func = bind_node_by_size,
+        .filter = filter_by_size,
+        .global = true,
         .size = true,
         .exclude = true,
     },
     {
         .func = bind_neighbor_by_size,
+        .filter = filter_by_size,
         .size = true,
         .exclude = true,
     },
     {
         .func = bind_neighbor_by_color,
+        .filter = filter_by_color,
         .exclude = true,
         .color = true,
     },
     {
         .func = bind_neighbor_by_degree,
+        .filter = filter_by_degree,
         .exclude = true,
         .degree = true,
     },
@@ -90,16 +95,47 @@ node_t* get_binding_node(const graph_t* graph, const node_t* node, const binding
     return call->binding->func(graph, node, &call->args);
 }
 
+// no padding, so that keys can be compared bytewise
+typedef struct {
+    const binding_func_t* binding;
+    int size;
+    int degree;
+    int exclude;
+    int color;
+} binding_key_t;
+
+node_t* resolve_binding(const graph_t* graph, const node_t* node, const binding_call_t* call) {
+    const node_table_t* table = get_node_table(graph);
+    binding_key_t key = {
+        .binding = call->binding,
+        .size = call->args.size,
+        .degree = call->args.degree,
+        .exclude = call->args.exclude,
+        .color = call->args.color,
+    };
+    node_memo_t* memo = get_node_memo(table, &key, sizeof(key));
+
+    // global bindings share a single entry
+    int idx = call->binding->global ? 0 : get_node_index(table, node);
+    const node_t* target;
+    if (!get_memoized(memo, idx, &target)) {
+        target = get_binding_node(graph, node, call);
+        set_memoized(memo, idx, target);
+    }
+    return (node_t*)target;
+}
+
 bool binding_matches(
     const graph_t* graph,
     const filter_call_t* filter_call,
     const binding_call_t* binding_call) {
-    for (const node_t* node = graph->nodes; node; node = node->next) {
-        if (apply_filter(graph, node, filter_call)) {
-            node_t* match = get_binding_node(graph, node, binding_call);
-            if (match) {
-                return true;
-            }
+    const node_table_t* table = get_node_table(graph);
+    unsigned long matches[NODE_MASK_WORDS(table->n_nodes)];
+    apply_filter_batch(table, filter_call, matches);
+    for (int idx = 0; idx < table->n_nodes; idx++) {
+        if (is_node_matched(matches, idx) &&
+            resolve_binding(graph, table->nodes[idx], binding_call)) {
+            return true;
         }
     }
     return false;
@@ -120,6 +156,7 @@ struct {
 } binding_argument_values;
 
 typedef struct {
+    long func;
     long size;
     long degree;
 } binding_valid_arguments_t;
@@ -182,6 +219,41 @@ void init_binding(__attribute__((unused)) guide_builder_t* builder) {
     }
 }
 
+int enumerate_bindings(binding_call_t* calls, int max_calls) {
+    int n_calls = 0;
+    for (int i_func = 0; binding_funcs[i_func].func; i_func++) {
+        const binding_func_t* func = &binding_funcs[i_func];
+        int n_size = func->size ? binding_argument_values.n_size : 1;
+        int n_degree = func->degree ? binding_argument_values.n_degree : 1;
+        int n_exclude = func->exclude ? binding_argument_values.n_exclude : 1;
+        int n_color = func->color ? binding_argument_values.n_color : 1;
+        for (int i_size = 0; i_size < n_size; i_size++) {
+            for (int i_degree = 0; i_degree < n_degree; i_degree++) {
+                for (int i_exclude = 0; i_exclude < n_exclude; i_exclude++) {
+                    for (int i_color = 0; i_color < n_color; i_color++) {
+                        if (n_calls == max_calls) {
+                            return n_calls;
+                        }
+                        calls[n_calls++] = (binding_call_t){
+                            .binding = func,
+                            .args = {
+                                .size = func->size ? binding_argument_values.size[i_size] : 0,
+                                .degree =
+                                    func->degree ? binding_argument_values.degree[i_degree] : 0,
+                                .exclude = func->exclude
+                                               ? binding_argument_values.exclude[i_exclude]
+                                               : false,
+                                .color = func->color ? binding_argument_values.color[i_color] : 0,
+                            },
+                        };
+                    }
+                }
+            }
+        }
+    }
+    return n_calls;
+}
+
 void add_binding_choice(
     guide_builder_t* builder, int n_choices, const char* prefix, const char* suffix) {
     char* buffer = malloc(strlen(prefix) + strlen(suffix) + 2);
@@ -197,66 +269,232 @@ void add_binding(guide_builder_t* builder, const char* prefix) {
     add_binding_choice(builder, binding_argument_values.n_color, prefix, "color");
 }
 
-binding_call_t* sample_binding(
-    task_t* task, const graph_t* graph, const filter_call_t* filter, trail_t** p_trail) {
-    binding_valid_arguments_t arg_vals;
-    get_binding_arguments(graph, &arg_vals);
+long get_binding_funcs(const graph_t* graph, const filter_call_t* filter) {
+    const node_table_t* table = get_node_table(graph);
+    unsigned long matches[NODE_MASK_WORDS(table->n_nodes)];
+    apply_filter_batch(table, filter, matches);
+    bool has_neighbors = false;
+    for (int idx = 0; idx < table->n_nodes && !has_neighbors; idx++) {
+        has_neighbors = is_node_matched(matches, idx) && table->degree[idx] > 0;
+    }
+    long valid = 0;
+    for (int i_func = 0; binding_funcs[i_func].func; i_func++) {
+        if (binding_funcs[i_func].global || has_neighbors) {
+            valid |= 1l << i_func;
+        }
+    }
+    return valid;
+}
 
-    binding_call_t* call = new_item(task->_mem_binding_calls);
-    trail_t* trail = *p_trail;
+// the nodes that the binding may bind for the nodes selected by the filter
+static void binding_candidates(
+    const node_table_t* table,
+    const filter_call_t* filter,
+    const binding_func_t* func,
+    unsigned long* candidates) {
+    int n_words = NODE_MASK_WORDS(table->n_nodes);
+    unsigned long matches[n_words];
+    int n_matches = apply_filter_batch(table, filter, matches);
+    for (int i = 0; i < n_words; i++) {
+        candidates[i] = func->global && n_matches ? ~0ul : 0;
+    }
+    if (func->global) {
+        clear_padding(table, candidates);
+        return;
+    }
+    for (int idx = 0; idx < table->n_nodes; idx++) {
+        if (is_node_matched(matches, idx)) {
+            for (int i = table->neighbor_offset[idx]; i < table->neighbor_offset[idx + 1]; i++) {
+                candidates[table->neighbors[i] / 64] |= 1ul << (table->neighbors[i] % 64);
+            }
+        }
+    }
+}
+
+// the values of exclude for which the binding resolves for a selected node
+long resolving_excludes(const graph_t* graph, const filter_call_t* filter, binding_call_t* call) {
+    const node_table_t* table = get_node_table(graph);
+    unsigned long candidates[NODE_MASK_WORDS(table->n_nodes)];
+    binding_candidates(table, filter, call->binding, candidates);
+    filter_arguments_t args = {.size = call->args.size, .degree = call->args.degree};
+    bool included = false;
+    bool excluded = false;
+    for (int idx = 0; idx < table->n_nodes && !(included && excluded); idx++) {
+        if (is_node_matched(candidates, idx)) {
+            args.exclude = false;
+            included |= call->binding->filter(graph, table->nodes[idx], &args);
+            args.exclude = true;
+            excluded |= call->binding->filter(graph, table->nodes[idx], &args);
+        }
+    }
+
+    long valid = 0;
+    for (int i = 0; i < binding_argument_values.n_exclude; i++) {
+        if (binding_argument_values.exclude[i] ? excluded : included) {
+            valid |= 1l << i;
+        }
+    }
+    return valid;
+}
+
+// the colors for which the binding resolves for a selected node, from the colors of the candidates
+long resolving_colors(const graph_t* graph, const filter_call_t* filter, binding_call_t* call) {
+    const node_table_t* table = get_node_table(graph);
+    unsigned long candidates[NODE_MASK_WORDS(table->n_nodes)];
+    binding_candidates(table, filter, call->binding, candidates);
+    bool any_candidate = false;
+    unsigned short any_colors = 0;
+    unsigned short all_colors = 0xffff;
+    for (int idx = 0; idx < table->n_nodes; idx++) {
+        if (is_node_matched(candidates, idx)) {
+            any_candidate = true;
+            any_colors |= table->colors[idx];
+            all_colors &= table->colors[idx];
+        }
+    }
+
+    // as filter_by_color: some candidate has the color, or some candidate does not
+    long valid = 0;
+    for (int i = 0; i < binding_argument_values.n_color; i++) {
+        unsigned short bit = color_bit(resolve_color(table, binding_argument_values.color[i]));
+        if (call->args.exclude ? any_candidate && !(all_colors & bit) : any_colors & bit) {
+            valid |= 1l << i;
+        }
+    }
+    return valid;
+}
+
+// argument values that lead to a failure with a binding function, see sample_binding_arguments
+typedef struct {
+    long size;
+    long degree;
+    long exclude;
+} binding_failed_arguments_t;
 
-    const categorical_t* func_dist = next_choice(trail);
-    int i_func = choose(func_dist);
+// as sample_filter_arguments, for a binding that has to resolve for a selected node
+static bool sample_binding_arguments(
+    const graph_t* graph,
+    const filter_call_t* filter,
+    const binding_valid_arguments_t* arg_vals,
+    long* failed_funcs,
+    binding_failed_arguments_t* failed,
+    binding_call_t* call,
+    trail_t** p_trail) {
+    const categorical_t* func_dist = next_choice(*p_trail);
+    long valid_funcs = arg_vals->func & ~*failed_funcs;
+    if (!valid_funcs) {
+        return false;
+    }
+    int i_func = choose_from(func_dist, valid_funcs);
     binding_func_t* func = &binding_funcs[i_func];
     call->binding = func;
-    trail = observe_choice(trail, i_func);
+    // unused arguments are part of the memo key of resolve_binding
+    call->args = (binding_arguments_t){0};
+    *p_trail = observe_choice(*p_trail, i_func);
 
-    const categorical_t* size_dist = next_choice(trail);
+    binding_failed_arguments_t* func_failed = &failed[i_func];
+    long* blamed = failed_funcs;
+    int i_blamed = i_func;
+
+    const categorical_t* size_dist = next_choice(*p_trail);
     if (func->size) {
-        int i_size = choose_from(size_dist, arg_vals.size);
+        long valid = arg_vals->size & ~func_failed->size;
+        if (!valid) {
+            goto fail;
+        }
+        int i_size = choose_from(size_dist, valid);
         call->args.size = binding_argument_values.size[i_size];
-        trail = observe_choice(trail, i_size);
+        *p_trail = observe_choice(*p_trail, i_size);
+        blamed = &func_failed->size;
+        i_blamed = i_size;
     } else {
-        trail = observe_choice(trail, -1);
+        *p_trail = observe_choice(*p_trail, -1);
     }
 
-    const categorical_t* degree_dist = next_choice(trail);
+    const categorical_t* degree_dist = next_choice(*p_trail);
     if (func->degree) {
-        int i_degree = choose_from(degree_dist, arg_vals.degree);
+        long valid = arg_vals->degree & ~func_failed->degree;
+        if (!valid) {
+            goto fail;
+        }
+        int i_degree = choose_from(degree_dist, valid);
         call->args.degree = binding_argument_values.degree[i_degree];
-        trail = observe_choice(trail, i_degree);
+        *p_trail = observe_choice(*p_trail, i_degree);
+        blamed = &func_failed->degree;
+        i_blamed = i_degree;
     } else {
-        trail = observe_choice(trail, -1);
+        *p_trail = observe_choice(*p_trail, -1);
     }
 
-    const categorical_t* exclude_dist = next_choice(trail);
+    // the last argument only takes values for which the binding resolves
+    const categorical_t* exclude_dist = next_choice(*p_trail);
     if (func->exclude) {
-        int i_exclude = choose(exclude_dist);
+        long valid = func->color ? (1l << binding_argument_values.n_exclude) - 1
+                                 : resolving_excludes(graph, filter, call);
+        valid &= ~func_failed->exclude;
+        if (!valid) {
+            goto fail;
+        }
+        int i_exclude = choose_from(exclude_dist, valid);
         call->args.exclude = binding_argument_values.exclude[i_exclude];
-        trail = observe_choice(trail, i_exclude);
+        *p_trail = observe_choice(*p_trail, i_exclude);
+        blamed = &func_failed->exclude;
+        i_blamed = i_exclude;
     } else {
-        trail = observe_choice(trail, -1);
+        *p_trail = observe_choice(*p_trail, -1);
     }
 
-    const categorical_t* color_dist = next_choice(trail);
+    const categorical_t* color_dist = next_choice(*p_trail);
     if (func->color) {
-        int i_color = choose(color_dist);
+        long valid = resolving_colors(graph, filter, call);
+        if (!valid) {
+            goto fail;
+        }
+        int i_color = choose_from(color_dist, valid);
         call->args.color = binding_argument_values.color[i_color];
-        trail = observe_choice(trail, i_color);
+        *p_trail = observe_choice(*p_trail, i_color);
     } else {
-        trail = observe_choice(trail, -1);
+        *p_trail = observe_choice(*p_trail, -1);
+    }
+
+    if (!func->exclude && !func->color && !binding_matches(graph, filter, call)) {
+        goto fail;
     }
+    return true;
 
-    if (!binding_matches(graph, filter, call)) {
-        while (trail != *p_trail) {
-            trail = backtrack(trail);
+fail:
+    *blamed |= 1l << i_blamed;
+    return false;
+}
+
+binding_call_t* sample_binding(
+    task_t* task, const graph_t* graph, const filter_call_t* filter, trail_t** p_trail) {
+    binding_valid_arguments_t arg_vals;
+    get_binding_arguments(graph, &arg_vals);
+    arg_vals.func = get_binding_funcs(graph, filter);
+    long failed_funcs = 0;
+    binding_failed_arguments_t failed[binding_argument_values.n_bindings];
+    for (int i_func = 0; i_func < binding_argument_values.n_bindings; i_func++) {
+        failed[i_func] = (binding_failed_arguments_t){0, 0, 0};
+    }
+
+    binding_call_t* call = new_item(task->_mem_binding_calls);
+    trail_t* trail = *p_trail;
+    trail_mark_t mark = mark_trail(trail);
+    while (!sample_binding_arguments(
+        graph, filter, &arg_vals, &failed_funcs, failed, call, &trail)) {
+        // once every function failed, sampling again can not succeed
+        if (!resample_from(&mark, &trail) || !(arg_vals.func & ~failed_funcs)) {
+            release_mark(&mark);
+            task->rejections.binding++;
+            free_item(task->_mem_binding_calls, call);
+            return NULL;
         }
-        free_item(task->_mem_binding_calls, call);
-        return NULL;
-    } else {
-        *p_trail = trail;
-        return call;
+        task->rejections.resampled++;
     }
+    release_mark(&mark);
+    *p_trail = trail;
+    return call;
 }
 
 trail_t* observe_binding(trail_t* trail, const binding_call_t* call) {
@@ -15,6 +15,10 @@ typedef struct _binding_arguments {
 
 typedef struct _binding_func {
     node_t* (*func)(const graph_t*, const node_t*, const binding_arguments_t*);
+    // the bound node does not depend on the node being transformed
+    bool global;
+    // the condition on the bound node: any node of the graph when global, else a neighbor
+    bool (*filter)(const graph_t*, const node_t*, const filter_arguments_t*);
     bool size;
     bool degree;
     bool exclude;
@@ -31,8 +35,21 @@ typedef struct _binding_call {
 
 node_t* get_binding_node(const graph_t* graph, const node_t* node, const binding_call_t* call);
 
+// as get_binding_node, memoized on the node table of the graph until it is modified
+node_t* resolve_binding(const graph_t* graph, const node_t* node, const binding_call_t* call);
+
 void init_binding(guide_builder_t* guide);
 
+// whether the binding resolves for any of the nodes selected by the filter
+bool binding_matches(
+    const graph_t* graph, const filter_call_t* filter_call, const binding_call_t* binding_call);
+
+// bit per binding function that can resolve for some node selected by the filter
+long get_binding_funcs(const graph_t* graph, const filter_call_t* filter);
+
+// all binding calls over the argument values of init_binding, see enumerate_filters
+int enumerate_bindings(binding_call_t* calls, int max_calls);
+
 void add_binding(guide_builder_t* guide, const char* prefix);
 
 // sample a binding, or NULL when sample didn't match the graph/filter
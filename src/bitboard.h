@@ -0,0 +1,181 @@
+#ifndef __BITBOARD_H__
+#define __BITBOARD_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "graph.h"
+
+/**
+ * Pixels of (a part of) a graph as one 32 bit word per row, bit x of row y
+ * set when pixel (x, y) is.  ARC grids are at most 30x30, so translations,
+ * dilations and masks become a few word operations per row.
+ */
+#define BITBOARD_SIZE 32
+
+typedef struct _bitboard {
+    uint32_t rows[BITBOARD_SIZE];
+} bitboard_t;
+
+static inline bool fits_bitboard(const graph_t *graph) {
+    return graph->width <= BITBOARD_SIZE && graph->height <= BITBOARD_SIZE;
+}
+
+static inline void clear_bitboard(bitboard_t *board) {
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        board->rows[y] = 0;
+    }
+}
+
+static inline uint32_t _row_mask(int width) {
+    return (uint32_t)((1ull << width) - 1);
+}
+
+// all pixels inside the graph
+static inline void bounds_bitboard(const graph_t *graph, bitboard_t *board) {
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        board->rows[y] = y < graph->height ? _row_mask(graph->width) : 0;
+    }
+}
+
+// the pixels of the rectangle between the corners (inclusive)
+static inline void rectangle_bitboard(coordinate_t min, coordinate_t max, bitboard_t *board) {
+    uint32_t row = _row_mask(max.pri + 1) & ~_row_mask(min.pri);
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        board->rows[y] = y >= min.sec && y <= max.sec ? row : 0;
+    }
+}
+
+// pixels outside of the board are ignored, returns whether the pixel was set
+static inline bool set_pixel(bitboard_t *board, coordinate_t coord) {
+    if (unlikely(coord.pri < 0 || coord.sec < 0 || coord.pri >= BITBOARD_SIZE ||
+                 coord.sec >= BITBOARD_SIZE)) {
+        return false;
+    }
+    board->rows[coord.sec] |= 1u << coord.pri;
+    return true;
+}
+
+// add the pixels of the node, restricted to those with the color when it is not negative
+// returns false when some of them are not on the board
+static inline bool add_node_pixels(bitboard_t *board, const node_t *node, int color) {
+    bool on_board = true;
+    for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+        subnode_t subnode = next_subnode(&iter);
+        if (color < 0 || subnode.color == color) {
+            on_board &= set_pixel(board, subnode.coord);
+        }
+    }
+    return on_board;
+}
+
+// pixels of all nodes in the graph except the given one (which may be NULL)
+static inline void graph_bitboard(const graph_t *graph, const node_t *except, bitboard_t *board) {
+    clear_bitboard(board);
+    for (const node_t *node = graph->nodes; node; node = node->next) {
+        if (node != except) {
+            add_node_pixels(board, node, -1);
+        }
+    }
+}
+
+// translate all pixels, pixels moved off the board are lost (in and out may be the same)
+static inline void shift_bitboard(const bitboard_t *in, int dx, int dy, bitboard_t *out) {
+    bitboard_t src = *in;
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        int from = y - dy;
+        uint32_t row = from >= 0 && from < BITBOARD_SIZE ? src.rows[from] : 0;
+        if (dx >= BITBOARD_SIZE || dx <= -BITBOARD_SIZE) {
+            row = 0;
+        } else if (dx > 0) {
+            row <<= dx;
+        } else if (dx < 0) {
+            row >>= -dx;
+        }
+        out->rows[y] = row;
+    }
+}
+
+// add the 8-connected neighbors of all pixels
+static inline void dilate_bitboard(const bitboard_t *in, bitboard_t *out) {
+    uint32_t prev = 0;
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        uint32_t next = y + 1 < BITBOARD_SIZE ? in->rows[y + 1] : 0;
+        uint32_t rows = prev | in->rows[y] | next;
+        prev = in->rows[y];
+        out->rows[y] = rows | rows << 1 | rows >> 1;
+    }
+}
+
+static inline void and_bitboard(bitboard_t *board, const bitboard_t *mask) {
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        board->rows[y] &= mask->rows[y];
+    }
+}
+
+static inline void and_not_bitboard(bitboard_t *board, const bitboard_t *mask) {
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        board->rows[y] &= ~mask->rows[y];
+    }
+}
+
+static inline void or_bitboard(bitboard_t *board, const bitboard_t *other) {
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        board->rows[y] |= other->rows[y];
+    }
+}
+
+static inline bool is_empty_bitboard(const bitboard_t *board) {
+    uint32_t any = 0;
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        any |= board->rows[y];
+    }
+    return any == 0;
+}
+
+// the smallest rectangle containing all pixels, false when there are none
+static inline bool bitboard_bounding_box(
+    const bitboard_t *board, coordinate_t *min, coordinate_t *max) {
+    uint32_t columns = 0;
+    min->sec = max->sec = -1;
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        if (board->rows[y]) {
+            if (min->sec < 0) {
+                min->sec = y;
+            }
+            max->sec = y;
+            columns |= board->rows[y];
+        }
+    }
+    if (!columns) {
+        return false;
+    }
+    min->pri = __builtin_ctz(columns);
+    max->pri = 31 - __builtin_clz(columns);
+    return true;
+}
+
+static inline int count_bitboard(const bitboard_t *board) {
+    int count = 0;
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        count += __builtin_popcount(board->rows[y]);
+    }
+    return count;
+}
+
+// append the pixels of the board to the node in row-major order, nothing is added on failure
+static inline bool append_bitboard(
+    graph_t *graph, node_t *node, const bitboard_t *board, color_t color) {
+    if (unlikely(!reserve_subnodes(graph, node, node->n_subnodes + count_bitboard(board)))) {
+        return false;
+    }
+    for (int y = 0; y < BITBOARD_SIZE; y++) {
+        for (uint32_t row = board->rows[y]; row; row &= row - 1) {
+            coordinate_t coord = {__builtin_ctz(row), y};
+            append_subnode(graph, node, (subnode_t){coord, color});
+        }
+    }
+    return true;
+}
+
+#endif  // __BITBOARD_H__
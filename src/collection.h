@@ -135,13 +135,13 @@ static inline int bitset_size(const graph_t *graph) {
 
 static inline void add_coordinate(const graph_t *graph, long *bitset, coordinate_t coord) {
     int index = coord.sec * graph->width + coord.pri;
-    bitset[index / 64] |= 1 << (index % 64);
+    bitset[index / 64] |= 1l << (index % 64);
 }
 
 static inline bool coordinate_in_set(
     const graph_t *graph, const long *bitset, coordinate_t coord) {
     int index = coord.sec * graph->width + coord.pri;
-    return bitset[index / 64] & (1 << (index % 64));
+    return bitset[index / 64] & (1l << (index % 64));
 }
 
 #endif  // __COLLECTION_H__
\ No newline at end of file
@@ -1,7 +1,6 @@
 #include "filter.h"
 
 #include "guide.h"
-#include "util.h"
 
 #define MAX_ARGUMENT_VALUES 20
 
@@ -22,15 +21,15 @@ bool filter_by_color(const graph_t* graph, const node_t* node, const filter_argu
     }
     if (graph->is_multicolor) {
         if (!args->exclude) {
-            for (int i = 0; i < node->n_subnodes; i++) {
-                if (get_subnode(node, i).color == color) {
+            for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+                if (next_subnode(&iter).color == color) {
                     return true;
                 }
             }
             return false;
         } else {
-            for (int i = 0; i < node->n_subnodes; i++) {
-                if (get_subnode(node, i).color == color) {
+            for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+                if (next_subnode(&iter).color == color) {
                     return false;
                 }
             }
@@ -118,11 +117,11 @@ bool filter_by_neighbor_size(
             }
         } else {
             if (args->exclude) {
-                if (node->n_subnodes != size) {
+                if (peer->n_subnodes != size) {
                     return true;
                 }
             } else {
-                if (node->n_subnodes == size) {
+                if (peer->n_subnodes == size) {
                     return true;
                 }
             }
@@ -182,41 +181,113 @@ bool filter_by_neighbor_degree(
     return false;
 }
 
+filter_term_t compile_by_color(const node_table_t* table, const filter_arguments_t* args) {
+    return (filter_term_t){
+        .column = table->colors,
+        .op = TERM_ANY_BITS,
+        .value = color_bit(resolve_color(table, args->color)),
+        .exclude = args->exclude,
+    };
+}
+
+filter_term_t compile_by_size(const node_table_t* table, const filter_arguments_t* args) {
+    filter_term_t term = {.column = table->size, .op = TERM_EQUAL};
+    if (args->size == ODD_SIZE) {
+        term.op = TERM_ANY_BITS;
+        term.value = 1;
+        term.exclude = args->exclude;
+    } else if (args->size == MAX_SIZE) {
+        term.value = table->derived.max_size;
+    } else if (args->size == MIN_SIZE) {
+        term.value = table->derived.min_size;
+    } else if (args->size >= 0) {
+        term.value = args->size;
+        term.exclude = args->exclude;
+    } else {
+        term.op = TERM_NONE;
+        term.exclude = args->exclude;
+    }
+    return term;
+}
+
+filter_term_t compile_by_degree(const node_table_t* table, const filter_arguments_t* args) {
+    return (filter_term_t){
+        .column = table->degree,
+        .op = args->degree >= 0 ? TERM_EQUAL : TERM_NONE,
+        .value = args->degree >= 0 ? args->degree : 0,
+        .exclude = args->exclude,
+    };
+}
+
+filter_term_t compile_by_neighbor_size(
+    const node_table_t* table, const filter_arguments_t* args) {
+    filter_term_t term = compile_by_size(table, args);
+    term.neighbor = true;
+    return term;
+}
+
+filter_term_t compile_by_neighbor_color(
+    const node_table_t* table, const filter_arguments_t* args) {
+    unsigned short bit = color_bit(resolve_color(table, args->color));
+    // when excluding, some neighbor has to have another color
+    return (filter_term_t){
+        .column = table->neighbor_colors,
+        .op = TERM_ANY_BITS,
+        .value = args->exclude ? ~bit : bit,
+    };
+}
+
+filter_term_t compile_by_neighbor_degree(
+    const node_table_t* table, const filter_arguments_t* args) {
+    filter_term_t term = compile_by_degree(table, args);
+    term.neighbor = true;
+    return term;
+}
+
 filter_func_t filter_funcs[] = {
     {
         .func = filter_by_color,
+        .compile = compile_by_color,
         .color = true,
         .exclude = true,
         .name = "filter_by_color",
     },
     {
         .func = filter_by_size,
+        .compile = compile_by_size,
         .size = true,
         .exclude = true,
         .name = "filter_by_size",
     },
     {
         .func = filter_by_degree,
+        .compile = compile_by_degree,
         .degree = true,
         .exclude = true,
         .name = "filter_by_degree",
     },
     {
         .func = filter_by_neighbor_color,
+        .compile = compile_by_neighbor_color,
         .color = true,
         .exclude = true,
+        .neighbor = true,
         .name = "filter_by_neighbor_color",
     },
     {
         .func = filter_by_neighbor_size,
+        .compile = compile_by_neighbor_size,
         .size = true,
         .exclude = true,
+        .neighbor = true,
         .name = "filter_by_neighbor_size",
     },
     {
         .func = filter_by_neighbor_degree,
+        .compile = compile_by_neighbor_degree,
         .degree = true,
         .exclude = true,
+        .neighbor = true,
         .name = "filter_by_neighbor_degree",
     },
     {
@@ -233,21 +304,118 @@ bool apply_filter(const graph_t* graph, const node_t* node, const filter_call_t*
     return true;
 }
 
-bool filter_matches(const graph_t* graph, const filter_call_t* call) {
-    bool found_node = false;
-    for (const node_t* node = graph->nodes; node; node = node->next) {
-        if (apply_filter(graph, node, call)) {
-            found_node = true;
-            break;
+// lower is more selective: explicit values first, then exclusions, neighbors (expensive) last
+static int term_rank(const filter_term_t* term) {
+    int rank;
+    if (term->exclude) {
+        rank = 2;
+    } else if (term->op == TERM_ANY_BITS && __builtin_popcount(term->value) > 1) {
+        rank = 1;
+    } else {
+        rank = 0;
+    }
+    return term->neighbor ? rank + 3 : rank;
+}
+
+void compile_filter(
+    const node_table_t* table, const filter_call_t* call, compiled_filter_t* compiled) {
+    compiled->table = table;
+    compiled->never = false;
+    compiled->n_terms = 0;
+    for (const filter_call_t* current = call; current; current = current->next_in_multi) {
+        filter_term_t term = current->filter->compile(table, &current->args);
+        if (term.op == TERM_ANY_BITS && term.value == 0) {
+            term.op = TERM_NONE;
         }
+        if (term.op == TERM_NONE) {
+            if (!term.exclude) {
+                compiled->never = true;
+                return;
+            } else if (!term.neighbor) {
+                continue;
+            }
+            // any neighbor will do
+            term = (filter_term_t){
+                .column = table->degree,
+                .op = TERM_EQUAL,
+                .value = 0,
+                .exclude = true,
+            };
+        }
+
+        // insert in order of selectivity
+        assert(compiled->n_terms < MAX_FILTER_TERMS);
+        int idx = compiled->n_terms++;
+        while (idx > 0 && term_rank(&compiled->terms[idx - 1]) > term_rank(&term)) {
+            compiled->terms[idx] = compiled->terms[idx - 1];
+            idx--;
+        }
+        compiled->terms[idx] = term;
     }
-    if (!found_node) {
-        return false;
+}
+
+static inline unsigned int match_term_chunk(const filter_term_t* term, int idx) {
+    unsigned int bits = term->op == TERM_EQUAL
+                            ? match_chunk_equal(term->column, idx, term->value)
+                            : match_chunk_any_bits(term->column, idx, term->value);
+    return term->exclude ? bits ^ 0xffff : bits;
+}
+
+int run_filter(const compiled_filter_t* compiled, unsigned long* matches) {
+    const node_table_t* table = compiled->table;
+    int n_words = NODE_MASK_WORDS(table->n_nodes);
+    for (int i = 0; i < n_words; i++) {
+        matches[i] = 0;
     }
-    return true;
+    if (compiled->never) {
+        return 0;
+    }
+
+    // the terms on the node itself in a single pass, a chunk is done when none of its nodes match
+    int n_local = 0;
+    while (n_local < compiled->n_terms && !compiled->terms[n_local].neighbor) {
+        n_local++;
+    }
+    bool any_match = false;
+    for (int idx = 0; idx < padded_nodes(table); idx += NODE_CHUNK) {
+        unsigned int bits = 0xffff;
+        for (int i = 0; bits && i < n_local; i++) {
+            bits &= match_term_chunk(&compiled->terms[i], idx);
+        }
+        set_chunk_matches(matches, idx, bits);
+        any_match |= bits != 0;
+    }
+    clear_padding(table, matches);
+
+    // neighbor terms, for the nodes that are left
+    for (int i = n_local; any_match && i < compiled->n_terms; i++) {
+        unsigned long peers[n_words];
+        for (int j = 0; j < n_words; j++) {
+            peers[j] = 0;
+        }
+        for (int idx = 0; idx < padded_nodes(table); idx += NODE_CHUNK) {
+            set_chunk_matches(peers, idx, match_term_chunk(&compiled->terms[i], idx));
+        }
+        keep_with_neighbor(table, peers, matches);
+    }
+    return count_matches(table, matches);
+}
+
+int apply_filter_batch(
+    const node_table_t* table, const filter_call_t* call, unsigned long* matches) {
+    compiled_filter_t compiled;
+    compile_filter(table, call, &compiled);
+    return run_filter(&compiled, matches);
+}
+
+bool filter_matches(const graph_t* graph, const filter_call_t* call) {
+    const node_table_t* table = get_node_table(graph);
+    unsigned long matches[NODE_MASK_WORDS(table->n_nodes)];
+    return apply_filter_batch(table, call, matches) > 0;
 }
 
 struct {
+    int n_funcs;
     int n_size;
     int n_degree;
     int n_exclude;
@@ -259,6 +427,7 @@ struct {
 } filter_argument_values;
 
 typedef struct {
+    long func;
     long size;
     long degree;
 } filter_valid_arguments_t;
@@ -266,6 +435,7 @@ typedef struct {
 void get_filter_arguments(const graph_t* graph, filter_valid_arguments_t* valid) {
     valid->size = 1 << 0 | 1 << 1 | 1 << 2;
     valid->degree = 1 << 0 | 1 << 1 | 1 << 2;
+    bool has_edges = false;
     for (const node_t* node = graph->nodes; node; node = node->next) {
         for (int j = 3; j < filter_argument_values.n_size; j++) {
             if (filter_argument_values.size[j] == node->n_subnodes) {
@@ -279,7 +449,76 @@ void get_filter_arguments(const graph_t* graph, filter_valid_arguments_t* valid)
                 break;
             }
         }
+        has_edges |= node->n_edges > 0;
+    }
+    valid->func = 0;
+    for (int i_func = 0; filter_funcs[i_func].func; i_func++) {
+        if (has_edges || !filter_funcs[i_func].neighbor) {
+            valid->func |= 1l << i_func;
+        }
+    }
+}
+
+// the values of exclude for which the call selects any node, from a single pass over the table
+long matching_excludes(const graph_t* graph, filter_call_t* call) {
+    const node_table_t* table = get_node_table(graph);
+    // the largest and smallest size select the same nodes either way
+    call->args.exclude = true;
+    bool excludes = call->filter->compile(table, &call->args).exclude;
+    call->args.exclude = false;
+    filter_term_t term = call->filter->compile(table, &call->args);
+    if (term.op == TERM_NONE) {
+        term.op = TERM_ANY_BITS;
+        term.value = 0;
+    }
+
+    // a term on the neighbors selects a node when it holds (or not) for a node with neighbors
+    unsigned int included = 0;
+    unsigned int excluded = 0;
+    for (int idx = 0; idx < padded_nodes(table); idx += NODE_CHUNK) {
+        int n_left = table->n_nodes - idx;
+        unsigned int counted = n_left < NODE_CHUNK ? (1u << n_left) - 1 : 0xffff;
+        if (term.neighbor) {
+            counted &= match_chunk_equal(table->degree, idx, 0) ^ 0xffff;
+        }
+        unsigned int bits = match_term_chunk(&term, idx);
+        included |= bits & counted;
+        excluded |= ~bits & counted;
+    }
+
+    long valid = 0;
+    for (int i = 0; i < filter_argument_values.n_exclude; i++) {
+        bool exclude = filter_argument_values.exclude[i] && excludes;
+        if (exclude ? excluded : included) {
+            valid |= 1l << i;
+        }
+    }
+    return valid;
+}
+
+// whether a term on the colors selects any node, from the colors present in the table
+static bool selects_any_color(const node_table_t* table, const filter_term_t* term) {
+    if (term->column == table->neighbor_colors) {
+        return table->any_neighbor_colors & term->value;
+    } else if (!term->exclude) {
+        return table->any_colors & term->value;
+    }
+    // a single color (see compile_by_color), which some node does not have
+    return table->n_nodes > 0 && !(table->all_colors & term->value);
+}
+
+// the colors for which the call selects any node
+long matching_colors(const graph_t* graph, filter_call_t* call) {
+    const node_table_t* table = get_node_table(graph);
+    long valid = 0;
+    for (int i = 0; i < filter_argument_values.n_color; i++) {
+        call->args.color = filter_argument_values.color[i];
+        filter_term_t term = call->filter->compile(table, &call->args);
+        if (selects_any_color(table, &term)) {
+            valid |= 1l << i;
+        }
     }
+    return valid;
 }
 
 void init_filter(guide_builder_t* builder) {
@@ -288,6 +527,7 @@ void init_filter(guide_builder_t* builder) {
         n_filters++;
     }
     add_choice(builder, n_filters, "filter");
+    filter_argument_values.n_funcs = n_filters;
 
     filter_argument_values.n_size = MAX_ARGUMENT_VALUES;
     int* size = filter_argument_values.size;
@@ -325,69 +565,175 @@ void init_filter(guide_builder_t* builder) {
     add_choice(builder, filter_argument_values.n_color, "filter:color");
 }
 
+int enumerate_filters(filter_call_t* calls, int max_calls) {
+    int n_calls = 0;
+    for (int i_func = 0; filter_funcs[i_func].func; i_func++) {
+        const filter_func_t* func = &filter_funcs[i_func];
+        int n_size = func->size ? filter_argument_values.n_size : 1;
+        int n_degree = func->degree ? filter_argument_values.n_degree : 1;
+        int n_exclude = func->exclude ? filter_argument_values.n_exclude : 1;
+        int n_color = func->color ? filter_argument_values.n_color : 1;
+        for (int i_size = 0; i_size < n_size; i_size++) {
+            for (int i_degree = 0; i_degree < n_degree; i_degree++) {
+                for (int i_exclude = 0; i_exclude < n_exclude; i_exclude++) {
+                    for (int i_color = 0; i_color < n_color; i_color++) {
+                        if (n_calls == max_calls) {
+                            return n_calls;
+                        }
+                        calls[n_calls++] = (filter_call_t){
+                            .filter = func,
+                            .args = {
+                                .size = func->size ? filter_argument_values.size[i_size] : 0,
+                                .degree =
+                                    func->degree ? filter_argument_values.degree[i_degree] : 0,
+                                .exclude = func->exclude
+                                               ? filter_argument_values.exclude[i_exclude]
+                                               : false,
+                                .color = func->color ? filter_argument_values.color[i_color] : 0,
+                            },
+                        };
+                    }
+                }
+            }
+        }
+    }
+    return n_calls;
+}
+
 /**
  * Sample a filter, may return NULL when the created sample turned out to be invalid
  */
-filter_call_t* sample_filter(task_t* task, const graph_t* graph, trail_t** p_trail) {
-    filter_valid_arguments_t arg_vals;
-    get_filter_arguments(graph, &arg_vals);
-
-    filter_call_t* call = new_item(task->_mem_filter_calls);
-    call->next_in_multi = NULL;
-    trail_t* trail = *p_trail;
+// argument values that lead to a failure with a filter function, see sample_filter_arguments
+typedef struct {
+    long size;
+    long degree;
+    long exclude;
+} filter_failed_arguments_t;
 
-    const categorical_t* func_dist = next_choice(trail);
-    int i_func = choose(func_dist);
+/**
+ * Sample the function and arguments of the call, excluding the combinations
+ * that failed before.  On failure the function, or the last argument before
+ * the one that was left without valid values, is added to them.
+ */
+static bool sample_filter_arguments(
+    const graph_t* graph,
+    const filter_valid_arguments_t* arg_vals,
+    long* failed_funcs,
+    filter_failed_arguments_t* failed,
+    filter_call_t* call,
+    trail_t** p_trail) {
+    const categorical_t* func_dist = next_choice(*p_trail);
+    long valid_funcs = arg_vals->func & ~*failed_funcs;
+    if (!valid_funcs) {
+        return false;
+    }
+    int i_func = choose_from(func_dist, valid_funcs);
     filter_func_t* func = &filter_funcs[i_func];
     call->filter = func;
-    trail = observe_choice(trail, i_func);
+    call->args = (filter_arguments_t){0};
+    *p_trail = observe_choice(*p_trail, i_func);
+
+    filter_failed_arguments_t* func_failed = &failed[i_func];
+    long* blamed = failed_funcs;
+    int i_blamed = i_func;
 
-    const categorical_t* size_dist = next_choice(trail);
+    const categorical_t* size_dist = next_choice(*p_trail);
     if (func->size) {
-        int i_size = choose_from(size_dist, arg_vals.size);
+        long valid = arg_vals->size & ~func_failed->size;
+        if (!valid) {
+            goto fail;
+        }
+        int i_size = choose_from(size_dist, valid);
         call->args.size = filter_argument_values.size[i_size];
-        trail = observe_choice(trail, i_size);
+        *p_trail = observe_choice(*p_trail, i_size);
+        blamed = &func_failed->size;
+        i_blamed = i_size;
     } else {
-        trail = observe_choice(trail, -1);
+        *p_trail = observe_choice(*p_trail, -1);
     }
 
-    const categorical_t* degree_dist = next_choice(trail);
+    const categorical_t* degree_dist = next_choice(*p_trail);
     if (func->degree) {
-        int i_degree = choose_from(degree_dist, arg_vals.degree);
+        long valid = arg_vals->degree & ~func_failed->degree;
+        if (!valid) {
+            goto fail;
+        }
+        int i_degree = choose_from(degree_dist, valid);
         call->args.degree = filter_argument_values.degree[i_degree];
-        trail = observe_choice(trail, i_degree);
+        *p_trail = observe_choice(*p_trail, i_degree);
+        blamed = &func_failed->degree;
+        i_blamed = i_degree;
     } else {
-        trail = observe_choice(trail, -1);
+        *p_trail = observe_choice(*p_trail, -1);
     }
 
-    const categorical_t* exclude_dist = next_choice(trail);
+    // the last argument only takes values for which some node is selected
+    const categorical_t* exclude_dist = next_choice(*p_trail);
     if (func->exclude) {
-        int i_exclude = choose(exclude_dist);
+        long valid = func->color ? (1l << filter_argument_values.n_exclude) - 1
+                                 : matching_excludes(graph, call);
+        valid &= ~func_failed->exclude;
+        if (!valid) {
+            goto fail;
+        }
+        int i_exclude = choose_from(exclude_dist, valid);
         call->args.exclude = filter_argument_values.exclude[i_exclude];
-        trail = observe_choice(trail, i_exclude);
+        *p_trail = observe_choice(*p_trail, i_exclude);
+        blamed = &func_failed->exclude;
+        i_blamed = i_exclude;
     } else {
-        trail = observe_choice(trail, -1);
+        *p_trail = observe_choice(*p_trail, -1);
     }
 
-    const categorical_t* color_dist = next_choice(trail);
+    const categorical_t* color_dist = next_choice(*p_trail);
     if (func->color) {
-        int i_color = choose(color_dist);
+        long valid = matching_colors(graph, call);
+        if (!valid) {
+            goto fail;
+        }
+        int i_color = choose_from(color_dist, valid);
         call->args.color = filter_argument_values.color[i_color];
-        trail = observe_choice(trail, i_color);
+        *p_trail = observe_choice(*p_trail, i_color);
     } else {
-        trail = observe_choice(trail, -1);
+        *p_trail = observe_choice(*p_trail, -1);
     }
 
-    if (!filter_matches(graph, call)) {
-        while (trail != *p_trail) {
-            trail = backtrack(trail);
+    if (!func->exclude && !func->color && !filter_matches(graph, call)) {
+        goto fail;
+    }
+    return true;
+
+fail:
+    *blamed |= 1l << i_blamed;
+    return false;
+}
+
+filter_call_t* sample_filter(task_t* task, const graph_t* graph, trail_t** p_trail) {
+    filter_valid_arguments_t arg_vals;
+    get_filter_arguments(graph, &arg_vals);
+    long failed_funcs = 0;
+    filter_failed_arguments_t failed[filter_argument_values.n_funcs];
+    for (int i_func = 0; i_func < filter_argument_values.n_funcs; i_func++) {
+        failed[i_func] = (filter_failed_arguments_t){0, 0, 0};
+    }
+
+    filter_call_t* call = new_item(task->_mem_filter_calls);
+    call->next_in_multi = NULL;
+    trail_t* trail = *p_trail;
+    trail_mark_t mark = mark_trail(trail);
+    while (!sample_filter_arguments(graph, &arg_vals, &failed_funcs, failed, call, &trail)) {
+        // once every function failed, sampling again can not succeed
+        if (!resample_from(&mark, &trail) || !(arg_vals.func & ~failed_funcs)) {
+            release_mark(&mark);
+            task->rejections.filter++;
+            free_item(task->_mem_filter_calls, call);
+            return NULL;
         }
-        free_item(task->_mem_filter_calls, call);
-        return NULL;
-    } else {
-        *p_trail = trail;
-        return call;
+        task->rejections.resampled++;
     }
+    release_mark(&mark);
+    *p_trail = trail;
+    return call;
 }
 
 trail_t* observe_filter(trail_t* trail, const filter_call_t* call) {
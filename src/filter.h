@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 
+#include "node_table.h"
 #include "graph.h"
 #include "image.h"
 #include "task.h"
@@ -14,12 +15,32 @@ typedef struct _filter_arguments {
     color_t color;
 } filter_arguments_t;
 
+typedef enum _term_op {
+    TERM_EQUAL,     // the column equals the value
+    TERM_ANY_BITS,  // the column has any of the bits in the value
+    TERM_NONE,      // no node matches
+} term_op_t;
+
+// a filter with its (symbolic) arguments resolved against a node table
+typedef struct _filter_term {
+    const unsigned short* column;
+    term_op_t op;
+    unsigned short value;
+    bool exclude;
+    // the term has to hold for a neighbor of the node
+    bool neighbor;
+} filter_term_t;
+
 typedef struct _filter_func {
     bool (*func)(const graph_t*, const node_t*, const filter_arguments_t*);
+    // the same filter, as a term on the columns of the table
+    filter_term_t (*compile)(const node_table_t*, const filter_arguments_t*);
     bool size;
     bool degree;
     bool exclude;
     bool color;
+    // the filter looks at the neighbors of a node, so nothing matches without edges
+    bool neighbor;
     const char* name;
 } filter_func_t;
 
@@ -34,6 +55,33 @@ typedef struct _filter_call {
 
 bool apply_filter(const graph_t* graph, const node_t* node, const filter_call_t* call);
 
+#define MAX_FILTER_TERMS 8
+
+/**
+ * A filter chain compiled against the node table of a graph: a conjunction
+ * of terms, ordered such that the most selective ones are checked first.
+ */
+typedef struct _compiled_filter {
+    const node_table_t* table;
+    bool never;
+    int n_terms;
+    filter_term_t terms[MAX_FILTER_TERMS];
+} compiled_filter_t;
+
+void compile_filter(
+    const node_table_t* table, const filter_call_t* call, compiled_filter_t* compiled);
+
+/**
+ * Evaluate the compiled filter on all nodes of the table, the matches get a
+ * bit per node (see node_table_t) and need NODE_MASK_WORDS(n_nodes) words.
+ * Returns the number of matching nodes.
+ */
+int run_filter(const compiled_filter_t* compiled, unsigned long* matches);
+
+// compile and run the filter in one go
+int apply_filter_batch(
+    const node_table_t* table, const filter_call_t* call, unsigned long* matches);
+
 bool filter_by_size(const graph_t* graph, const node_t* node, const filter_arguments_t* args);
 bool filter_by_color(const graph_t* graph, const node_t* node, const filter_arguments_t* args);
 bool filter_by_degree(const graph_t* graph, const node_t* node, const filter_arguments_t* args);
@@ -42,6 +90,15 @@ filter_call_t* get_candidate_filters(task_t* task, const abstraction_t* abstract
 
 void init_filter(guide_builder_t* guide);
 
+// whether the filter selects any node of the graph
+bool filter_matches(const graph_t* graph, const filter_call_t* call);
+
+/**
+ * All single filter calls over the argument values of init_filter, in a fixed
+ * order.  Stores at most max_calls and returns the number stored.
+ */
+int enumerate_filters(filter_call_t* calls, int max_calls);
+
 filter_call_t* sample_filter(task_t* task, const graph_t* graph, trail_t** p_trail);
 
 trail_t * observe_filter(trail_t* trail, const filter_call_t* call);
@@ -3,14 +3,15 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #define NODE_INDEX_SIZE 1024
 #define NODES_ALLOC 1024
 #define EDGES_ALLOC 4096
-#define SUBNODE_BLOCK_SIZE 11
-#define SUBNODE_BLOCKS_ALLOC 2048
+#define SUBNODES_ALLOC 32768
 
 #define likely(x) __builtin_expect(!!(x), 1)
 #define unlikely(x) __builtin_expect(!!(x), 0)
@@ -44,19 +45,16 @@ typedef struct _subnode {
 
 struct _edge;
 
-// premature optimization: fits on a cacheline (64 bytes)
-typedef struct _subnode_block {
-    struct _subnode_block *next;
-    coordinate_t subnode[SUBNODE_BLOCK_SIZE];
-    color_t color[SUBNODE_BLOCK_SIZE];
-} subnode_block_t;
-
+// subnodes are stored as contiguous coordinate and color arrays, carved from the graph arena
 typedef struct _node {
     struct _node *next;
+    struct _node **pprev;
     struct _edge *edges;
-    struct _subnode_block *subnodes;
+    coordinate_t *subnode_coords;
+    color_t *subnode_colors;
     struct _coordinate coord;
     unsigned short n_subnodes;
+    unsigned short _subnodes_capacity;
     unsigned short n_edges;
 } node_t;
 
@@ -67,13 +65,21 @@ typedef enum _edge_direction {
 } edge_direction_t;
 
 // premature optimization: fits with partner on a cacheline (64 bytes)
+// edges are allocated as aligned pairs, so the partner follows from the address
 typedef struct _edge {
     struct _edge *next;
-    struct _edge *swap;
+    struct _edge **pprev;
     struct _node *peer;
     edge_direction_t direction;
 } edge_t;
 
+#define EDGE_PAIR_SIZE (2 * sizeof(edge_t))
+_Static_assert(EDGE_PAIR_SIZE == 64, "edge pairs should fill a cacheline");
+
+static inline edge_t *edge_partner(const edge_t *edge) {
+    return (edge_t *)((uintptr_t)edge ^ sizeof(edge_t));
+}
+
 typedef struct _graph {
     // nodes, in (reverse) order of allocation
     // only exception is that nodes with the same index are grouped together
@@ -87,19 +93,26 @@ typedef struct _graph {
     // derived properties
     bool _has_changed;
     derived_props_t _derived;
+    struct _node_table *_node_table;
 
     // dimensions
     unsigned short width;
     unsigned short height;
 
     // memory management for mutating the graph
+    // entries are taken from the free lists first, then from the unused tail of the arena
     unsigned short n_nodes;
     unsigned short _nodes_available;
     unsigned short _edges_available;
-    unsigned short _blocks_available;
+    unsigned short _nodes_used;
+    unsigned short _edges_used;
     node_t *_free_nodes;
     edge_t *_free_edges;
-    subnode_block_t *_free_blocks;
+
+    // arena for subnodes, space is only reclaimed when it is at the end
+    unsigned int _subnodes_used;
+    coordinate_t *_subnode_coords;
+    color_t *_subnode_colors;
 
     // nodes indexed by their node_id - this relies on sibling nodes being adjacent
     node_t *_index[NODE_INDEX_SIZE];
@@ -107,15 +120,10 @@ typedef struct _graph {
     // for freeing / cleanup
     node_t *_all_nodes;
     edge_t *_all_edges;
-    subnode_block_t *_all_blocks;
 } graph_t;
 
 static inline unsigned int node_id(coordinate_t coord) { return 32 * coord.pri + coord.sec; }
 
-struct _list_entry {
-    struct _list_entry *next;
-};
-
 #define _init_list(pphead) \
     { *pphead = NULL; }
 #define _insert_entry(pphead, pentry) \
@@ -123,18 +131,24 @@ struct _list_entry {
         (pentry)->next = *pphead;     \
         *pphead = pentry;             \
     }
-#define _remove_entry(pphead, pentry)                           \
-    {                                                           \
-        struct _list_entry **p = (struct _list_entry **)pphead; \
-        struct _list_entry *e = (struct _list_entry *)pentry;   \
-        if ((*p) == e) {                                        \
-            *p = e->next;                                       \
-        } else {                                                \
-            while ((*p)->next != e) {                           \
-                p = &((*p)->next);                              \
-            }                                                   \
-            (*p)->next = e->next;                               \
-        }                                                       \
+
+// doubly linked lists, entries have a pprev pointing at the link that refers to them
+// so that they can be removed in O(1)
+#define _link_entry(pplink, pentry)                  \
+    {                                                \
+        (pentry)->next = *(pplink);                  \
+        (pentry)->pprev = (pplink);                  \
+        if ((pentry)->next) {                        \
+            (pentry)->next->pprev = &(pentry)->next; \
+        }                                            \
+        *(pplink) = (pentry);                        \
+    }
+#define _unlink_entry(pentry)                           \
+    {                                                   \
+        *(pentry)->pprev = (pentry)->next;              \
+        if ((pentry)->next) {                           \
+            (pentry)->next->pprev = (pentry)->pprev;    \
+        }                                               \
     }
 
 static inline graph_t *new_graph(unsigned short width, unsigned short height) {
@@ -144,30 +158,26 @@ static inline graph_t *new_graph(unsigned short width, unsigned short height) {
     graph->height = height;
     graph->is_multicolor = false;
     graph->background_color = BACKGROUND_COLOR;
+    graph->_has_changed = true;
+    graph->_node_table = NULL;
 
     graph->n_nodes = 0;
     _init_list(&graph->nodes);
 
     _init_list(&graph->_free_nodes);
     graph->_nodes_available = NODES_ALLOC;
+    graph->_nodes_used = 0;
     graph->_all_nodes = malloc(NODES_ALLOC * sizeof(node_t));
-    for (int i = 0; i < NODES_ALLOC; i++) {
-        _insert_entry(&graph->_free_nodes, &graph->_all_nodes[i]);
-    }
 
+    // only the first edge of each pair is on the free list
     _init_list(&graph->_free_edges);
     graph->_edges_available = EDGES_ALLOC;
-    graph->_all_edges = malloc(EDGES_ALLOC * sizeof(edge_t));
-    for (int i = 0; i < EDGES_ALLOC; i++) {
-        _insert_entry(&graph->_free_edges, &graph->_all_edges[i]);
-    }
+    graph->_edges_used = 0;
+    graph->_all_edges = aligned_alloc(EDGE_PAIR_SIZE, EDGES_ALLOC * sizeof(edge_t));
 
-    _init_list(&graph->_free_blocks);
-    graph->_blocks_available = SUBNODE_BLOCKS_ALLOC;
-    graph->_all_blocks = malloc(SUBNODE_BLOCKS_ALLOC * sizeof(subnode_block_t));
-    for (int i = 0; i < SUBNODE_BLOCKS_ALLOC; i++) {
-        _insert_entry(&graph->_free_blocks, &graph->_all_blocks[i]);
-    }
+    graph->_subnodes_used = 0;
+    graph->_subnode_coords = malloc(SUBNODES_ALLOC * sizeof(coordinate_t));
+    graph->_subnode_colors = malloc(SUBNODES_ALLOC * sizeof(color_t));
 
     for (int idx = 0; idx < NODE_INDEX_SIZE; idx++) {
         graph->_index[idx] = NULL;
@@ -175,56 +185,142 @@ static inline graph_t *new_graph(unsigned short width, unsigned short height) {
     return graph;
 }
 
+// see node_table.h
+void free_node_table(struct _node_table *table);
+
+static inline void invalidate_node_table(graph_t *graph) {
+    if (graph->_node_table) {
+        free_node_table(graph->_node_table);
+        graph->_node_table = NULL;
+    }
+}
+
 static inline void free_graph(graph_t *graph) {
-    free(graph->_all_blocks);
+    invalidate_node_table(graph);
+    free(graph->_subnode_colors);
+    free(graph->_subnode_coords);
     free(graph->_all_edges);
     free(graph->_all_nodes);
     free(graph);
 }
 
-static inline subnode_block_t *new_subnode_block(graph_t *graph) {
-    if (graph->_blocks_available == 0) {
-        return NULL;
+// the address in the copy of a pointer into the graph or one of its arenas
+static inline void *_rebase_pointer(const graph_t *graph, graph_t *copy, const void *ptr) {
+    const char *p = ptr;
+#define _rebase(from, to, size)                                               \
+    if (p >= (const char *)(from) && p < (const char *)(from) + (size)) {     \
+        return (char *)(to) + (p - (const char *)(from));                     \
     }
-    subnode_block_t *block = graph->_free_blocks;
-    graph->_free_blocks = block->next;
-    block->next = NULL;
-    graph->_blocks_available--;
-    return block;
+    _rebase(graph, copy, sizeof(graph_t));
+    _rebase(graph->_all_nodes, copy->_all_nodes, NODES_ALLOC * sizeof(node_t));
+    _rebase(graph->_all_edges, copy->_all_edges, EDGES_ALLOC * sizeof(edge_t));
+    _rebase(graph->_subnode_coords, copy->_subnode_coords,
+            SUBNODES_ALLOC * sizeof(coordinate_t));
+    _rebase(graph->_subnode_colors, copy->_subnode_colors, SUBNODES_ALLOC * sizeof(color_t));
+#undef _rebase
+    return NULL;
 }
 
-static inline bool add_subnode_to_block(graph_t *graph, subnode_block_t *block,
-                                        subnode_t subnode, int *n_subnodes) {
-                                            int n_blocks = 1;
-    subnode_block_t *last_block = block;
-    while (last_block->next) {
-        last_block = last_block->next;
-        n_blocks++;
+/**
+ * Independent copy of a graph, e.g. to continue transforming it in different
+ * ways.  The used parts of the arenas are copied and the links between nodes
+ * and edges are moved over to the copies.
+ */
+static inline graph_t *copy_graph(const graph_t *graph) {
+    graph_t *copy = malloc(sizeof(graph_t));
+    *copy = *graph;
+    copy->_node_table = NULL;
+    copy->_all_nodes = malloc(NODES_ALLOC * sizeof(node_t));
+    memcpy(copy->_all_nodes, graph->_all_nodes, graph->_nodes_used * sizeof(node_t));
+    copy->_all_edges = aligned_alloc(EDGE_PAIR_SIZE, EDGES_ALLOC * sizeof(edge_t));
+    memcpy(copy->_all_edges, graph->_all_edges, graph->_edges_used * sizeof(edge_t));
+    copy->_subnode_coords = malloc(SUBNODES_ALLOC * sizeof(coordinate_t));
+    memcpy(copy->_subnode_coords, graph->_subnode_coords,
+           graph->_subnodes_used * sizeof(coordinate_t));
+    copy->_subnode_colors = malloc(SUBNODES_ALLOC * sizeof(color_t));
+    memcpy(copy->_subnode_colors, graph->_subnode_colors,
+           graph->_subnodes_used * sizeof(color_t));
+
+    copy->nodes = _rebase_pointer(graph, copy, graph->nodes);
+    copy->_free_nodes = _rebase_pointer(graph, copy, graph->_free_nodes);
+    copy->_free_edges = _rebase_pointer(graph, copy, graph->_free_edges);
+    for (int idx = 0; idx < NODE_INDEX_SIZE; idx++) {
+        copy->_index[idx] = _rebase_pointer(graph, copy, graph->_index[idx]);
     }
-    if (*n_subnodes > 0 && (*n_subnodes % SUBNODE_BLOCK_SIZE) == 0) {
-        last_block->next = new_subnode_block(graph);
-        if (unlikely(!last_block->next)) {
-            return false;
+    // each edge is on the list of exactly one node, free entries only use their next link
+    for (node_t *node = copy->nodes; node; node = node->next) {
+        node->next = _rebase_pointer(graph, copy, node->next);
+        node->pprev = _rebase_pointer(graph, copy, node->pprev);
+        node->edges = _rebase_pointer(graph, copy, node->edges);
+        node->subnode_coords = _rebase_pointer(graph, copy, node->subnode_coords);
+        node->subnode_colors = _rebase_pointer(graph, copy, node->subnode_colors);
+        for (edge_t *edge = node->edges; edge; edge = edge->next) {
+            edge->next = _rebase_pointer(graph, copy, edge->next);
+            edge->pprev = _rebase_pointer(graph, copy, edge->pprev);
+            edge->peer = _rebase_pointer(graph, copy, edge->peer);
         }
-        last_block = last_block->next;
     }
-    int idx = (*n_subnodes) % SUBNODE_BLOCK_SIZE;
-    last_block->subnode[idx] = subnode.coord;
-    last_block->color[idx] = subnode.color;
-    (*n_subnodes)++;
+    for (node_t *node = copy->_free_nodes; node; node = node->next) {
+        node->next = _rebase_pointer(graph, copy, node->next);
+    }
+    for (edge_t *edge = copy->_free_edges; edge; edge = edge->next) {
+        edge->next = _rebase_pointer(graph, copy, edge->next);
+    }
+    return copy;
+}
+
+static inline bool _is_last_in_arena(const graph_t *graph, const node_t *node) {
+    return node->subnode_coords + node->_subnodes_capacity ==
+           graph->_subnode_coords + graph->_subnodes_used;
+}
+
+// make room for at least n_subnodes, doubling the capacity so that appending is amortized O(1)
+static inline bool reserve_subnodes(graph_t *graph, node_t *node, int n_subnodes) {
+    if (n_subnodes <= node->_subnodes_capacity) {
+        return true;
+    }
+    int capacity = node->_subnodes_capacity * 2;
+    if (capacity < n_subnodes) {
+        capacity = n_subnodes;
+    }
+    if (capacity > 0xffff) {
+        capacity = 0xffff;
+    }
+    if (unlikely(capacity < n_subnodes)) {
+        return false;
+    }
+
+    // grow in place when the node has the last allocation in the arena
+    unsigned int offset = graph->_subnodes_used;
+    if (node->_subnodes_capacity > 0 && _is_last_in_arena(graph, node)) {
+        offset = node->subnode_coords - graph->_subnode_coords;
+    }
+    if (unlikely(offset + capacity > SUBNODES_ALLOC)) {
+        return false;
+    }
+    coordinate_t *coords = graph->_subnode_coords + offset;
+    color_t *colors = graph->_subnode_colors + offset;
+    if (coords != node->subnode_coords) {
+        for (int i = 0; i < node->n_subnodes; i++) {
+            coords[i] = node->subnode_coords[i];
+            colors[i] = node->subnode_colors[i];
+        }
+    }
+    node->subnode_coords = coords;
+    node->subnode_colors = colors;
+    node->_subnodes_capacity = capacity;
+    graph->_subnodes_used = offset + capacity;
     return true;
 }
 
-static inline void free_subnode_block(graph_t *graph, subnode_block_t *block) {
-    subnode_block_t *last_block = block;
-    int n_blocks = 1;
-    while (last_block->next) {
-        last_block = last_block->next;
-        n_blocks++;
+static inline void _release_subnodes(graph_t *graph, node_t *node) {
+    if (node->_subnodes_capacity > 0 && _is_last_in_arena(graph, node)) {
+        graph->_subnodes_used -= node->_subnodes_capacity;
     }
-    last_block->next = graph->_free_blocks;
-    graph->_free_blocks = block;
-    graph->_blocks_available += n_blocks;
+    node->subnode_coords = NULL;
+    node->subnode_colors = NULL;
+    node->_subnodes_capacity = 0;
+    node->n_subnodes = 0;
 }
 
 // iterate over all nodes
@@ -235,33 +331,46 @@ static inline const node_t *next_node(const node_t *node) { return node->next; }
 
 static inline subnode_t get_subnode(const node_t *node, int idx) {
     assert(idx < node->n_subnodes);
-
-    subnode_block_t *block;
-    for (block = node->subnodes; idx >= SUBNODE_BLOCK_SIZE; block = block->next) {
-        idx = idx - SUBNODE_BLOCK_SIZE;
-    }
-    subnode_t subnode;
-    subnode.coord = block->subnode[idx];
-    subnode.color = block->color[idx];
-    return subnode;
+    return (subnode_t){node->subnode_coords[idx], node->subnode_colors[idx]};
 }
 
 static inline void set_subnode(const node_t *node, int idx, subnode_t subnode) {
     assert(idx < node->n_subnodes);
+    node->subnode_coords[idx] = subnode.coord;
+    node->subnode_colors[idx] = subnode.color;
+}
 
-    subnode_block_t *block;
-    for (block = node->subnodes; idx >= SUBNODE_BLOCK_SIZE; block = block->next) {
-        idx = idx - SUBNODE_BLOCK_SIZE;
+static inline bool append_subnode(graph_t *graph, node_t *node, subnode_t subnode) {
+    if (unlikely(!reserve_subnodes(graph, node, node->n_subnodes + 1))) {
+        return false;
     }
-    block->subnode[idx] = subnode.coord;
-    block->color[idx] = subnode.color;
+    invalidate_node_table(graph);
+    node->subnode_coords[node->n_subnodes] = subnode.coord;
+    node->subnode_colors[node->n_subnodes] = subnode.color;
+    node->n_subnodes++;
+    return true;
 }
 
-static inline void set_subnodes(graph_t *graph, node_t *node, subnode_block_t *block,
-                                int n_subnodes) {
-    free_subnode_block(graph, node->subnodes);
-    node->subnodes = block;
-    node->n_subnodes = n_subnodes;
+// iterate over the subnodes of a node
+
+typedef struct _subnode_iter {
+    const coordinate_t *coord;
+    const color_t *color;
+    const coordinate_t *end;
+} subnode_iter_t;
+
+static inline subnode_iter_t subnodes_of(const node_t *node) {
+    return (subnode_iter_t){
+        node->subnode_coords,
+        node->subnode_colors,
+        node->subnode_coords + node->n_subnodes,
+    };
+}
+
+static inline bool has_subnode(const subnode_iter_t *iter) { return iter->coord < iter->end; }
+
+static inline subnode_t next_subnode(subnode_iter_t *iter) {
+    return (subnode_t){*iter->coord++, *iter->color++};
 }
 
 // lookup
@@ -290,9 +399,8 @@ static inline derived_props_t get_derived_properties(const graph_t *graph) {
             if (max_size < 0 || max_size < node->n_subnodes) {
                 max_size = node->n_subnodes;
             }
-            for (int i = 0; i < node->n_subnodes; i++) {
-                subnode_t subnode = get_subnode(node, i);
-                counts[(unsigned char) subnode.color]++;
+            for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+                counts[(unsigned char) next_subnode(&iter).color]++;
             }
         }
         props->max_size = max_size;
@@ -322,38 +430,36 @@ static inline derived_props_t get_derived_properties(const graph_t *graph) {
 // mutate
 
 static inline node_t *add_node(graph_t *graph, coordinate_t coord, int n_subnodes) {
-    int n_blocks = (n_subnodes + SUBNODE_BLOCK_SIZE - 1) / SUBNODE_BLOCK_SIZE;
-    if (unlikely(graph->_nodes_available == 0 || graph->_blocks_available < n_blocks)) {
+    if (unlikely(graph->_nodes_available == 0 ||
+                 graph->_subnodes_used + n_subnodes > SUBNODES_ALLOC)) {
         return NULL;
     }
 
     node_t *node = graph->_free_nodes;
+    if (node) {
+        graph->_free_nodes = node->next;
+    } else {
+        node = &graph->_all_nodes[graph->_nodes_used++];
+    }
     graph->_nodes_available--;
     graph->n_nodes++;
     graph->_has_changed = true;
-
-    _remove_entry(&graph->_free_nodes, node);
+    invalidate_node_table(graph);
 
     unsigned int idx = node_id(coord) % NODE_INDEX_SIZE;
     node_t *sibling = graph->_index[idx];
     if (sibling) {
-        node->next = sibling->next;
-        sibling->next = node;
+        _link_entry(&sibling->next, node);
     } else {
         graph->_index[idx] = node;
-        _insert_entry(&graph->nodes, node);
+        _link_entry(&graph->nodes, node);
     }
 
-    graph->_blocks_available -= n_blocks;
-    node->subnodes = graph->_free_blocks;
-    subnode_block_t * last_block = NULL;
-    while (n_blocks-- > 0) {
-        last_block = graph->_free_blocks;
-        graph->_free_blocks = graph->_free_blocks->next;
-    }
-    if (last_block) {
-        last_block->next = NULL;
-    }
+    node->subnode_coords = NULL;
+    node->subnode_colors = NULL;
+    node->_subnodes_capacity = 0;
+    node->n_subnodes = 0;
+    reserve_subnodes(graph, node, n_subnodes);
     node->n_subnodes = n_subnodes;
     node->n_edges = 0;
 
@@ -363,16 +469,16 @@ static inline node_t *add_node(graph_t *graph, coordinate_t coord, int n_subnode
 }
 
 static inline void remove_edge(graph_t *graph, edge_t *edge) {
-    edge_t *other = edge->swap;
-    _remove_entry(&edge->peer->edges, other);
-    _remove_entry(&other->peer->edges, edge);
+    invalidate_node_table(graph);
+    edge_t *other = edge_partner(edge);
+    _unlink_entry(edge);
+    _unlink_entry(other);
     edge->peer->n_edges--;
     other->peer->n_edges--;
 
     graph->_edges_available += 2;
-    other->next = edge;
-    edge->next = graph->_free_edges;
-    graph->_free_edges = other;
+    edge_t *first = edge < other ? edge : other;
+    _insert_entry(&graph->_free_edges, first);
 }
 
 static inline void remove_node(graph_t *graph, node_t *node) {
@@ -391,23 +497,14 @@ static inline void remove_node(graph_t *graph, node_t *node) {
         remove_edge(graph, node->edges);
     }
 
-    _remove_entry(&graph->nodes, node);
+    _unlink_entry(node);
     _insert_entry(&graph->_free_nodes, node);
     graph->_nodes_available++;
     graph->n_nodes--;
     graph->_has_changed = true;
+    invalidate_node_table(graph);
 
-    int n_blocks = (node->n_subnodes + SUBNODE_BLOCK_SIZE - 1) / SUBNODE_BLOCK_SIZE;
-    if (unlikely(n_blocks == 0)) {
-        return;
-    }
-    graph->_blocks_available += n_blocks;
-    subnode_block_t *block = node->subnodes;
-    while (n_blocks-- > 1) {
-        block = block->next;
-    }
-    block->next = graph->_free_blocks;
-    graph->_free_blocks = node->subnodes;
+    _release_subnodes(graph, node);
 }
 
 static inline edge_t *add_edge(graph_t *graph, node_t *from, node_t *to,
@@ -417,22 +514,24 @@ static inline edge_t *add_edge(graph_t *graph, node_t *from, node_t *to,
     }
 
     graph->_edges_available -= 2;
+    invalidate_node_table(graph);
     edge_t *from_to = graph->_free_edges;
-    edge_t *to_from = from_to->next;
-    graph->_free_edges = to_from->next;
+    if (from_to) {
+        graph->_free_edges = from_to->next;
+    } else {
+        from_to = &graph->_all_edges[graph->_edges_used];
+        graph->_edges_used += 2;
+    }
+    edge_t *to_from = edge_partner(from_to);
 
-    from_to->next = from->edges;
-    from_to->swap = to_from;
     from_to->peer = to;
     from_to->direction = direction;
-    from->edges = from_to;
+    _link_entry(&from->edges, from_to);
     from->n_edges++;
 
-    to_from->next = to->edges;
-    to_from->swap = from_to;
     to_from->peer = from;
     to_from->direction = direction;
-    to->edges = to_from;
+    _link_entry(&to->edges, to_from);
     to->n_edges++;
 
     return from_to;
@@ -0,0 +1,60 @@
+#ifndef __GRID_H__
+#define __GRID_H__
+
+#include "graph.h"
+#include "raster.h"
+
+/**
+ * Implicit pixel graph on top of a raster.  Node ids are pixel indices and
+ * the (4-connected) neighbors follow from the dimensions, so apart from the
+ * pixels themselves nothing needs to be allocated.
+ */
+typedef struct _grid {
+    unsigned short width;
+    unsigned short height;
+    color_t background_color;
+    const color_t* pixels;
+} grid_t;
+
+// pixel graphs have black as their background
+static inline grid_t grid_from_raster(const raster_t* raster) {
+    return (grid_t){
+        .width = raster->width,
+        .height = raster->height,
+        .background_color = 0,
+        .pixels = raster->pixels,
+    };
+}
+
+static inline int grid_size(const grid_t* grid) { return grid->width * grid->height; }
+
+static inline int grid_index(const grid_t* grid, coordinate_t coord) {
+    return coord.sec * grid->width + coord.pri;
+}
+
+static inline coordinate_t grid_coord(const grid_t* grid, int idx) {
+    return (coordinate_t){idx % grid->width, idx / grid->width};
+}
+
+static inline color_t grid_color(const grid_t* grid, int idx) { return grid->pixels[idx]; }
+
+// store the indices of the neighbors of a pixel, returns their number
+static inline int grid_neighbors(const grid_t* grid, int idx, int neighbors[4]) {
+    int n_neighbors = 0;
+    int col = idx % grid->width;
+    if (col > 0) {
+        neighbors[n_neighbors++] = idx - 1;
+    }
+    if (col < grid->width - 1) {
+        neighbors[n_neighbors++] = idx + 1;
+    }
+    if (idx >= grid->width) {
+        neighbors[n_neighbors++] = idx - grid->width;
+    }
+    if (idx < grid_size(grid) - grid->width) {
+        neighbors[n_neighbors++] = idx + grid->width;
+    }
+    return n_neighbors;
+}
+
+#endif  // __GRID_H__
@@ -1,6 +1,7 @@
 #include "guide.h"
 
 #include <math.h>
+#include <string.h>
 
 #include "mtwister.h"
 #include "nnet.h"
@@ -16,6 +17,13 @@ guide_t* build_guide(guide_builder_t* builder) {
     guide->items = builder->items;
     guide->_trail_mem = new_block(256, sizeof(trail_t));
     guide->_random = seedRand(42l);
+    guide->_nnet_lock = malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(guide->_nnet_lock, NULL);
+    guide->_is_fork = false;
+    guide->max_resamples = 0;
+    guide->inference = false;
+    guide->cache_distributions = false;
+    guide->_dist_cache = NULL;
 
     guide_net_builder_t nnet_builder = create_network();
     for (guide_item_t* item = guide->items; item; item = item->next) {
@@ -25,104 +33,332 @@ guide_t* build_guide(guide_builder_t* builder) {
     return guide;
 }
 
-void add_choice(guide_builder_t* guide, int n_choices, const char* name) {
-    assert(n_choices <= MAX_CHOICES);
+guide_t* fork_guide(guide_t* guide, unsigned long seed) {
+    guide_t* fork = malloc(sizeof(guide_t));
+    fork->items = guide->items;
+    fork->_trail_mem = new_block(256, sizeof(trail_t));
+    fork->_random = seedRand(seed);
+    fork->_nnet_guide = guide->_nnet_guide;
+    fork->_nnet_lock = guide->_nnet_lock;
+    fork->_is_fork = true;
+    fork->max_resamples = guide->max_resamples;
+    fork->inference = guide->inference;
+    fork->cache_distributions = guide->cache_distributions;
+    fork->_dist_cache = NULL;
+    return fork;
+}
 
+static void clear_dist_cache(guide_t* guide, dist_cache_t* cache) {
+    pthread_mutex_lock(guide->_nnet_lock);
+    for (dist_node_t* node = cache->nodes; node;) {
+        dist_node_t* next = node->next;
+        complete_trail(node->state, false);
+        free_item(cache->_nodes_mem, node);
+        node = next;
+    }
+    pthread_mutex_unlock(guide->_nnet_lock);
+    for (dist_root_t* root = cache->roots; root;) {
+        dist_root_t* next = root->next;
+        free_item(cache->_roots_mem, root);
+        root = next;
+    }
+    cache->nodes = NULL;
+    cache->roots = NULL;
+    cache->n_nodes = 0;
+}
+
+void free_guide(guide_t* guide) {
+    dist_cache_t* cache = guide->_dist_cache;
+    if (cache) {
+        clear_dist_cache(guide, cache);
+        free_block(cache->_roots_mem);
+        free_block(cache->_nodes_mem);
+        free(cache);
+    }
+    // the network itself is owned by the original guide and lives as long as the process
+    if (!guide->_is_fork) {
+        pthread_mutex_destroy(guide->_nnet_lock);
+        free(guide->_nnet_lock);
+    }
+    free_block(guide->_trail_mem);
+    free(guide);
+}
+
+static guide_item_t* append_item(guide_builder_t* guide, int n_choices, const char* name) {
     guide_item_t* item = new_item(guide->_items_mem);
     item->n_choices = n_choices;
     item->color_covariant = false;
     item->spatial_repr = 0;
     item->name = name;
+    item->index = 0;
+    item->repeat = NULL;
+    item->max_repeats = 0;
     item->next = NULL;
     guide_item_t** p_item = &guide->items;
     while (*p_item) {
+        item->index++;
         p_item = &((*p_item)->next);
     }
     *p_item = item;
+    return item;
+}
+
+void add_choice(guide_builder_t* guide, int n_choices, const char* name) {
+    assert(n_choices <= MAX_CHOICES);
+    append_item(guide, n_choices, name);
 }
 
 void add_color(guide_builder_t* guide, const char* name) {
-    guide_item_t* item = new_item(guide->_items_mem);
-    item->n_choices = 0;
+    guide_item_t* item = append_item(guide, 0, name);
     item->color_covariant = true;
-    item->spatial_repr = 0;
-    item->name = name;
-    item->next = NULL;
-    guide_item_t** p_item = &guide->items;
-    while (*p_item) {
-        p_item = &((*p_item)->next);
-    }
-    *p_item = item;
 }
 
 void add_spatial(guide_builder_t* guide, repr_dihedral_t repr, const char* name) {
-    guide_item_t* item = new_item(guide->_items_mem);
-    item->n_choices = 0;
-    item->color_covariant = false;
+    guide_item_t* item = append_item(guide, 0, name);
     item->spatial_repr = repr;
-    item->name = name;
-    item->next = NULL;
-    guide_item_t** p_item = &guide->items;
-    while (*p_item) {
-        p_item = &((*p_item)->next);
+}
+
+void add_repeat(guide_builder_t* guide, const char* from, int max_repeats, const char* name) {
+    guide_item_t* target = guide->items;
+    while (target && strcmp(target->name, from) != 0) {
+        target = target->next;
     }
-    *p_item = item;
+    assert(target);
+    guide_item_t* item = append_item(guide, 2, name);
+    item->repeat = target;
+    item->max_repeats = max_repeats;
 }
 
-trail_t* new_trail(const graph_t* input, const graph_t* output, guide_t* guide) {
+int max_trail_length(const guide_t* guide) {
+    int length = 0;
+    for (const guide_item_t* item = guide->items; item; item = item->next) {
+        length++;
+        if (item->repeat) {
+            length += item->max_repeats * (item->index - item->repeat->index + 1);
+        }
+    }
+    return length;
+}
+
+static void smooth_distribution(categorical_t* dist) {
+    // encourage exploration - try something new in at least 10% of the cases
+    double base = 0.1;
+    for (int i = 0; i < dist->size; i++) {
+        dist->p[i] = (base / dist->size + dist->p[i]) / (1.0 + base);
+    }
+}
+
+static int dist_size(const guide_item_t* item) {
+    if (item->n_choices) {
+        return item->n_choices;
+    } else if (item->color_covariant) {
+        return 10;
+    }
+    switch (item->spatial_repr) {
+        case DIHEDRAL_SIDE_CORNER:
+            return 8;
+        case DIHEDRAL_SIDE:
+        case DIHEDRAL_CORNER:
+        case DIHEDRAL_MIRROR:
+            return 4;
+        case DIHEDRAL_AXIS:
+            return 2;
+    }
+    return 0;
+}
+
+// the cache for a new trail that is not scripted, NULL when distributions are not cached
+static dist_cache_t* get_dist_cache(guide_t* guide) {
+    if (!guide->cache_distributions) {
+        return NULL;
+    }
+    dist_cache_t* cache = guide->_dist_cache;
+    if (!cache) {
+        cache = malloc(sizeof(dist_cache_t));
+        cache->version = -1;
+        cache->n_nodes = 0;
+        cache->n_trails = 0;
+        cache->nodes = NULL;
+        cache->roots = NULL;
+        cache->_nodes_mem = new_block(256, sizeof(dist_node_t));
+        cache->_roots_mem = new_block(64, sizeof(dist_root_t));
+        guide->_dist_cache = cache;
+    }
+    if (cache->n_trails == 0) {
+        pthread_mutex_lock(guide->_nnet_lock);
+        long version = network_version(guide->_nnet_guide);
+        pthread_mutex_unlock(guide->_nnet_lock);
+        if (version != cache->version || cache->n_nodes >= DIST_CACHE_SIZE) {
+            clear_dist_cache(guide, cache);
+            cache->version = version;
+        }
+    }
+    return cache;
+}
+
+// cache the distribution of the trail, the network has to be in sync; NULL when the cache is full
+static dist_node_t* add_dist_node(dist_cache_t* cache, const trail_t* trail) {
+    if (cache->n_nodes >= DIST_CACHE_SIZE) {
+        return NULL;
+    }
+    dist_node_t* node = new_item(cache->_nodes_mem);
+    node->size = trail->dist.size;
+    memcpy(node->p, trail->dist.p, node->size * sizeof(double));
+    node->state = fork_network_trail(trail->_nnet_trail);
+    for (int i = 0; i <= MAX_CHOICES; i++) {
+        node->children[i] = NULL;
+    }
+    node->next = cache->nodes;
+    cache->nodes = node;
+    cache->n_nodes++;
+    return node;
+}
+
+trail_t* new_trail(const raster_t* input, const raster_t* output, guide_t* guide) {
+    return new_scripted_trail(input, output, guide, NULL);
+}
+
+trail_t* new_scripted_trail(
+    const raster_t* input, const raster_t* output, guide_t* guide, trail_script_t* script) {
     trail_t* trail = new_item(guide->_trail_mem);
     trail->guide = guide;
     trail->cursor = guide->items;
     trail->prev = NULL;
+    trail->depth = 0;
+    trail->script = script;
 
-    trail->dist.size = trail->cursor->n_choices;
+    trail->dist.size = dist_size(trail->cursor);
     trail->dist.rnd = &guide->_random;
+    trail->dist.trail = trail;
+    trail->_dist_node = NULL;
+    trail->_in_sync = true;
 
-    unsigned int* input_pixels = malloc(input->width * input->height * sizeof(int));
-    for (int x = 0; x < input->width; x++) {
-        for (int y = 0; y < input->height; y++) {
-            int idx = y * input->width + x;
-            input_pixels[idx] = input->background_color;
-        }
-    }
-    for (node_t* node = input->nodes; node; node = node->next) {
-        for (int i = 0; i < node->n_subnodes; i++) {
-            subnode_t subnode = get_subnode(node, i);
-            int idx = subnode.coord.sec * input->width + subnode.coord.pri;
-            input_pixels[idx] = subnode.color;
-        }
+    if (script && script->n_prefix > 0) {
+        trail->_nnet_trail = script->state;
+        return trail;
     }
 
-    unsigned int* output_pixels = malloc(output->width * output->height * sizeof(int));
-    for (int x = 0; x < output->width; x++) {
-        for (int y = 0; y < output->height; y++) {
-            int idx = y * output->width + x;
-            output_pixels[idx] = output->background_color;
-        }
-    }
-    for (node_t* node = output->nodes; node; node = node->next) {
-        for (int i = 0; i < node->n_subnodes; i++) {
-            subnode_t subnode = get_subnode(node, i);
-            int idx = subnode.coord.sec * output->width + subnode.coord.pri;
-            output_pixels[idx] = subnode.color;
+    // the first distribution is cached as soon as the example is encoded
+    dist_cache_t* cache = script ? NULL : get_dist_cache(guide);
+    dist_root_t* root = NULL;
+    unsigned long input_hash = 0, output_hash = 0;
+    if (cache) {
+        cache->n_trails++;
+        input_hash = hash_raster(input);
+        output_hash = hash_raster(output);
+        for (root = cache->roots; root; root = root->next) {
+            if (root->input == input_hash && root->output == output_hash) {
+                trail->_dist_node = root->node;
+                trail->_nnet_trail = copy_trail_state(guide, root->node->state);
+                return trail;
+            }
         }
     }
-
+    pthread_mutex_lock(guide->_nnet_lock);
     trail->_nnet_trail = create_network_trail(
         guide->_nnet_guide,
         input->width,
         input->height,
-        input_pixels,
+        (const unsigned char*)input->pixels,
         output->width,
         output->height,
-        output_pixels);
-    free(input_pixels);
-    free(output_pixels);
+        (const unsigned char*)output->pixels,
+        guide->inference || script != NULL);
+    if (cache && cache->n_nodes < DIST_CACHE_SIZE) {
+        next_network_choice(trail->_nnet_trail, trail->dist.p);
+        smooth_distribution(&trail->dist);
+        root = new_item(cache->_roots_mem);
+        *root = (dist_root_t){cache->roots, input_hash, output_hash, add_dist_node(cache, trail)};
+        cache->roots = root;
+        trail->_dist_node = root->node;
+    }
+    pthread_mutex_unlock(guide->_nnet_lock);
+    if (script && script->probe) {
+        script->state = trail->_nnet_trail;
+    }
     return trail;
 }
 
+void* fork_trail_state(const trail_t* trail) {
+    return copy_trail_state(trail->guide, trail->_nnet_trail);
+}
+
+void* copy_trail_state(guide_t* guide, void* state) {
+    pthread_mutex_lock(guide->_nnet_lock);
+    void* copy = fork_network_trail(state);
+    pthread_mutex_unlock(guide->_nnet_lock);
+    return copy;
+}
+
+void free_trail_state(guide_t* guide, void* state) {
+    pthread_mutex_lock(guide->_nnet_lock);
+    complete_trail(state, false);
+    pthread_mutex_unlock(guide->_nnet_lock);
+}
+
+trail_mark_t mark_trail(trail_t* trail) {
+    trail_mark_t mark = {trail, NULL, 0};
+    if (!trail->script && trail->guide->max_resamples > 0) {
+        mark.state = fork_trail_state(trail);
+    }
+    return mark;
+}
+
+bool resample_from(trail_mark_t* mark, trail_t** p_trail) {
+    trail_t* trail = *p_trail;
+    while (trail != mark->trail) {
+        trail = backtrack(trail);
+    }
+    *p_trail = trail;
+    if (!mark->state || mark->n_resamples >= trail->guide->max_resamples) {
+        return false;
+    }
+    mark->n_resamples++;
+    pthread_mutex_lock(trail->guide->_nnet_lock);
+    restore_network_trail(trail->_nnet_trail, mark->state);
+    pthread_mutex_unlock(trail->guide->_nnet_lock);
+    // the distribution at the mark may have been cached since, with the state after it
+    trail->_in_sync = !trail->_dist_node;
+    return true;
+}
+
+void release_mark(trail_mark_t* mark) {
+    if (mark->state) {
+        free_trail_state(mark->trail->guide, mark->state);
+        mark->state = NULL;
+    }
+}
+
+// within the prefix of a script, or after a probe stopped, the network is not consulted
+static inline bool is_replayed(const trail_t* trail) {
+    const trail_script_t* script = trail->script;
+    return script && (trail->depth < script->n_prefix || script->stopped);
+}
+
+void next_choices(guide_t* guide, void** states, int n_states, categorical_t* dists) {
+    double p[n_states + 1][MAX_CHOICES];
+    pthread_mutex_lock(guide->_nnet_lock);
+    next_network_choices(states, n_states, &p[0][0], MAX_CHOICES);
+    pthread_mutex_unlock(guide->_nnet_lock);
+    for (int i = 0; i < n_states; i++) {
+        for (int j = 0; j < dists[i].size; j++) {
+            dists[i].p[j] = p[i][j];
+        }
+        smooth_distribution(&dists[i]);
+    }
+}
+
 float free_trail(guide_t* guide, trail_t* trail, bool success) {
-    float result = complete_trail(trail->_nnet_trail, success);
+    // the network state of a probe is kept by its script
+    float result = 0.0f;
+    if (!trail->script || !trail->script->probe) {
+        pthread_mutex_lock(guide->_nnet_lock);
+        result = complete_trail(trail->_nnet_trail, success);
+        pthread_mutex_unlock(guide->_nnet_lock);
+    }
+    if (!trail->script && guide->_dist_cache) {
+        guide->_dist_cache->n_trails--;
+    }
     for (trail_t* prev = trail->prev; trail; trail = prev, prev = trail ? trail->prev : NULL) {
         free_item(guide->_trail_mem, trail);
     }
@@ -139,8 +375,12 @@ trail_t* observe_choice(trail_t* prev, int choice) {
     prev->choice = choice;
     trail_t* trail = new_item(prev->guide->_trail_mem);
     trail->guide = prev->guide;
-    trail->cursor = prev->cursor->next;
+    // a repeat returns to an earlier item for any choice but the first
+    const guide_item_t* item = prev->cursor;
+    trail->cursor = item->repeat && choice > 0 ? item->repeat : item->next;
     trail->prev = prev;
+    trail->depth = prev->depth + 1;
+    trail->script = prev->script;
 
     if (trail->cursor) {
         trail->dist.size = trail->cursor->n_choices;
@@ -148,47 +388,124 @@ trail_t* observe_choice(trail_t* prev, int choice) {
         trail->dist.size = 0;
     }
     trail->dist.rnd = &trail->guide->_random;
+    trail->dist.trail = trail;
     trail->choice = -1;
 
-    observe_network_choice(prev->_nnet_trail, choice);
+    // cached distributions go without the network, which catches up when the trail leaves the trie
+    trail->_dist_node = prev->_dist_node ? prev->_dist_node->children[choice + 1] : NULL;
+    trail->_in_sync = !trail->_dist_node;
+
+    // the network state is that of the last prefix choice, earlier ones are already in it
+    if (!is_replayed(trail) && !trail->_dist_node) {
+        pthread_mutex_lock(trail->guide->_nnet_lock);
+        if (!prev->_in_sync) {
+            restore_network_trail(prev->_nnet_trail, prev->_dist_node->state);
+        }
+        observe_network_choice(prev->_nnet_trail, choice);
+        if (trail->cursor && trail->cursor != item->next) {
+            seek_network_trail(prev->_nnet_trail, trail->cursor->index);
+        }
+        pthread_mutex_unlock(trail->guide->_nnet_lock);
+    }
     trail->_nnet_trail = prev->_nnet_trail;
     return trail;
 }
 
 const categorical_t* next_choice(trail_t* trail) {
-    guide_item_t* item = trail->cursor;
     categorical_t* dist = &trail->dist;
-    if (item->n_choices) {
-        dist->size = item->n_choices;
-    } else if (item->color_covariant) {
-        dist->size = 10;
-    } else {
-        switch (item->spatial_repr) {
-            case DIHEDRAL_SIDE_CORNER:
-                dist->size = 8;
-                break;
-            case DIHEDRAL_SIDE:
-            case DIHEDRAL_CORNER:
-            case DIHEDRAL_MIRROR:
-                dist->size = 4;
-                break;
-            case DIHEDRAL_AXIS:
-                dist->size = 2;
-                break;
-        }
+    dist->size = dist_size(trail->cursor);
+    dist_node_t* node = trail->_dist_node;
+    if (node) {
+        memcpy(dist->p, node->p, node->size * sizeof(double));
+        return dist;
     }
-    // double p[dist->size];
+    // probes leave the distribution to next_choices
+    if (is_replayed(trail) || (trail->script && trail->script->probe)) {
+        return dist;
+    }
+    pthread_mutex_lock(trail->guide->_nnet_lock);
     next_network_choice(trail->_nnet_trail, dist->p);
+    smooth_distribution(dist);
+    const trail_t* prev = trail->prev;
+    if (prev && prev->_dist_node) {
+        trail->_dist_node = add_dist_node(trail->guide->_dist_cache, trail);
+        prev->_dist_node->children[prev->choice + 1] = trail->_dist_node;
+    }
+    pthread_mutex_unlock(trail->guide->_nnet_lock);
+    return dist;
+}
 
-    // encourage exploration - try something new in at least 10% of the cases
-    double base = 0.1;
+int get_trail_choices(const trail_t* trail, signed char* choices, int max_choices) {
+    int n_choices = 0;
+    for (const trail_t* prev = trail->prev; prev; prev = prev->prev) {
+        n_choices++;
+    }
+    assert(n_choices <= max_choices);
+    int idx = n_choices;
+    for (const trail_t* prev = trail->prev; prev; prev = prev->prev) {
+        choices[--idx] = prev->choice;
+    }
+    return n_choices;
+}
+
+int get_trail_items(const trail_t* trail, unsigned short* items, int max_items) {
+    int n_items = 0;
+    for (const trail_t* prev = trail->prev; prev; prev = prev->prev) {
+        n_items++;
+    }
+    assert(n_items <= max_items);
+    int idx = n_items;
+    for (const trail_t* prev = trail->prev; prev; prev = prev->prev) {
+        items[--idx] = prev->cursor->index;
+    }
+    return n_items;
+}
+
+// follow the script: replay the prefix, then take the most probable valid choice
+static int choose_scripted(const categorical_t* dist, long valid_flags) {
+    trail_t* trail = dist->trail;
+    trail_script_t* script = trail->script;
+    if (trail->depth < script->n_prefix) {
+        return script->prefix[trail->depth];
+    }
+    if (script->probe) {
+        int first = -1;
+        for (int i = 0; i < dist->size && first < 0; i++) {
+            if (valid_flags & (1l << i)) {
+                first = i;
+            }
+        }
+        if (first >= 0 && !script->stopped) {
+            script->stopped = true;
+            if (script->on_branch) {
+                script->on_branch(script, trail, dist, valid_flags);
+            }
+        }
+        return first;
+    }
+    double sum = 0.0;
+    int best = -1;
     for (int i = 0; i < dist->size; i++) {
-        dist->p[i] = (base / dist->size + dist->p[i]) / (1.0 + base);
+        if (valid_flags & (1l << i)) {
+            sum += dist->p[i];
+            if (best < 0 || dist->p[i] > dist->p[best]) {
+                best = i;
+            }
+        }
     }
-    return dist;
+    if (best >= 0) {
+        if (script->on_branch) {
+            script->on_branch(script, trail, dist, valid_flags);
+        }
+        script->log_p += log(dist->p[best] / sum);
+    }
+    return best;
 }
 
 int choose(const categorical_t* dist) {
+    if (dist->trail->script) {
+        return choose_scripted(dist, (1l << dist->size) - 1);
+    }
     double x = genRand(dist->rnd);
     for (int i = 0; i < dist->size; i++) {
         if (x < dist->p[i]) {
@@ -200,6 +517,9 @@ int choose(const categorical_t* dist) {
 }
 
 int choose_from(const categorical_t* dist, long valid_flags) {
+    if (dist->trail->script) {
+        return choose_scripted(dist, valid_flags);
+    }
     double sum = 0.0;
     for (int i = 0; i < dist->size; i++) {
         if (valid_flags & (1 << i)) {
@@ -1,9 +1,12 @@
 #ifndef __GUIDE_H__
 #define __GUIDE_H__
 
+#include <pthread.h>
+
 #include "graph.h"
 #include "mem.h"
 #include "mtwister.h"
+#include "raster.h"
 
 #define MAX_CHOICES 32
 
@@ -33,9 +36,53 @@ typedef struct _guide_item {
     bool color_covariant;
     repr_dihedral_t spatial_repr;
     const char* name;
+    // position in the sequence, also that of its module in the network
+    int index;
+    // for a repeat: the item to return to, and how often that may happen
+    struct _guide_item* repeat;
+    int max_repeats;
 } guide_item_t;
 
 
+/**
+ * The distributions that the network computed for the trails of a guide, in
+ * a trie per example keyed by the choices that precede them.  Each node also
+ * keeps the network state after its distribution, so that a trail that
+ * leaves the trie continues from there instead of from the start.  The
+ * distributions only depend on the weights of the network, the cache is
+ * cleared when those are updated.
+ */
+#define DIST_CACHE_SIZE 4096
+
+typedef struct _dist_node {
+    // all nodes of the cache, for clearing it
+    struct _dist_node* next;
+    int size;
+    double p[MAX_CHOICES];
+    void* state;
+    // by choice + 1, as unused choices are observed as -1
+    struct _dist_node* children[MAX_CHOICES + 1];
+} dist_node_t;
+
+// the trie of an example, identified by hash_raster of its input and output
+typedef struct _dist_root {
+    struct _dist_root* next;
+    unsigned long input;
+    unsigned long output;
+    dist_node_t* node;
+} dist_root_t;
+
+typedef struct _dist_cache {
+    long version;
+    int n_nodes;
+    // trails that may point into the trie, it is only cleared when there are none
+    int n_trails;
+    dist_node_t* nodes;
+    dist_root_t* roots;
+    mem_block_t* _nodes_mem;
+    mem_block_t* _roots_mem;
+} dist_cache_t;
+
 typedef struct _guide_builder {
     guide_item_t* items;
     mem_block_t* _items_mem;
@@ -46,6 +93,16 @@ typedef struct _guide {
     MTRand _random;
     mem_block_t* _trail_mem;
     void * _nnet_guide;
+    // the network is shared between forked guides, calls into it are serialized
+    pthread_mutex_t* _nnet_lock;
+    bool _is_fork;
+    // times a failed part of a sampled trail is sampled again (see resample_from)
+    int max_resamples;
+    // trails are never trained, the network does not track gradients for them
+    bool inference;
+    // look up the distributions of trails that are not scripted in a cache, for inference only
+    bool cache_distributions;
+    dist_cache_t* _dist_cache;
 } guide_t;
 
 /**
@@ -63,20 +120,63 @@ typedef struct _guide {
 typedef struct {
     int size;
     MTRand* rnd;
+    // the trail the distribution belongs to
+    struct _trail* trail;
     double p[MAX_CHOICES];
 } categorical_t;
 
+struct _trail_script;
+
 typedef struct _trail {
     guide_t* guide;
     guide_item_t* cursor;
     struct _trail* prev;
+    // number of preceding choices
+    int depth;
 
     categorical_t dist;
     int choice;
 
+    struct _trail_script* script;
     void * _nnet_trail;
+    // position of the trail in the distribution cache, NULL when it is not in there
+    dist_node_t* _dist_node;
+    // the network state is at this item, else it is at an earlier one and _dist_node is set
+    bool _in_sync;
 } trail_t;
 
+/**
+ * Deterministic decoding instead of sampling.  The choices of the prefix are
+ * replayed without consulting the network, which resumes from the state that
+ * was saved before the last of them (see fork_trail_state).  Beyond the
+ * prefix, choose and choose_from take the most probable valid choice and
+ * report the distribution to on_branch first, so that the alternatives can be
+ * visited later.
+ *
+ * A probe instead stops at the first choice beyond the prefix: on_branch gets
+ * its valid choices before the distribution is computed, and from there on
+ * the lowest valid choice is taken without consulting the network.  The
+ * network state is left at the stopped item and kept by the script, so that
+ * the distributions of several probes can be computed at once (next_choices).
+ */
+typedef struct _trail_script {
+    int n_prefix;
+    const signed char* prefix;
+    // network state before the last prefix choice, NULL for an empty prefix; it has to be taken
+    // after the distribution of that choice's item was computed, as the choice is observed on it
+    void* state;
+    // log-probability of the choices so far, updated by choose and choose_from
+    double log_p;
+    bool probe;
+    bool stopped;
+    void (*on_branch)(
+        struct _trail_script* script,
+        const trail_t* trail,
+        const categorical_t* dist,
+        long valid_flags);
+    void* context;
+} trail_script_t;
+
 void init_guide(guide_builder_t * builder);
 
 void add_choice(guide_builder_t* builder, int n_choices, const char* name);
@@ -87,9 +187,69 @@ void add_color(guide_builder_t* builder, const char* name);
 // add a spatial representation, transforming under the dihedral group
 void add_spatial(guide_builder_t* builder, repr_dihedral_t repr, const char* name);
 
+/**
+ * Add a binary choice that repeats part of the sequence: choosing 1 returns
+ * the trail to the (earlier) item with the given name, 0 continues with the
+ * next item.  Returning more than max_repeats times should be prevented by
+ * the caller, e.g. with choose_from.
+ */
+void add_repeat(guide_builder_t* builder, const char* from, int max_repeats, const char* name);
+
 guide_t * build_guide(guide_builder_t * builder);
 
-trail_t* new_trail(const graph_t* input, const graph_t* output, guide_t* guide);
+// the maximum number of choices on a trail, taking repeats into account
+int max_trail_length(const guide_t* guide);
+
+/**
+ * Create a guide for use on another thread.  It shares the network with the
+ * original guide, but has its own random state and trail memory.
+ */
+guide_t* fork_guide(guide_t* guide, unsigned long seed);
+
+void free_guide(guide_t* guide);
+
+trail_t* new_trail(const raster_t* input, const raster_t* output, guide_t* guide);
+
+// a trail that follows the script, which takes ownership of its network state
+trail_t* new_scripted_trail(
+    const raster_t* input, const raster_t* output, guide_t* guide, trail_script_t* script);
+
+// copy of the network state at the current item, before its choice is observed
+void* fork_trail_state(const trail_t* trail);
+
+void* copy_trail_state(guide_t* guide, void* state);
+
+void free_trail_state(guide_t* guide, void* state);
+
+/**
+ * Local resampling: a mark is put on the trail where a part of the program
+ * (e.g. a filter) starts.  When that part fails, the trail is returned to the
+ * mark together with the network state it had there, so that only the part
+ * is sampled again instead of the whole trail.  Scripted trails are never
+ * resampled, as their choices are not random.
+ */
+typedef struct _trail_mark {
+    trail_t* trail;
+    // network state before the distribution at the mark was computed, NULL when not resampling
+    void* state;
+    int n_resamples;
+} trail_mark_t;
+
+trail_mark_t mark_trail(trail_t* trail);
+
+/**
+ * Backtrack the trail to the mark.  Returns true when the part may be sampled
+ * again, with the network restored to its state at the mark.
+ */
+bool resample_from(trail_mark_t* mark, trail_t** p_trail);
+
+void release_mark(trail_mark_t* mark);
+
+/**
+ * The distributions of the items that network states were left at by probes,
+ * in one pass over the network.  The size of each distribution must be set.
+ */
+void next_choices(guide_t* guide, void** states, int n_states, categorical_t* dists);
 
 /**
  * Before continuing to the next choice on the trail, the observed choice
@@ -106,6 +266,15 @@ trail_t* backtrack(trail_t* trail);
 
 const categorical_t* next_choice(trail_t* trail);
 
+/**
+ * Copy the observed choices, from the start of the trail up to (excluding)
+ * the current item, returns the number of choices.
+ */
+int get_trail_choices(const trail_t* trail, signed char* choices, int max_choices);
+
+// the index of the guide item of each choice that get_trail_choices copies
+int get_trail_items(const trail_t* trail, unsigned short* items, int max_items);
+
 int choose(const categorical_t* dist);
 
 int choose_from(const categorical_t* dist, long valid_flags);
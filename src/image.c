@@ -2,7 +2,6 @@
 
 #include <stdio.h>
 
-#include "collection.h"
 #include "graph.h"
 #include "guide.h"
 
@@ -60,21 +59,25 @@ graph_t* graph_from_grid(const color_t* grid, int n_rows, int n_cols) {
     return graph;
 }
 
-void print_graph(const graph_t* graph) {
-    color_t* result = malloc(graph->width * graph->height * sizeof(color_t));
-    for (int x = 0; x < graph->width; x++) {
-        for (int y = 0; y < graph->height; y++) {
-            int idx = y * graph->width + x;
-            result[idx] = graph->background_color;
-        }
+void render_graph(const graph_t* graph, raster_t* raster) {
+    assert(raster->width == graph->width && raster->height == graph->height);
+    color_t* result = raster->pixels;
+    for (int idx = 0; idx < graph->width * graph->height; idx++) {
+        result[idx] = graph->background_color;
     }
     for (node_t* node = graph->nodes; node; node = node->next) {
-        for (int i = 0; i < node->n_subnodes; i++) {
-            subnode_t subnode = get_subnode(node, i);
+        for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+            subnode_t subnode = next_subnode(&iter);
             int idx = subnode.coord.sec * graph->width + subnode.coord.pri;
             result[idx] = subnode.color;
         }
     }
+}
+
+void print_graph(const graph_t* graph) {
+    raster_t* raster = new_raster(graph->width, graph->height);
+    render_graph(graph, raster);
+    color_t* result = raster->pixels;
     for (int y = 0; y < graph->height; y++) {
         for (int x = 0; x < graph->width; x++) {
             int idx = y * graph->width + x;
@@ -86,23 +89,22 @@ void print_graph(const graph_t* graph) {
         }
         printf("\n");
     }
-    free(result);
+    free_raster(raster);
 }
 
-graph_t* get_no_abstraction_graph(const graph_t* in) {
+graph_t* get_no_abstraction_graph(const grid_t* in) {
     graph_t* out = new_graph(in->width, in->height);
     if (unlikely(out == NULL)) {
         return NULL;
     }
+    out->background_color = in->background_color;
     coordinate_t coord = {0, 0};
-    node_t* out_node = add_node(out, coord, in->n_nodes);
+    node_t* out_node = add_node(out, coord, grid_size(in));
     if (unlikely(out_node == NULL)) {
         return NULL;
     }
-    int idx = 0;
-    for (const node_t* node = first_node(in); node != NULL; node = next_node(node)) {
-        const subnode_t orig = get_subnode(node, 0);
-        set_subnode(out_node, idx++, orig);
+    for (int idx = 0; idx < grid_size(in); idx++) {
+        set_subnode(out_node, idx, (subnode_t){grid_coord(in, idx), grid_color(in, idx)});
     }
     return out;
 }
@@ -127,27 +129,15 @@ graph_t* subgraph_by_color(const graph_t* in, color_t color) {
     return out;
 }
 
-void _add_neighbors(node_set_t* visited, list_node_t* nodes, const node_t* node, int* count) {
-    for (const edge_t* edge = node->edges; edge; edge = edge->next) {
-        if (is_node_in_set(visited, edge->peer)) {
-            continue;
-        }
-        node_t* peer = edge->peer;
-        add_node_to_set(visited, peer);
-        add_node_to_list(nodes, peer);
-        (*count)++;
-        _add_neighbors(visited, nodes, peer, count);
-    }
-}
-
-void _link_nodes_without_intermediary(graph_t* out, const graph_t* in) {
+void _link_nodes_without_intermediary(graph_t* out, const grid_t* in) {
     for (node_t* node1 = out->nodes; node1; node1 = node1->next) {
         for (node_t* node2 = node1->next; node2; node2 = node2->next) {
             bool edge_added = false;
-            for (int sub_1 = 0; !edge_added && sub_1 < node1->n_subnodes; sub_1++) {
-                for (int sub_2 = 0; !edge_added && sub_2 < node2->n_subnodes; sub_2++) {
-                    subnode_t subnode_1 = get_subnode(node1, sub_1);
-                    subnode_t subnode_2 = get_subnode(node2, sub_2);
+            for (subnode_iter_t iter_1 = subnodes_of(node1); !edge_added && has_subnode(&iter_1);) {
+                subnode_t subnode_1 = next_subnode(&iter_1);
+                for (subnode_iter_t iter_2 = subnodes_of(node2);
+                     !edge_added && has_subnode(&iter_2);) {
+                    subnode_t subnode_2 = next_subnode(&iter_2);
                     if (subnode_1.coord.pri == subnode_2.coord.pri) {
                         bool found = false;
                         int pri = subnode_1.coord.pri;
@@ -160,8 +150,8 @@ void _link_nodes_without_intermediary(graph_t* out, const graph_t* in) {
                             max = subnode_1.coord.sec;
                         }
                         for (int sec = min + 1; sec < max; sec++) {
-                            const node_t* orig_node = get_node(in, (coordinate_t){pri, sec});
-                            if (get_subnode(orig_node, 0).color != in->background_color) {
+                            int idx = grid_index(in, (coordinate_t){pri, sec});
+                            if (grid_color(in, idx) != in->background_color) {
                                 found = true;
                                 break;
                             }
@@ -183,8 +173,8 @@ void _link_nodes_without_intermediary(graph_t* out, const graph_t* in) {
                             max = subnode_1.coord.pri;
                         }
                         for (int pri = min + 1; pri < max; pri++) {
-                            const node_t* orig_node = get_node(in, (coordinate_t){pri, sec});
-                            if (get_subnode(orig_node, 0).color != in->background_color) {
+                            int idx = grid_index(in, (coordinate_t){pri, sec});
+                            if (grid_color(in, idx) != in->background_color) {
                                 found = true;
                                 break;
                             }
@@ -202,32 +192,45 @@ void _link_nodes_without_intermediary(graph_t* out, const graph_t* in) {
 }
 
 graph_t* _connected_components_graph(
-    const graph_t* in, bool remove_bg_corners, bool remove_bg_edges, bool remove_all_bg) {
+    const grid_t* in, bool remove_bg_corners, bool remove_bg_edges, bool remove_all_bg) {
     graph_t* out = new_graph(in->width, in->height);
     out->background_color = in->background_color;
+
+    // pixels of the current component, in order of discovery
+    int n_pixels = grid_size(in);
+    bool visited[n_pixels];
+    int members[n_pixels];
+    for (int idx = 0; idx < n_pixels; idx++) {
+        visited[idx] = false;
+    }
     for (color_t color = 0; color < 10; color++) {
-        graph_t* by_color = subgraph_by_color(in, color);
-        node_set_t* visited = new_node_set(by_color->n_nodes);
         int component_idx = 0;
-        for (const node_t* node = by_color->nodes; node; node = node->next) {
-            if (is_node_in_set(visited, node)) {
+        for (int start = 0; start < n_pixels; start++) {
+            if (visited[start] || grid_color(in, start) != color) {
                 continue;
             }
             int n_subnodes = 1;
-            list_node_t* node_list = new_node_list();
-            add_node_to_set(visited, node);
-            add_node_to_list(node_list, node);
-            _add_neighbors(visited, node_list, node, &n_subnodes);
+            visited[start] = true;
+            members[0] = start;
+            for (int head = 0; head < n_subnodes; head++) {
+                int neighbors[4];
+                int n_neighbors = grid_neighbors(in, members[head], neighbors);
+                for (int i = 0; i < n_neighbors; i++) {
+                    int peer = neighbors[i];
+                    if (!visited[peer] && grid_color(in, peer) == color) {
+                        visited[peer] = true;
+                        members[n_subnodes++] = peer;
+                    }
+                }
+            }
 
             bool excluded = false;
             if (color == in->background_color) {
                 if (remove_all_bg) {
                     excluded = true;
                 } else {
-                    list_iter_t iter;
-                    for (init_list_iter(node_list, &iter); has_iter_value(&iter);
-                         next_list_iter(&iter)) {
-                        coordinate_t coord = iter.node->coord;
+                    for (int i = 0; i < n_subnodes; i++) {
+                        coordinate_t coord = grid_coord(in, members[i]);
                         if (remove_bg_edges) {
                             if (coord.pri == 0 || coord.sec == 0 ||
                                 coord.pri == in->width - 1 || coord.sec == in->height - 1) {
@@ -248,40 +251,30 @@ graph_t* _connected_components_graph(
             if (!excluded) {
                 node_t* component =
                     add_node(out, (coordinate_t){color, component_idx}, n_subnodes);
-                list_iter_t iter;
-                int subnode_idx = 0;
-                for (init_list_iter(node_list, &iter); has_iter_value(&iter);
-                     next_list_iter(&iter)) {
-                    subnode_t subnode = get_subnode(component, subnode_idx);
-                    subnode.coord = iter.node->coord;
-                    subnode.color = color;
-                    set_subnode(component, subnode_idx, subnode);
-                    subnode_idx++;
+                for (int i = 0; i < n_subnodes; i++) {
+                    set_subnode(component, i, (subnode_t){grid_coord(in, members[i]), color});
                 }
                 component_idx++;
             }
-            free_node_list(node_list);
         }
-        free_node_set(visited);
-        free_graph(by_color);
     }
     _link_nodes_without_intermediary(out, in);
     return out;
 }
 
-graph_t* get_connected_components_graph(const graph_t* in) {
+graph_t* get_connected_components_graph(const grid_t* in) {
     return _connected_components_graph(in, false, false, false);
 }
 
-graph_t* get_connected_components_graph_background_corners_removed(const graph_t* in) {
+graph_t* get_connected_components_graph_background_corners_removed(const grid_t* in) {
     return _connected_components_graph(in, true, false, false);
 }
 
-graph_t* get_connected_components_graph_background_edges_removed(const graph_t* in) {
+graph_t* get_connected_components_graph_background_edges_removed(const grid_t* in) {
     return _connected_components_graph(in, false, true, false);
 }
 
-graph_t* get_connected_components_graph_background_removed(const graph_t* in) {
+graph_t* get_connected_components_graph_background_removed(const grid_t* in) {
     return _connected_components_graph(in, false, false, true);
 }
 
@@ -295,8 +288,8 @@ graph_t* undo_abstraction(const graph_t* in) {
         }
     }
     for (const node_t* node = in->nodes; node; node = node->next) {
-        for (int sub = 0; sub < node->n_subnodes; sub++) {
-            subnode_t subnode = get_subnode(node, sub);
+        for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+            subnode_t subnode = next_subnode(&iter);
             node_t* new_node = get_node(out, subnode.coord);
             if (!new_node) {
                 free_graph(out);
@@ -308,6 +301,53 @@ graph_t* undo_abstraction(const graph_t* in) {
     return out;
 }
 
+bool render_abstraction(const graph_t* in, raster_t* raster) {
+    assert(raster->width == in->width && raster->height == in->height);
+    color_t* pixels = raster->pixels;
+    for (int idx = 0; idx < in->width * in->height; idx++) {
+        pixels[idx] = in->background_color;
+    }
+    for (const node_t* node = in->nodes; node; node = node->next) {
+        for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+            subnode_t subnode = next_subnode(&iter);
+            coordinate_t coord = subnode.coord;
+            if (coord.pri < 0 || coord.sec < 0 || coord.pri >= in->width ||
+                coord.sec >= in->height) {
+                return false;
+            }
+            pixels[coord.sec * in->width + coord.pri] = subnode.color;
+        }
+    }
+    return true;
+}
+
+// splitmix64 finalizer, so that summed node hashes do not cancel
+static inline unsigned long _mix_hash(unsigned long z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ul;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebul;
+    return z ^ (z >> 31);
+}
+
+unsigned long hash_graph(const graph_t* graph) {
+    unsigned long hash = _zobrist_key(-1, graph->background_color) *
+                         (graph->width << 16 | graph->height);
+    // later steps see the nodes in order, subnodes and edges are sets
+    for (const node_t* node = graph->nodes; node; node = node->next) {
+        unsigned long node_hash = _mix_hash(node_id(node->coord) + 1);
+        for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+            subnode_t subnode = next_subnode(&iter);
+            node_hash += _zobrist_key(
+                subnode.coord.sec * graph->width + subnode.coord.pri, subnode.color);
+        }
+        for (const edge_t* edge = node->edges; edge; edge = edge->next) {
+            unsigned long peer = node_id(edge->peer->coord);
+            node_hash += _mix_hash(peer << 2 | edge->direction);
+        }
+        hash = hash * 1099511628211ul + _mix_hash(node_hash);
+    }
+    return hash;
+}
+
 abstraction_t abstractions[] = {
     {
         .func = get_connected_components_graph_background_removed,
@@ -2,21 +2,41 @@
 #define __IMAGE__
 
 #include "graph.h"
+#include "grid.h"
 #include "guide.h"
+#include "raster.h"
 
 graph_t* new_grid(const color_t bg_color, int n_rows, int n_cols);
 graph_t* graph_from_grid(const color_t* grid, int n_rows, int n_cols);
 graph_t* subgraph_by_color(const graph_t* in, color_t color);
 void print_graph(const graph_t* graph);
 
-graph_t* get_no_abstraction_graph(const graph_t* in);
-graph_t* get_connected_components_graph(const graph_t* in);
-graph_t* get_connected_components_graph_background_removed(const graph_t* in);
+// paint the subnodes of the graph on its background, raster must have the graph's dimensions
+void render_graph(const graph_t* graph, raster_t* raster);
+
+// abstractions of a pixel graph
+graph_t* get_no_abstraction_graph(const grid_t* in);
+graph_t* get_connected_components_graph(const grid_t* in);
+graph_t* get_connected_components_graph_background_removed(const grid_t* in);
 
 graph_t* undo_abstraction(const graph_t* in);
 
+/**
+ * Like undo_abstraction, but paints the subnodes straight into the raster
+ * (which must have the dimensions of the graph).  Returns false when a
+ * subnode lies outside of the image.
+ */
+bool render_abstraction(const graph_t* in, raster_t* raster);
+
+/**
+ * Hash of an abstracted graph: the nodes in order, each with its coordinate,
+ * its subnodes (with their colors) and its edges.  The order of the subnodes
+ * and edges of a node does not matter.
+ */
+unsigned long hash_graph(const graph_t* graph);
+
 typedef struct _abstraction {
-    graph_t* (*func)(const graph_t* in);
+    graph_t* (*func)(const grid_t* in);
     char* name;
 } abstraction_t;
 
@@ -1,66 +1,71 @@
 #include <stdio.h>
 #include <string.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <cjson/cJSON.h>
 
 #include "io.h"
 #include "image.h"
+#include "parser.h"
 #include "task.h"
 
-graph_t* read_graph(cJSON* json_grid) {
+raster_t* read_raster(cJSON* json_grid) {
     int input_rows = cJSON_GetArraySize(json_grid);
     cJSON* first_row = cJSON_GetArrayItem(json_grid, 0);
     int input_cols = cJSON_GetArraySize(first_row);
-    color_t grid[input_cols * input_rows];
+    raster_t* raster = new_raster(input_cols, input_rows);
     for (int row = 0; row < input_rows; row++) {
         cJSON* json_row = cJSON_GetArrayItem(json_grid, row);
         for (int col = 0; col < input_cols; col++) {
             cJSON* cell = cJSON_GetArrayItem(json_row, col);
-            grid[row * input_cols + col] = cJSON_GetNumberValue(cell);
+            raster->pixels[row * input_cols + col] = cJSON_GetNumberValue(cell);
         }
     }
-    return graph_from_grid(grid, input_rows, input_cols);
+    return raster;
 }
 
-task_t* parse_task(const char* source) {
+static task_t* parse_task_cjson(const char* source) {
     task_t* task = new_task();
 
     cJSON* json = cJSON_Parse(source);
     cJSON* train = cJSON_GetObjectItem(json, "train");
-    task->n_train = cJSON_GetArraySize(train);
-    for (int i_train = 0; i_train < task->n_train; i_train++) {
+    int n_train = cJSON_GetArraySize(train);
+    for (int i_train = 0; i_train < n_train; i_train++) {
         cJSON* train_io = cJSON_GetArrayItem(train, i_train);
         cJSON* input = cJSON_GetObjectItem(train_io, "input");
-        task->train_input[i_train] = read_graph(input);
-
         cJSON* output = cJSON_GetObjectItem(train_io, "output");
-        task->train_output[i_train] = read_graph(output);
+        add_train_example(task, read_raster(input), read_raster(output));
     }
 
     cJSON* test = cJSON_GetObjectItem(json, "test");
-    task->n_test = cJSON_GetArraySize(test);
-    for (int i_test = 0; i_test < task->n_test; i_test++) {
+    int n_test = cJSON_GetArraySize(test);
+    for (int i_test = 0; i_test < n_test; i_test++) {
         cJSON* test_io = cJSON_GetArrayItem(test, i_test);
         cJSON* input = cJSON_GetObjectItem(test_io, "input");
-        task->test_input[i_test] = read_graph(input);
-
         cJSON* output = cJSON_GetObjectItem(test_io, "output");
-        task->test_output[i_test] = read_graph(output);
+        add_test_example(task, read_raster(input), output ? read_raster(output) : NULL);
     }
 
-    cJSON_free(json);
+    cJSON_Delete(json);
 
     return task;
 }
 
-const char * read_task(const char * name) {
-    char filename[128];
-    if (strlen(name) < 100) {
-        sprintf(filename, "data/%s", name);
-    } else {
-        return NULL;
+task_t* parse_task(const char* source) {
+    task_t* task = new_task();
+    if (parse_task_json(source, task)) {
+        return task;
     }
+    // not the plain ARC schema, leave it to the general purpose parser
+    free_task(task);
+    return parse_task_cjson(source);
+}
 
+const char* read_file(const char* filename) {
     char *source = NULL;
     FILE *fp = fopen(filename, "r");
     if (fp != NULL) {
@@ -94,6 +99,20 @@ const char * read_task(const char * name) {
     return source;
 }
 
+const char * read_task(const char * name) {
+    char filename[128];
+    if (strlen(name) < 100) {
+        sprintf(filename, "data/%s", name);
+    } else {
+        return NULL;
+    }
+    return read_file(filename);
+}
+
+static int compare_task_names(const void* a, const void* b) {
+    return strcmp((*(const task_def_t**)a)->name, (*(const task_def_t**)b)->name);
+}
+
 task_def_t* list_tasks() {
     task_def_t * result = NULL;
     DIR* d = opendir("data");
@@ -114,12 +133,269 @@ task_def_t* list_tasks() {
         }
         closedir(d);
     }
+
+    // readdir order depends on the filesystem, sort for reproducible runs
+    int n_tasks = 0;
+    for (task_def_t* entry = result; entry; entry = entry->next) {
+        n_tasks++;
+    }
+    if (n_tasks > 1) {
+        task_def_t* sorted[n_tasks];
+        n_tasks = 0;
+        for (task_def_t* entry = result; entry; entry = entry->next) {
+            sorted[n_tasks++] = entry;
+        }
+        qsort(sorted, n_tasks, sizeof(task_def_t*), compare_task_names);
+        for (int i = 0; i < n_tasks - 1; i++) {
+            sorted[i]->next = sorted[i + 1];
+        }
+        sorted[n_tasks - 1]->next = NULL;
+        result = sorted[0];
+    }
     return result;
 }
 
+typedef struct _load_pool {
+    task_def_t** tasks;
+    int n_tasks;
+    int next_task;
+    int n_loaded;
+} load_pool_t;
+
+static void* run_loader(void* arg) {
+    load_pool_t* pool = arg;
+    for (;;) {
+        int i_task = __atomic_fetch_add(&pool->next_task, 1, __ATOMIC_RELAXED);
+        if (i_task >= pool->n_tasks) {
+            break;
+        }
+        task_def_t* task_def = pool->tasks[i_task];
+        const char* source = read_task(task_def->name);
+        if (source) {
+            task_def->task = parse_task(source);
+            free((char*)source);
+            __atomic_fetch_add(&pool->n_loaded, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+int load_tasks(task_def_t* tasks, int n_workers) {
+    int n_tasks = 0;
+    for (task_def_t* task_def = tasks; task_def; task_def = task_def->next) {
+        n_tasks++;
+    }
+    task_def_t* task_array[n_tasks + 1];
+    n_tasks = 0;
+    for (task_def_t* task_def = tasks; task_def; task_def = task_def->next) {
+        task_array[n_tasks++] = task_def;
+    }
+
+    load_pool_t pool = {
+        .tasks = task_array,
+        .n_tasks = n_tasks,
+        .next_task = 0,
+        .n_loaded = 0,
+    };
+    if (n_workers < 1) {
+        n_workers = 1;
+    }
+    pthread_t workers[n_workers];
+    for (int i = 0; i < n_workers; i++) {
+        pthread_create(&workers[i], NULL, run_loader, &pool);
+    }
+    for (int i = 0; i < n_workers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    return pool.n_loaded;
+}
+
 void free_task_list(task_def_t* list) {
     if (list->next) {
         free_task_list(list->next);
     }
     free(list);
 }
+
+void free_task_defs(task_def_t* tasks) {
+    for (task_def_t* entry = tasks; entry; entry = entry->next) {
+        if (entry->task) {
+            free_task(entry->task);
+        }
+    }
+    free_task_list(tasks);
+}
+
+
+#define TASK_CACHE_MAGIC "ARCTASK1"
+#define TASK_CACHE_NAME_SIZE 32
+
+/*
+ * Layout of the task cache:
+ *   magic, number of tasks,
+ *   index: per task its name and the offset of its examples,
+ *   per task: n_train, n_test, then (input, output) grids of the train and test examples
+ *   per grid: width and height (a byte each), pixels - an unknown test output has no pixels
+ */
+
+typedef struct _task_cache_header {
+    char magic[8];
+    unsigned int n_tasks;
+} task_cache_header_t;
+
+typedef struct _task_cache_entry {
+    char name[TASK_CACHE_NAME_SIZE];
+    unsigned int offset;
+} task_cache_entry_t;
+
+// a missing raster (unknown test output) is written as an empty grid
+static void write_raster(FILE* fp, const raster_t* raster) {
+    unsigned char dims[2] = {0, 0};
+    if (raster) {
+        dims[0] = raster->width;
+        dims[1] = raster->height;
+    }
+    fwrite(dims, 1, 2, fp);
+    if (raster) {
+        fwrite(raster->pixels, sizeof(color_t), raster->width * raster->height, fp);
+    }
+}
+
+bool write_task_cache(const char* filename, task_def_t** tasks, int n_tasks) {
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        return false;
+    }
+    task_cache_header_t header = {TASK_CACHE_MAGIC, n_tasks};
+    fwrite(&header, sizeof(header), 1, fp);
+
+    // the index is written after the tasks, when their offsets are known
+    task_cache_entry_t* index = calloc(n_tasks, sizeof(task_cache_entry_t));
+    fseek(fp, n_tasks * sizeof(task_cache_entry_t), SEEK_CUR);
+    for (int i_task = 0; i_task < n_tasks; i_task++) {
+        const task_t* task = tasks[i_task]->task;
+        strncpy(index[i_task].name, tasks[i_task]->name, TASK_CACHE_NAME_SIZE - 1);
+        index[i_task].offset = ftell(fp);
+
+        unsigned char counts[2] = {task->n_train, task->n_test};
+        fwrite(counts, 1, 2, fp);
+        for (int i_train = 0; i_train < task->n_train; i_train++) {
+            write_raster(fp, task->train_input_raster[i_train]);
+            write_raster(fp, task->train_output_raster[i_train]);
+        }
+        for (int i_test = 0; i_test < task->n_test; i_test++) {
+            write_raster(fp, task->test_input_raster[i_test]);
+            write_raster(fp, task->test_output_raster[i_test]);
+        }
+    }
+    fseek(fp, sizeof(header), SEEK_SET);
+    fwrite(index, sizeof(task_cache_entry_t), n_tasks, fp);
+    free(index);
+
+    bool ok = !ferror(fp);
+    return fclose(fp) == 0 && ok;
+}
+
+// a raster that refers to pixels in the mapped file, NULL for an empty grid
+// returns false when the grid does not fit before the end of the file
+static bool map_raster(const unsigned char** cursor, const unsigned char* end, raster_t** raster) {
+    if (end - *cursor < 2) {
+        return false;
+    }
+    int width = (*cursor)[0];
+    int height = (*cursor)[1];
+    if (width == 0 || height == 0) {
+        *cursor += 2;
+        *raster = NULL;
+        return true;
+    }
+    size_t n_bytes = width * height * sizeof(color_t);
+    if ((size_t)(end - *cursor - 2) < n_bytes) {
+        return false;
+    }
+    *raster = malloc(sizeof(raster_t));
+    (*raster)->width = width;
+    (*raster)->height = height;
+    (*raster)->pixels = (color_t*)(*cursor + 2);
+    *cursor += 2 + n_bytes;
+    return true;
+}
+
+// map the examples of a task, the input and (for train examples) output are required
+static bool map_examples(
+    task_t* task, const unsigned char* cursor, const unsigned char* end) {
+    if (end - cursor < 2) {
+        return false;
+    }
+    int n_train = cursor[0];
+    int n_test = cursor[1];
+    if (n_train > MAX_TRAIN_EXAMPLES || n_test > MAX_TEST_INPUT) {
+        return false;
+    }
+    cursor += 2;
+    for (int i_example = 0; i_example < n_train + n_test; i_example++) {
+        raster_t *input = NULL, *output = NULL;
+        bool mapped = map_raster(&cursor, end, &input) && map_raster(&cursor, end, &output);
+        if (!mapped || !input || (i_example < n_train && !output)) {
+            free(input);
+            free(output);
+            return false;
+        }
+        if (i_example < n_train) {
+            add_train_example(task, input, output);
+        } else {
+            add_test_example(task, input, output);
+        }
+    }
+    return true;
+}
+
+task_def_t* load_task_cache(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(task_cache_header_t)) {
+        close(fd);
+        return NULL;
+    }
+    // the mapping stays around for the lifetime of the process, it is private so names can be
+    // terminated in place
+    size_t size = st.st_size;
+    unsigned char* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    const unsigned char* end = data + size;
+    const task_cache_header_t* header = (const task_cache_header_t*)data;
+    size_t index_size = (size_t)header->n_tasks * sizeof(task_cache_entry_t);
+    if (memcmp(header->magic, TASK_CACHE_MAGIC, sizeof(header->magic)) ||
+        index_size > size - sizeof(*header)) {
+        munmap(data, size);
+        return NULL;
+    }
+
+    task_cache_entry_t* index = (task_cache_entry_t*)(data + sizeof(*header));
+    task_def_t* result = NULL;
+    task_def_t** p_last = &result;
+    for (unsigned int i_task = 0; i_task < header->n_tasks; i_task++) {
+        index[i_task].name[TASK_CACHE_NAME_SIZE - 1] = 0;
+        task_def_t* entry = malloc(sizeof(task_def_t));
+        entry->next = NULL;
+        entry->name = index[i_task].name;
+        entry->task = new_task();
+        // keep the order of the cache
+        *p_last = entry;
+        p_last = &entry->next;
+
+        unsigned int offset = index[i_task].offset;
+        if (offset > size || !map_examples(entry->task, data + offset, end)) {
+            free_task_defs(result);
+            munmap(data, size);
+            return NULL;
+        }
+    }
+    return result;
+}
@@ -1,6 +1,8 @@
 #ifndef __IO_H__
 #define __IO_H__
 
+#include <stdbool.h>
+
 #include "task.h"
 
 typedef struct _task_def {
@@ -9,10 +11,29 @@ typedef struct _task_def {
     task_t * task;
 } task_def_t;
 
+// tasks in the data directory, sorted by name
 task_def_t* list_tasks();
 void free_task_list(task_def_t * list);
+// free the list together with the tasks that were loaded
+void free_task_defs(task_def_t* tasks);
 
+const char* read_file(const char* filename);
 const char * read_task(const char * name);
+// parse a task in the ARC json schema, the caller owns the source
 task_t* parse_task(const char* source);
 
+/**
+ * Read and parse the tasks in the list concurrently, on a pool of threads.
+ * Tasks that could not be read are left NULL, returns the number of tasks read.
+ */
+int load_tasks(task_def_t* tasks, int n_workers);
+
+/**
+ * The task cache is a single binary file holding the grids of all tasks,
+ * with an index at the start.  Loading maps the file and uses the grids in
+ * place, without any parsing.
+ */
+bool write_task_cache(const char* filename, task_def_t** tasks, int n_tasks);
+task_def_t* load_task_cache(const char* filename);
+
 #endif  // __IO_H__
\ No newline at end of file
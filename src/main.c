@@ -1,29 +1,175 @@
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "filter.h"
 #include "guide.h"
 #include "image.h"
 #include "io.h"
 #include "mtwister.h"
+#include "parser.h"
+#include "program.h"
+#include "sample_log.h"
+#include "solve.h"
 #include "transform.h"
 
+static void train(
+    task_def_t** task_array, int n_tasks, guide_t* guide, FILE* out, sample_log_t* log);
+
+// training stops on SIGINT/SIGTERM, so that buffered samples can be flushed
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt(__attribute__((unused)) int signal) { interrupted = 1; }
+
+static void usage(const char* name) {
+    fprintf(
+        stderr,
+        "usage: %s [-c cache | -p cache] [-f challenges [-s solutions]] [-e [-m mode] [-w width]] [-l log] "
+        "[-r resamples] [-t seconds] [-n samples] [-j workers] [output]\n"
+        "  -c  load tasks from a task cache instead of parsing data/\n"
+        "  -p  preprocess: write the tasks to a task cache and exit\n"
+        "  -f  read tasks from a combined challenges file instead of data/\n"
+        "  -s  test outputs for the challenges file\n"
+        "  -e  evaluation mode: solve each task once instead of training\n"
+        "  -m  how programs are found in evaluation mode: sample (default), enumerate\n"
+        "      (exhaustively, without the guide), best-first (most probable first) or beam\n"
+        "  -w  beam width in beam mode, at least 1 and at most %d\n"
+        "  -l  write training samples to a binary log instead of the CSV output\n"
+        "  -r  times a failed filter or binding is sampled again before the sample is dropped\n"
+        "  -t  wall-clock budget per task in evaluation mode\n"
+        "  -n  sample (or expansion) budget per task in evaluation mode\n"
+        "  -j  number of worker threads for loading tasks and evaluation\n",
+        name,
+        MAX_BEAM_WIDTH);
+}
+
 int main(int argc, char* argv[]) {
+    bool evaluate = false;
+    const char* log_filename = NULL;
+    const char* cache_filename = NULL;
+    const char* challenges_filename = NULL;
+    const char* solutions_filename = NULL;
+    bool preprocess = false;
+    int max_resamples = 3;
+    solve_options_t options = {
+        .time_budget = 10.0,
+        .sample_budget = 10000,
+        .n_workers = sysconf(_SC_NPROCESSORS_ONLN),
+        .mode = SOLVE_SAMPLE,
+        .beam_width = 64,
+    };
+    int opt;
+    while ((opt = getopt(argc, argv, "c:p:f:s:em:w:l:r:t:n:j:")) != -1) {
+        switch (opt) {
+            case 'c':
+                cache_filename = optarg;
+                break;
+            case 'p':
+                cache_filename = optarg;
+                preprocess = true;
+                break;
+            case 'f':
+                challenges_filename = optarg;
+                break;
+            case 's':
+                solutions_filename = optarg;
+                break;
+            case 'e':
+                evaluate = true;
+                break;
+            case 'm':
+                if (!strcmp(optarg, "sample")) {
+                    options.mode = SOLVE_SAMPLE;
+                } else if (!strcmp(optarg, "enumerate")) {
+                    options.mode = SOLVE_ENUMERATE;
+                } else if (!strcmp(optarg, "best-first")) {
+                    options.mode = SOLVE_BEST_FIRST;
+                } else if (!strcmp(optarg, "beam")) {
+                    options.mode = SOLVE_BEAM;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'w':
+                options.beam_width = atoi(optarg);
+                if (options.beam_width < 1) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                if (options.beam_width > MAX_BEAM_WIDTH) {
+                    fprintf(stderr, "beam width capped at %d\n", MAX_BEAM_WIDTH);
+                    options.beam_width = MAX_BEAM_WIDTH;
+                }
+                break;
+            case 'l':
+                log_filename = optarg;
+                break;
+            case 'r':
+                max_resamples = atoi(optarg);
+                if (max_resamples < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 't':
+                options.time_budget = atof(optarg);
+                break;
+            case 'n':
+                options.sample_budget = atol(optarg);
+                break;
+            case 'j':
+                options.n_workers = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
     FILE* out = stdout;
-    if (argc >= 2) {
-        char* out_filename = argv[1];
+    if (optind < argc) {
+        char* out_filename = argv[optind];
         out = fopen(out_filename, "a");
     }
 
-    task_def_t* tasks = list_tasks();
+    task_def_t* tasks;
     int n_tasks = 0;
-    for (task_def_t* task_def = tasks; task_def; task_def = task_def->next) {
-        const char* source = read_task(task_def->name);
-        if (source) {
-            task_def->task = parse_task(source);
+    if (cache_filename && !preprocess) {
+        tasks = load_task_cache(cache_filename);
+        if (!tasks) {
+            fprintf(stderr, "unable to load task cache %s\n", cache_filename);
+            return 1;
+        }
+        for (task_def_t* task_def = tasks; task_def; task_def = task_def->next) {
+            n_tasks++;
+        }
+    } else if (challenges_filename) {
+        const char* challenges = read_file(challenges_filename);
+        const char* solutions = solutions_filename ? read_file(solutions_filename) : NULL;
+        if (!challenges || (solutions_filename && !solutions)) {
+            fprintf(
+                stderr,
+                "unable to read %s\n",
+                challenges ? solutions_filename : challenges_filename);
+            return 1;
+        }
+        tasks = parse_task_collection(challenges, solutions);
+        free((char*)challenges);
+        free((char*)solutions);
+        if (!tasks) {
+            fprintf(stderr, "unable to parse tasks in %s\n", challenges_filename);
+            return 1;
+        }
+        for (task_def_t* task_def = tasks; task_def; task_def = task_def->next) {
             n_tasks++;
         }
+    } else {
+        tasks = list_tasks();
+        n_tasks = load_tasks(tasks, options.n_workers);
     }
     task_def_t* task_array[n_tasks];
     n_tasks = 0;
@@ -33,6 +179,15 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (preprocess) {
+        if (!write_task_cache(cache_filename, task_array, n_tasks)) {
+            fprintf(stderr, "unable to write task cache %s\n", cache_filename);
+            return 1;
+        }
+        fprintf(stderr, "Wrote %d tasks to %s\n", n_tasks, cache_filename);
+        return 0;
+    }
+
     guide_builder_t builder;
     init_guide(&builder);
 
@@ -40,102 +195,149 @@ int main(int argc, char* argv[]) {
     init_filter(&builder);
     init_binding(&builder);
     init_transform(&builder);
+    init_program(&builder);
     guide_t* guide = build_guide(&builder);
+    guide->max_resamples = max_resamples;
+    // the weights are not updated in evaluation mode, so the distributions can be cached
+    guide->inference = evaluate;
+    guide->cache_distributions = evaluate;
+
+    if (evaluate) {
+        solve_result_t* results = malloc(n_tasks * sizeof(solve_result_t));
+        solve_tasks(task_array, n_tasks, guide, &options, results);
+        print_solve_report(out, task_array, n_tasks, results);
+        free(results);
+    } else {
+        sample_log_t* log = NULL;
+        if (log_filename) {
+            log = open_sample_log(log_filename, guide->items);
+            if (!log) {
+                fprintf(stderr, "unable to open sample log %s\n", log_filename);
+                return 1;
+            }
+        }
+        signal(SIGINT, interrupt);
+        signal(SIGTERM, interrupt);
+        train(task_array, n_tasks, guide, out, log);
+        if (log) {
+            close_sample_log(log);
+        }
+        fflush(out);
+    }
+
+    return 0;
+}
+
+static unsigned int elapsed_micros(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+}
 
+static void train(
+    task_def_t** task_array, int n_tasks, guide_t* guide, FILE* out, sample_log_t* log) {
     MTRand rnd = seedRand(1234l);
 
-    fprintf(out, "task,example,loss,reconstructed,abstraction,filter,transform\n");
-    while (true) {
+    if (!log) {
+        fprintf(out, "task,example,loss,reconstructed,abstraction,filter,transform\n");
+    }
+    while (!interrupted) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
         int i_task = genRandLong(&rnd) % n_tasks;
         task_def_t* task_def = task_array[i_task];
         task_t* task = task_def->task;
 
         int i_train = genRandLong(&rnd) % task->n_train;
-        const graph_t* input = task->train_input[i_train];
-        const graph_t* output = task->train_output[i_train];
-        trail_t* trail = new_trail(input, output, guide);
-
-        abstraction_t* abstraction = sample_abstraction(&trail);
-        graph_t* graph = abstraction->func(input);
-        filter_call_t* filter = sample_filter(task, graph, &trail);
-        if (!filter) {
-            goto no_filter;
-        }
+        const grid_t* input = &task->train_input[i_train];
+        const raster_t* input_raster = task->train_input_raster[i_train];
+        const raster_t* output_raster = task->train_output_raster[i_train];
+        trail_t* trail = new_trail(input_raster, output_raster, guide);
 
-        transform_call_t* call = sample_transform(task, graph, filter, &trail);
-        if (!call) {
-            goto no_transform;
+        program_t program = {NULL};
+        program.abstraction = sample_abstraction(&trail);
+        graph_t* graph = program.abstraction->func(input);
+        if (!sample_steps(task, graph, &program, &trail)) {
+            goto no_program;
         }
 
         // printf("Found training example for %s\n", task_def->name);
-        bool transformed = false;
-        for (node_t* node = graph->nodes; node; node = node->next) {
-            if (filter->filter->func(graph, node, &filter->args)) {
-                transform_arguments_t transform_args = call->arguments;
-                if (apply_binding(graph, node, &call->dynamic, &transform_args) &&
-                    call->transform->func(graph, node, &transform_args)) {
-                    transformed = true;
-                }
-            }
-        }
+        bool transformed = transform_graph(&program, graph);
 
-        graph_t* reconstructed = undo_abstraction(graph);
-        if (!reconstructed) {
+        raster_t* reconstructed = new_raster(graph->width, graph->height);
+        if (!render_abstraction(graph, reconstructed)) {
             goto no_reconstruction;
         }
 
-        bool is_correct = true;
-        if (output->width == reconstructed->width && output->height == reconstructed->height) {
-            for (int x = 0; x < output->width; x++) {
-                for (int y = 0; y < output->height; y++) {
-                    const node_t* node = get_node(reconstructed, (coordinate_t){x, y});
-                    const node_t* orig = get_node(output, (coordinate_t){x, y});
-                    const subnode_t subnode = get_subnode(node, 0);
-                    const subnode_t refsub = get_subnode(orig, 0);
-                    if (subnode.color != refsub.color) {
-                        is_correct = false;
-                    }
-                }
-            }
-            if (is_correct) {
-                fprintf(stderr, "  %s: Correct transformation\n", task_def->name);
-            }
-        } else {
-            is_correct = false;
+        bool is_correct = rasters_equal(reconstructed, output_raster);
+        if (is_correct) {
+            fprintf(stderr, "  %s: Correct transformation\n", task_def->name);
         }
 
+        // train once per distinct reconstruction, unless a cheaper program for it comes along,
+        // programs whose output equals the input teach nothing
+        bool is_new = false;
         if (transformed) {
-            trail_t* train_trail = new_trail(input, reconstructed, guide);
-            train_trail = observe_abstraction(train_trail, abstraction);
-            train_trail = observe_filter(train_trail, filter);
-            train_trail = observe_transform(train_trail, call);
-            float loss = free_trail(guide, train_trail, true);
-            fprintf(
-                out,
-                "%s, %d, %.12e, %d, %s, %s, %s\n",
-                task_def->name,
-                i_train,
-                loss,
-                is_correct,
-                abstraction->name,
-                filter->filter->name,
-                call->transform->name);
-            fflush(out);
+            program_key_t key;
+            if (!encode_program(&program, &key)) {
+                key.size = 0;
+            }
+            output_table_t* outputs = &task->_train_outputs[i_train];
+            if (!outputs->input_hash) {
+                outputs->input_hash = hash_raster(input_raster);
+            }
+            // a diff against the input: every pixel is compared, the few changed ones are mixed
+            unsigned long hash = rehash_raster(reconstructed, input_raster, outputs->input_hash);
+            if (hash != outputs->input_hash) {
+                signed char choices[SAMPLE_MAX_CHOICES];
+                int n_choices = get_trail_choices(trail, choices, SAMPLE_MAX_CHOICES);
+                int cost = 0;
+                for (int i = 0; i < n_choices; i++) {
+                    cost += choices[i] >= 0;
+                }
+                is_new = record_output(outputs, hash, cost, &key);
+            }
         }
 
-        free_graph(reconstructed);
+        if (is_new) {
+            trail_t* train_trail = new_trail(input_raster, reconstructed, guide);
+            train_trail = observe_abstraction(train_trail, program.abstraction);
+            train_trail = observe_steps(train_trail, &program);
+            if (log) {
+                sample_record_t record = {
+                    .example = i_train,
+                    .correct = is_correct,
+                };
+                strncpy(record.task, task_def->name, SAMPLE_TASK_ID_SIZE);
+                record.n_choices =
+                    get_trail_choices(train_trail, record.choices, SAMPLE_MAX_CHOICES);
+                get_trail_items(train_trail, record.items, SAMPLE_MAX_CHOICES);
+                record.loss = free_trail(guide, train_trail, true);
+                record.micros = elapsed_micros(&start);
+                log_sample(log, &record);
+            } else {
+                float loss = free_trail(guide, train_trail, true);
+                fprintf(
+                    out,
+                    "%s, %d, %.12e, %d, %s, %s, %s\n",
+                    task_def->name,
+                    i_train,
+                    loss,
+                    is_correct,
+                    program.abstraction->name,
+                    program.steps[0].filter->filter->name,
+                    program.steps[0].transform->transform->name);
+            }
+        }
 
     no_reconstruction:
-        free_transform(task, call);
+        free_raster(reconstructed);
 
-    no_transform:
-        free_item(task->_mem_filter_calls, filter);
-
-    no_filter:
+    no_program:
+        free_program(task, &program);
         free_graph(graph);
 
         free_trail(guide, trail, false);
     }
-
-    return 0;
 }
\ No newline at end of file
@@ -2,7 +2,9 @@
 
 #include <torch/torch.h>
 
+#include <cmath>
 #include <iostream>
+#include <map>
 
 using namespace torch;
 using namespace std;
@@ -227,6 +229,40 @@ struct NNetModuleImpl : nn::Module {
         };
     }
 
+    /**
+     * The forward pass for several states at once, their distributions are
+     * stored in the states and returned as rows.  The preceding choices are
+     * padded to the longest sequence, padding does not receive attention.
+     */
+    Tensor forward_batch(const vector<NNetState*>& states) {
+        vector<Tensor> observations, keys, values;
+        vector<int64_t> lengths;
+        for (auto state : states) {
+            observations.push_back(state->observations);
+            keys.push_back(state->keys);
+            values.push_back(state->values);
+            lengths.push_back(state->keys.sizes().at(0));
+        }
+        auto query = torch::relu(project->forward(torch::stack(observations)));
+
+        auto padded_keys = nn::utils::rnn::pad_sequence(keys, true);
+        auto padded_values = nn::utils::rnn::pad_sequence(values, true);
+        auto positions = torch::arange(
+            padded_keys.sizes().at(1), TensorOptions().dtype(kLong).device(query.device()));
+        auto used = positions.unsqueeze(0) < torch::tensor(lengths).to(query.device()).unsqueeze(1);
+        auto weights = torch::bmm(padded_keys, query.unsqueeze(2))
+                           .squeeze(2)
+                           .masked_fill(used.logical_not(), -INFINITY)
+                           .softmax(1);
+        auto value = torch::bmm(weights.unsqueeze(1), padded_values).squeeze(1);
+
+        Tensor dist_states = decode->forward(value);
+        for (int i = 0; i < (int)states.size(); i++) {
+            states[i]->dist_state = dist_states[i];
+        }
+        return dist_states;
+    }
+
     NNetState observe(NNetState& state, int choice) {
         Tensor target = torch::zeros(state.dist_state.sizes());
         target[choice] = 1.0;
@@ -277,6 +313,7 @@ class NNetGuide : nn::Module {
               std::vector<optim::OptimizerParamGroup>(), optim::AdamWOptions().amsgrad(true)),
           scheduler(optimizer, 1000, 0.9),
           minibatch_size(0),
+          version(0),
           loss(torch::zeros({1}, TensorOptions().requires_grad(true)).cuda()) {
         int index = 0;
         for (auto& step : steps) {
@@ -291,7 +328,8 @@ class NNetGuide : nn::Module {
         optimizer.add_param_group(parameters());
     }
 
-    NNetState new_state(const Tensor& input, const Tensor& output) {
+    NNetState new_state(const Tensor& input, const Tensor& output, bool inference) {
+        AutoGradMode grad_mode(!inference);
         Tensor tmp_input = init_input->forward(input.cuda());
         Tensor tmp_output = init_output->forward(output.cuda());
 
@@ -331,6 +369,7 @@ class NNetGuide : nn::Module {
             loss.backward();
             optimizer.step();
             scheduler.step();
+            version++;
 
             minibatch_size = 0;
             loss = torch::zeros({1}, TensorOptions().requires_grad(true)).cuda();
@@ -350,16 +389,44 @@ class NNetGuide : nn::Module {
     // dynamically built up mini-batch
     int minibatch_size;
     Tensor loss;
+
+   public:
+    // number of updates of the weights
+    long version;
 };
 
 class NNetTrail {
    public:
-    NNetTrail(NNetGuide* guide, const Tensor& input, const Tensor& output)
-        : guide(guide), iter(guide->steps.begin()), state(guide->new_state(input, output)) {}
+    NNetTrail(NNetGuide* guide, const Tensor& input, const Tensor& output, bool inference)
+        : guide(guide),
+          iter(guide->steps.begin()),
+          inference(inference),
+          state(guide->new_state(input, output, inference)) {}
+
+    // distribution of the next choice, left on the device
+    Tensor forward_choice() {
+        AutoGradMode grad_mode(!inference);
+        state = (*iter)->forward(state);
+        return state.dist_state.softmax(0);
+    }
+
+    // forward_choice for trails at the same item, as one batch with a distribution per row
+    static Tensor forward_choices(const vector<NNetTrail*>& trails) {
+        bool inference = true;
+        vector<NNetState*> states;
+        for (auto trail : trails) {
+            inference &= trail->inference;
+            states.push_back(&trail->state);
+        }
+        AutoGradMode grad_mode(!inference);
+        return (*trails[0]->iter)->forward_batch(states).softmax(1);
+    }
+
+    // index of the item the trail is at
+    int step() const { return iter - guide->steps.begin(); }
 
     void next_choice(double* p) {
-        state = (*iter)->forward(state);
-        auto soft_dist = state.dist_state.softmax(0).to(kFloat64).cpu();
+        auto soft_dist = forward_choice().to(kFloat64).cpu();
         double* dist_values = (double*)soft_dist.data_ptr();
         for (int i = 0; i < soft_dist.sizes().at(0); i++) {
             p[i] = dist_values[i];
@@ -367,13 +434,17 @@ class NNetTrail {
     }
 
     void observe(int choice) {
+        AutoGradMode grad_mode(!inference);
         if (choice >= 0) {
             state = (*iter)->observe(state, choice);
         }
         ++iter;
     }
 
+    void seek(int step) { iter = guide->steps.begin() + step; }
+
     float train() {
+        assert(!inference);
         double loss_value = state.loss.item().toDouble();
         // cout << "loss: " << loss_value[0] << endl;
         guide->train(state.loss);
@@ -383,6 +454,8 @@ class NNetTrail {
    private:
     NNetGuide* guide;
     vector<NNetModule>::iterator iter;
+    // no gradients are tracked, so that forks (e.g. in the distribution cache) keep no graph
+    bool inference;
     NNetState state;
 };
 
@@ -446,14 +519,19 @@ guide_net_t build_network(guide_net_builder_t net) {
     return builder->build();
 }
 
+long network_version(guide_net_t c_guide) {
+    return static_cast<NNetGuide*>(c_guide)->version;
+}
+
 trail_net_t create_network_trail(
     guide_net_t c_guide,
     unsigned int input_width,
     unsigned int input_height,
-    unsigned int* input_pixels,
+    const unsigned char* input_pixels,
     unsigned int output_width,
     unsigned int output_height,
-    unsigned int* output_pixels) {
+    const unsigned char* output_pixels,
+    bool inference) {
     NNetGuide* guide = static_cast<NNetGuide*>(c_guide);
 
     // copy the input data by creating a 3d representation (each color has a depth)
@@ -492,7 +570,7 @@ trail_net_t create_network_trail(
         {1, 1, 10, output_height + 2, output_width + 2},
         [&](void* data) { free(data); },
         TensorOptions().dtype(kFloat));
-    return new NNetTrail(guide, input_tensor, output_tensor);
+    return new NNetTrail(guide, input_tensor, output_tensor, inference);
 }
 
 void next_network_choice(trail_net_t c_trail, double* p) {
@@ -500,12 +578,61 @@ void next_network_choice(trail_net_t c_trail, double* p) {
     trail->next_choice(p);
 }
 
+void next_network_choices(trail_net_t* c_trails, int n_trails, double* p, int stride) {
+    // trails at the same item share its module, which runs once for all of them
+    map<int, vector<int>> groups;
+    for (int i = 0; i < n_trails; i++) {
+        groups[static_cast<NNetTrail*>(c_trails[i])->step()].push_back(i);
+    }
+    vector<Tensor> dists;
+    for (auto& group : groups) {
+        vector<NNetTrail*> trails;
+        for (int i : group.second) {
+            trails.push_back(static_cast<NNetTrail*>(c_trails[i]));
+        }
+        dists.push_back(NNetTrail::forward_choices(trails));
+    }
+
+    // a single transfer from the device for all trails
+    vector<Tensor> flat_dists;
+    for (auto& dist : dists) {
+        flat_dists.push_back(dist.flatten());
+    }
+    auto soft_dists = torch::cat(flat_dists).to(kFloat64).cpu();
+    double* dist_values = (double*)soft_dists.data_ptr();
+    int i_group = 0;
+    for (auto& group : groups) {
+        int n_choices = dists[i_group++].sizes().at(1);
+        for (int i : group.second) {
+            for (int j = 0; j < n_choices; j++) {
+                p[i * stride + j] = *dist_values++;
+            }
+        }
+    }
+}
+
 trail_net_t observe_network_choice(trail_net_t c_trail, int choice) {
     NNetTrail* trail = static_cast<NNetTrail*>(c_trail);
     trail->observe(choice);
     return trail;
 }
 
+void seek_network_trail(trail_net_t c_trail, int step) {
+    NNetTrail* trail = static_cast<NNetTrail*>(c_trail);
+    trail->seek(step);
+}
+
+trail_net_t fork_network_trail(trail_net_t c_trail) {
+    NNetTrail* trail = static_cast<NNetTrail*>(c_trail);
+    // tensors are immutable once computed, so the copies share them
+    return new NNetTrail(*trail);
+}
+
+void restore_network_trail(trail_net_t c_trail, trail_net_t c_saved) {
+    NNetTrail* trail = static_cast<NNetTrail*>(c_trail);
+    *trail = *static_cast<NNetTrail*>(c_saved);
+}
+
 float complete_trail(trail_net_t c_trail, bool success) {
     NNetTrail* trail = static_cast<NNetTrail*>(c_trail);
     float result = 0.0f;
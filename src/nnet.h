@@ -13,20 +13,34 @@ void add_choice_to_net(guide_net_builder_t net, int n_choices, const char * name
 typedef void * guide_net_t;
 guide_net_t build_network(guide_net_builder_t builder);
 
+// changes whenever the weights of the network are updated
+long network_version(guide_net_t net);
+
 typedef void * trail_net_t;
 
+// an inference trail (and its forks) does not track gradients, it can not be trained
 trail_net_t create_network_trail(
   guide_net_t net,
   unsigned int input_width,
   unsigned int input_height,
-  unsigned int * input_pixels,
+  const unsigned char * input_pixels,
   unsigned int output_width,
   unsigned int output_height,
-  unsigned int * output_pixels
+  const unsigned char * output_pixels,
+  bool inference
 );
 
 void next_network_choice(trail_net_t trail, double * p);
+// next_network_choice for a batch of trails, the distribution of trail i starts at p[i * stride]
+// trails at the same item go through its module in one pass
+void next_network_choices(trail_net_t * trails, int n_trails, double * p, int stride);
 trail_net_t observe_network_choice(trail_net_t trail, int choice);
+// continue the trail at another step, e.g. to repeat a part of the sequence
+void seek_network_trail(trail_net_t trail, int step);
+// independent copy of a trail, e.g. to continue it with different choices
+trail_net_t fork_network_trail(trail_net_t trail);
+// continue the trail from a copy made by fork_network_trail, the copy is left unchanged
+void restore_network_trail(trail_net_t trail, trail_net_t saved);
 float complete_trail(trail_net_t trail, bool success);
 
 #ifdef __cplusplus
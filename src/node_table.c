@@ -0,0 +1,138 @@
+#include "node_table.h"
+
+#include <string.h>
+
+const node_table_t* get_node_table(const graph_t* graph) {
+    if (graph->_node_table) {
+        return graph->_node_table;
+    }
+
+    int n_nodes = graph->n_nodes;
+    int n_padded = (n_nodes + NODE_CHUNK - 1) / NODE_CHUNK * NODE_CHUNK;
+    int n_neighbors = 0;
+    for (const node_t* node = graph->nodes; node; node = node->next) {
+        n_neighbors += node->n_edges;
+    }
+
+    // a single allocation, the columns follow the table
+    size_t n_bytes = sizeof(node_table_t) + n_padded * sizeof(const node_t*) +
+                     (n_nodes + 1) * sizeof(int) + 4 * n_padded * sizeof(unsigned short) +
+                     (NODES_ALLOC + n_neighbors) * sizeof(unsigned short);
+    node_table_t* table = malloc(n_bytes);
+    void* cursor = (void*)table + sizeof(node_table_t);
+    table->nodes = cursor;
+    cursor += n_padded * sizeof(const node_t*);
+    table->neighbor_offset = cursor;
+    cursor += (n_nodes + 1) * sizeof(int);
+    table->size = cursor;
+    table->degree = table->size + n_padded;
+    table->colors = table->degree + n_padded;
+    table->neighbor_colors = table->colors + n_padded;
+    table->_index = table->neighbor_colors + n_padded;
+    table->neighbors = table->_index + NODES_ALLOC;
+    memset(table->size, 0, 4 * n_padded * sizeof(unsigned short));
+
+    table->n_nodes = n_nodes;
+    table->derived = get_derived_properties(graph);
+    table->background_color = graph->background_color;
+    table->_pool = graph->_all_nodes;
+    table->_memos = NULL;
+    table->any_colors = 0;
+    table->all_colors = 0xffff;
+    table->any_neighbor_colors = 0;
+
+    int idx = 0;
+    for (const node_t* node = graph->nodes; node; node = node->next) {
+        table->_index[node - graph->_all_nodes] = idx;
+        table->nodes[idx] = node;
+        table->size[idx] = node->n_subnodes;
+        table->degree[idx] = node->n_edges;
+        if (node->n_subnodes > 0) {
+            int n_colored = graph->is_multicolor ? node->n_subnodes : 1;
+            for (int i = 0; i < n_colored; i++) {
+                table->colors[idx] |= color_bit(get_subnode(node, i).color);
+            }
+        }
+        table->any_colors |= table->colors[idx];
+        table->all_colors &= table->colors[idx];
+        idx++;
+    }
+
+    // neighbors refer to the index of the peer in the table
+    int offset = 0;
+    idx = 0;
+    for (const node_t* node = graph->nodes; node; node = node->next) {
+        table->neighbor_offset[idx] = offset;
+        for (const edge_t* edge = node->edges; edge; edge = edge->next) {
+            table->neighbors[offset++] = get_node_index(table, edge->peer);
+            if (edge->peer->n_subnodes > 0) {
+                table->neighbor_colors[idx] |= color_bit(get_subnode(edge->peer, 0).color);
+            }
+        }
+        table->any_neighbor_colors |= table->neighbor_colors[idx];
+        idx++;
+    }
+    table->neighbor_offset[idx] = offset;
+
+    ((graph_t*)graph)->_node_table = table;
+    return table;
+}
+
+void free_node_table(node_table_t* table) {
+    while (table->_memos) {
+        node_memo_t* memo = table->_memos;
+        table->_memos = memo->next;
+        free(memo);
+    }
+    free(table);
+}
+
+node_memo_t* get_node_memo(const node_table_t* table, const void* key, int key_size) {
+    for (node_memo_t* memo = table->_memos; memo; memo = memo->next) {
+        if (memo->key_size == key_size && !memcmp(memo->key, key, key_size)) {
+            return memo;
+        }
+    }
+
+    // a single allocation: key, resolved mask and values
+    int n_words = NODE_MASK_WORDS(table->n_nodes);
+    int key_bytes = (key_size + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+    node_memo_t* memo = malloc(
+        sizeof(node_memo_t) + key_bytes + n_words * sizeof(unsigned long) +
+        table->n_nodes * sizeof(const node_t*));
+    memo->key_size = key_size;
+    memcpy(memo->key, key, key_size);
+    memo->resolved = (unsigned long*)(memo->key + key_bytes);
+    memo->values = (const node_t**)(memo->resolved + n_words);
+    memset(memo->resolved, 0, n_words * sizeof(unsigned long));
+
+    node_table_t* mutable = (node_table_t*)table;
+    memo->next = mutable->_memos;
+    mutable->_memos = memo;
+    return memo;
+}
+
+void keep_with_neighbor(
+    const node_table_t* table, const unsigned long* peers, unsigned long* matches) {
+    for (int idx = 0; idx < table->n_nodes; idx++) {
+        if (!is_node_matched(matches, idx)) {
+            continue;
+        }
+        bool found = false;
+        for (int i = table->neighbor_offset[idx]; !found && i < table->neighbor_offset[idx + 1];
+             i++) {
+            found = is_node_matched(peers, table->neighbors[i]);
+        }
+        if (!found) {
+            matches[idx / 64] &= ~(1ul << (idx % 64));
+        }
+    }
+}
+
+int count_matches(const node_table_t* table, const unsigned long* matches) {
+    int count = 0;
+    for (int i = 0; i < NODE_MASK_WORDS(table->n_nodes); i++) {
+        count += __builtin_popcountl(matches[i]);
+    }
+    return count;
+}
@@ -0,0 +1,164 @@
+#ifndef __NODE_TABLE_H__
+#define __NODE_TABLE_H__
+
+#include <stdbool.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "graph.h"
+
+// nodes are matched in chunks of this size, the columns are padded to it
+#define NODE_CHUNK 16
+
+// words in a node mask, the last word has a zero bit beyond the last node
+#define NODE_MASK_WORDS(n) ((n) / 64 + 1)
+
+/**
+ * The properties of the nodes of a graph that filters look at, one column
+ * per property, in the order of graph->nodes.  Node i is matched by setting
+ * bit i % 64 of word i / 64 in a node mask.
+ */
+typedef struct _node_table {
+    int n_nodes;
+    const node_t** nodes;
+    unsigned short* size;
+    unsigned short* degree;
+    // bit per color: of the node (or all its subnodes, in a multicolor graph) and of its neighbors
+    unsigned short* colors;
+    unsigned short* neighbor_colors;
+    // neighbors of node i are neighbors[neighbor_offset[i]] .. neighbors[neighbor_offset[i + 1] - 1]
+    int* neighbor_offset;
+    unsigned short* neighbors;
+    derived_props_t derived;
+    color_t background_color;
+    // union and intersection of the colors of the nodes, and union of their neighbor colors
+    unsigned short any_colors;
+    unsigned short all_colors;
+    unsigned short any_neighbor_colors;
+
+    // table index of the nodes, by their position in the pool of the graph
+    const node_t* _pool;
+    unsigned short* _index;
+    struct _node_memo* _memos;
+} node_table_t;
+
+/**
+ * A node per entry of the table, computed on demand and kept for as long as
+ * the table is valid.  Memos are identified by the bytes of their key.
+ */
+typedef struct _node_memo {
+    struct _node_memo* next;
+    int key_size;
+    unsigned long* resolved;
+    const node_t** values;
+    char key[];
+} node_memo_t;
+
+/**
+ * The table of the graph, built when it is first needed.  It is dropped when
+ * nodes or edges are added or removed; code that changes subnodes in place
+ * has to drop it with invalidate_node_table.
+ */
+const node_table_t* get_node_table(const graph_t* graph);
+
+static inline int get_node_index(const node_table_t* table, const node_t* node) {
+    return table->_index[node - table->_pool];
+}
+
+// the memo with the key, an empty one is added to the table when there is none yet
+node_memo_t* get_node_memo(const node_table_t* table, const void* key, int key_size);
+
+static inline bool get_memoized(const node_memo_t* memo, int idx, const node_t** value) {
+    if (!((memo->resolved[idx / 64] >> (idx % 64)) & 1)) {
+        return false;
+    }
+    *value = memo->values[idx];
+    return true;
+}
+
+static inline void set_memoized(node_memo_t* memo, int idx, const node_t* value) {
+    memo->resolved[idx / 64] |= 1ul << (idx % 64);
+    memo->values[idx] = value;
+}
+
+static inline unsigned short color_bit(color_t color) {
+    return color >= 0 && color < 16 ? 1 << color : 0;
+}
+
+// the color that a symbolic color (background, most or least common) stands for
+static inline color_t resolve_color(const node_table_t* table, color_t color) {
+    if (color == BACKGROUND_COLOR) {
+        return table->background_color;
+    } else if (color == MOST_COMMON_COLOR) {
+        return table->derived.most_common_color;
+    } else if (color == LEAST_COMMON_COLOR) {
+        return table->derived.least_common_color;
+    }
+    return color;
+}
+
+static inline bool is_node_matched(const unsigned long* matches, int idx) {
+    return (matches[idx / 64] >> (idx % 64)) & 1;
+}
+
+// the nodes in the table, rounded up to whole chunks
+static inline int padded_nodes(const node_table_t* table) {
+    return (table->n_nodes + NODE_CHUNK - 1) / NODE_CHUNK * NODE_CHUNK;
+}
+
+// a bit per node of the chunk that starts at idx, for which the column equals the value
+static inline unsigned int match_chunk_equal(
+    const unsigned short* column, int idx, unsigned short value) {
+#ifdef __SSE2__
+    __m128i v_value = _mm_set1_epi16(value);
+    __m128i lo = _mm_loadu_si128((const __m128i*)&column[idx]);
+    __m128i hi = _mm_loadu_si128((const __m128i*)&column[idx + 8]);
+    return _mm_movemask_epi8(
+        _mm_packs_epi16(_mm_cmpeq_epi16(lo, v_value), _mm_cmpeq_epi16(hi, v_value)));
+#else
+    unsigned int bits = 0;
+    for (int i = 0; i < NODE_CHUNK; i++) {
+        bits |= (column[idx + i] == value) << i;
+    }
+    return bits;
+#endif
+}
+
+// a bit per node of the chunk for which the column has any of the bits set
+static inline unsigned int match_chunk_any_bits(
+    const unsigned short* column, int idx, unsigned short bits) {
+#ifdef __SSE2__
+    __m128i v_bits = _mm_set1_epi16(bits);
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_and_si128(_mm_loadu_si128((const __m128i*)&column[idx]), v_bits);
+    __m128i hi = _mm_and_si128(_mm_loadu_si128((const __m128i*)&column[idx + 8]), v_bits);
+    __m128i none = _mm_packs_epi16(_mm_cmpeq_epi16(lo, zero), _mm_cmpeq_epi16(hi, zero));
+    return _mm_movemask_epi8(none) ^ 0xffff;
+#else
+    unsigned int any = 0;
+    for (int i = 0; i < NODE_CHUNK; i++) {
+        any |= ((column[idx + i] & bits) != 0) << i;
+    }
+    return any;
+#endif
+}
+
+// store the match bits of the chunk that starts at idx
+static inline void set_chunk_matches(unsigned long* matches, int idx, unsigned int bits) {
+    matches[idx / 64] |= (unsigned long)bits << (idx % 64);
+}
+
+// clear the bits beyond the last node
+static inline void clear_padding(const node_table_t* table, unsigned long* matches) {
+    matches[table->n_nodes / 64] &= (1ul << (table->n_nodes % 64)) - 1;
+}
+
+// keep the matches that have a neighbor among the peers
+void keep_with_neighbor(
+    const node_table_t* table, const unsigned long* peers, unsigned long* matches);
+
+// the number of nodes in the mask
+int count_matches(const node_table_t* table, const unsigned long* matches);
+
+#endif  // __NODE_TABLE_H__
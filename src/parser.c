@@ -0,0 +1,375 @@
+#include "parser.h"
+
+#include <string.h>
+
+typedef struct _parser {
+    const char* cursor;
+} parser_t;
+
+static inline void skip_whitespace(parser_t* parser) {
+    const char* p = parser->cursor;
+    while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') {
+        p++;
+    }
+    parser->cursor = p;
+}
+
+static inline bool expect(parser_t* parser, char c) {
+    skip_whitespace(parser);
+    if (*parser->cursor != c) {
+        return false;
+    }
+    parser->cursor++;
+    return true;
+}
+
+// consume a ',' and return true, or leave the closing character and return false
+static inline bool next_element(parser_t* parser) {
+    skip_whitespace(parser);
+    if (*parser->cursor == ',') {
+        parser->cursor++;
+        return true;
+    }
+    return false;
+}
+
+// strings are returned in place - escapes do not occur in the keys we are interested in
+static bool parse_string(parser_t* parser, const char** str, int* len) {
+    if (!expect(parser, '"')) {
+        return false;
+    }
+    const char* start = parser->cursor;
+    const char* p = start;
+    while (*p && *p != '"') {
+        if (*p == '\\' && p[1]) {
+            p++;
+        }
+        p++;
+    }
+    if (!*p) {
+        return false;
+    }
+    *str = start;
+    *len = p - start;
+    parser->cursor = p + 1;
+    return true;
+}
+
+static bool is_key(const char* key, int len, const char* name) {
+    return len == (int)strlen(name) && !strncmp(key, name, len);
+}
+
+static bool skip_value(parser_t* parser) {
+    skip_whitespace(parser);
+    char c = *parser->cursor;
+    if (c == '"') {
+        const char* str;
+        int len;
+        return parse_string(parser, &str, &len);
+    } else if (c == '[' || c == '{') {
+        parser->cursor++;
+        char close = c == '[' ? ']' : '}';
+        if (expect(parser, close)) {
+            return true;
+        }
+        do {
+            if (c == '{') {
+                const char* key;
+                int len;
+                if (!parse_string(parser, &key, &len) || !expect(parser, ':')) {
+                    return false;
+                }
+            }
+            if (!skip_value(parser)) {
+                return false;
+            }
+        } while (next_element(parser));
+        return expect(parser, close);
+    } else if (c) {
+        // number or literal
+        const char* p = parser->cursor;
+        while (*p && *p != ',' && *p != ']' && *p != '}' && *p != ' ' && *p != '\n') {
+            p++;
+        }
+        bool parsed = p > parser->cursor;
+        parser->cursor = p;
+        return parsed;
+    }
+    return false;
+}
+
+/**
+ * A grid is scanned twice: first to determine its dimensions, then to write
+ * the cells into a raster of that size.
+ */
+static raster_t* parse_grid(parser_t* parser) {
+    if (!expect(parser, '[')) {
+        return NULL;
+    }
+    const char* start = parser->cursor;
+
+    int n_rows = 0, n_cols = 0, n_cells = 0, row_start = 0;
+    bool in_row = false, in_number = false;
+    const char* p = start;
+    for (;; p++) {
+        char c = *p;
+        if (c >= '0' && c <= '9') {
+            // colors are single digits
+            if (!in_row || in_number) {
+                return NULL;
+            }
+            n_cells++;
+            in_number = true;
+            continue;
+        }
+        in_number = false;
+        if (c == '[') {
+            if (in_row) {
+                return NULL;
+            }
+            in_row = true;
+            row_start = n_cells;
+        } else if (c == ']') {
+            if (!in_row) {
+                break;
+            }
+            in_row = false;
+            n_rows++;
+            if (n_rows == 1) {
+                n_cols = n_cells;
+            } else if (n_cells - row_start != n_cols) {
+                return NULL;
+            }
+        } else if (c != ',' && c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            // negative numbers, fractions, nested values: not a grid
+            return NULL;
+        }
+    }
+    if (n_rows == 0 || n_cols == 0) {
+        return NULL;
+    }
+
+    raster_t* raster = new_raster(n_cols, n_rows);
+    color_t* pixels = raster->pixels;
+    for (const char* q = start; q < p; q++) {
+        if (*q >= '0' && *q <= '9') {
+            *pixels++ = *q - '0';
+        }
+    }
+    parser->cursor = p + 1;
+    return raster;
+}
+
+typedef enum _example_kind {
+    TRAIN_EXAMPLE,
+    TEST_EXAMPLE,
+} example_kind_t;
+
+static bool parse_example(parser_t* parser, task_t* task, example_kind_t kind) {
+    raster_t* input = NULL;
+    raster_t* output = NULL;
+    if (!expect(parser, '{')) {
+        return false;
+    }
+    if (!expect(parser, '}')) {
+        do {
+            const char* key;
+            int len;
+            if (!parse_string(parser, &key, &len) || !expect(parser, ':')) {
+                goto fail;
+            }
+            if (is_key(key, len, "input") && !input) {
+                input = parse_grid(parser);
+                if (!input) {
+                    goto fail;
+                }
+            } else if (is_key(key, len, "output") && !output) {
+                output = parse_grid(parser);
+                if (!output) {
+                    goto fail;
+                }
+            } else if (!skip_value(parser)) {
+                goto fail;
+            }
+        } while (next_element(parser));
+        if (!expect(parser, '}')) {
+            goto fail;
+        }
+    }
+
+    if (kind == TRAIN_EXAMPLE && input && output && task->n_train < MAX_TRAIN_EXAMPLES) {
+        add_train_example(task, input, output);
+        return true;
+    } else if (kind == TEST_EXAMPLE && input && task->n_test < MAX_TEST_INPUT) {
+        add_test_example(task, input, output);
+        return true;
+    }
+
+fail:
+    if (input) {
+        free_raster(input);
+    }
+    if (output) {
+        free_raster(output);
+    }
+    return false;
+}
+
+static bool parse_examples(parser_t* parser, task_t* task, example_kind_t kind) {
+    if (!expect(parser, '[')) {
+        return false;
+    }
+    if (expect(parser, ']')) {
+        return true;
+    }
+    do {
+        if (!parse_example(parser, task, kind)) {
+            return false;
+        }
+    } while (next_element(parser));
+    return expect(parser, ']');
+}
+
+static bool parse_task_object(parser_t* parser, task_t* task) {
+    if (!expect(parser, '{')) {
+        return false;
+    }
+    if (expect(parser, '}')) {
+        return true;
+    }
+    do {
+        const char* key;
+        int len;
+        if (!parse_string(parser, &key, &len) || !expect(parser, ':')) {
+            return false;
+        }
+        bool parsed;
+        if (is_key(key, len, "train")) {
+            parsed = parse_examples(parser, task, TRAIN_EXAMPLE);
+        } else if (is_key(key, len, "test")) {
+            parsed = parse_examples(parser, task, TEST_EXAMPLE);
+        } else {
+            parsed = skip_value(parser);
+        }
+        if (!parsed) {
+            return false;
+        }
+    } while (next_element(parser));
+    return expect(parser, '}');
+}
+
+bool parse_task_json(const char* source, task_t* task) {
+    parser_t parser = {source};
+    if (!parse_task_object(&parser, task)) {
+        return false;
+    }
+    skip_whitespace(&parser);
+    return *parser.cursor == '\0';
+}
+
+static task_def_t* new_task_def(const char* name, int len) {
+    task_def_t* entry = malloc(sizeof(task_def_t) + len + 1);
+    entry->next = NULL;
+    entry->task = NULL;
+    entry->name = (char*)(((void*)entry) + sizeof(task_def_t));
+    memcpy((char*)entry->name, name, len);
+    ((char*)entry->name)[len] = '\0';
+    return entry;
+}
+
+static task_def_t* find_task_def(task_def_t* tasks, const char* name, int len) {
+    for (task_def_t* entry = tasks; entry; entry = entry->next) {
+        if (is_key(name, len, entry->name)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// attach the test outputs of a solutions file to the tasks
+static bool parse_solutions(parser_t* parser, task_def_t* tasks) {
+    if (!expect(parser, '{')) {
+        return false;
+    }
+    if (expect(parser, '}')) {
+        return true;
+    }
+    do {
+        const char* id;
+        int len;
+        if (!parse_string(parser, &id, &len) || !expect(parser, ':')) {
+            return false;
+        }
+        task_def_t* entry = find_task_def(tasks, id, len);
+        if (!entry) {
+            if (!skip_value(parser)) {
+                return false;
+            }
+            continue;
+        }
+        if (!expect(parser, '[')) {
+            return false;
+        }
+        int i_test = 0;
+        if (!expect(parser, ']')) {
+            do {
+                raster_t* output = parse_grid(parser);
+                if (!output) {
+                    return false;
+                }
+                if (i_test < entry->task->n_test) {
+                    set_test_output(entry->task, i_test, output);
+                } else {
+                    free_raster(output);
+                }
+                i_test++;
+            } while (next_element(parser));
+            if (!expect(parser, ']')) {
+                return false;
+            }
+        }
+    } while (next_element(parser));
+    return expect(parser, '}');
+}
+
+task_def_t* parse_task_collection(const char* challenges, const char* solutions) {
+    parser_t parser = {challenges};
+    task_def_t* result = NULL;
+    task_def_t** p_last = &result;
+    if (!expect(&parser, '{')) {
+        return NULL;
+    }
+    if (!expect(&parser, '}')) {
+        do {
+            const char* id;
+            int len;
+            if (!parse_string(&parser, &id, &len) || !expect(&parser, ':')) {
+                goto fail;
+            }
+            task_def_t* entry = new_task_def(id, len);
+            entry->task = new_task();
+            *p_last = entry;
+            p_last = &entry->next;
+            if (!parse_task_object(&parser, entry->task)) {
+                goto fail;
+            }
+        } while (next_element(&parser));
+        if (!expect(&parser, '}')) {
+            goto fail;
+        }
+    }
+
+    if (solutions) {
+        parser = (parser_t){solutions};
+        if (!parse_solutions(&parser, result)) {
+            goto fail;
+        }
+    }
+    return result;
+
+fail:
+    if (result) {
+        free_task_defs(result);
+    }
+    return NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef __PARSER_H__
+#define __PARSER_H__
+
+#include <stdbool.h>
+
+#include "io.h"
+#include "task.h"
+
+/**
+ * Streaming parser for the ARC task schema
+ *   {"train": [{"input": [[...]], "output": [[...]]}, ...], "test": [...]}
+ * Cell values are written straight into the rasters of the task, without
+ * building a document tree.  Returns false on input it does not understand
+ * (the task may then hold part of the examples).
+ */
+bool parse_task_json(const char* source, task_t* task);
+
+/**
+ * Parse the combined single-file formats: a challenges file mapping task ids
+ * to tasks (test examples without output) and an optional solutions file
+ * mapping task ids to the list of test output grids.  Returns the tasks in
+ * the order of the challenges file, or NULL when it could not be parsed.
+ */
+task_def_t* parse_task_collection(const char* challenges, const char* solutions);
+
+#endif  // __PARSER_H__
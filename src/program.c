@@ -0,0 +1,619 @@
+#include "program.h"
+
+#include <string.h>
+
+// FNV-1a
+static void hash_key(program_key_t* key) {
+    key->hash = 14695981039346656037ul;
+    for (int i = 0; i < key->size; i++) {
+        key->hash = (key->hash ^ (unsigned char)key->bytes[i]) * 1099511628211ul;
+    }
+}
+
+static inline bool _keys_equal(const program_key_t* key, const program_key_t* other) {
+    return key->hash == other->hash && key->size == other->size &&
+           !memcmp(key->bytes, other->bytes, key->size);
+}
+
+bool apply_step(const program_step_t* step, graph_t* graph) {
+    const transform_call_t* call = step->transform;
+
+    // select the nodes before transforming any, transformations may add nodes
+    const node_table_t* table = get_node_table(graph);
+    unsigned long matches[NODE_MASK_WORDS(table->n_nodes)];
+    int n_selected = apply_filter_batch(table, step->filter, matches);
+    node_t* selected[n_selected + 1];
+    n_selected = 0;
+    for (int idx = 0; idx < table->n_nodes; idx++) {
+        if (is_node_matched(matches, idx)) {
+            selected[n_selected++] = (node_t*)table->nodes[idx];
+        }
+    }
+
+    // bind against the untransformed graph, reusing bindings resolved while sampling
+    transform_arguments_t transform_args[n_selected + 1];
+    bool bound[n_selected + 1];
+    for (int i = 0; i < n_selected; i++) {
+        transform_args[i] = call->arguments;
+        bound[i] = apply_binding(graph, selected[i], &call->dynamic, &transform_args[i]);
+    }
+
+    bool transformed = false;
+    for (int i = 0; i < n_selected; i++) {
+        if (bound[i] && call->transform->func(graph, selected[i], &transform_args[i])) {
+            transformed = true;
+        }
+    }
+    // subnodes are changed in place
+    invalidate_node_table(graph);
+    return transformed;
+}
+
+bool transform_graph(const program_t* program, graph_t* graph) {
+    bool transformed = false;
+    for (int i_step = 0; i_step < program->n_steps; i_step++) {
+        transformed |= apply_step(&program->steps[i_step], graph);
+    }
+    return transformed;
+}
+
+void init_program(guide_builder_t* builder) {
+    add_repeat(builder, "filter", MAX_PROGRAM_STEPS - 1, "program:next_step");
+}
+
+bool sample_steps(task_t* task, const graph_t* graph, program_t* program, trail_t** p_trail) {
+    graph_t* current = (graph_t*)graph;
+    bool complete = false;
+    program->n_steps = 0;
+    while (program->n_steps < MAX_PROGRAM_STEPS) {
+        program_step_t* step = &program->steps[program->n_steps++];
+        step->filter = sample_filter(task, current, p_trail);
+        step->transform = NULL;
+        if (step->filter) {
+            step->transform = sample_transform(task, current, step->filter, p_trail);
+        }
+        if (!step->transform) {
+            break;
+        }
+
+        long valid_flags = program->n_steps < MAX_PROGRAM_STEPS ? 0x3 : 0x1;
+        const categorical_t* dist = next_choice(*p_trail);
+        int next_step = choose_from(dist, valid_flags);
+        *p_trail = observe_choice(*p_trail, next_step);
+        if (next_step != 1) {
+            complete = true;
+            break;
+        }
+        if (current == graph) {
+            current = copy_graph(graph);
+        }
+        apply_step(step, current);
+    }
+    if (current != graph) {
+        free_graph(current);
+    }
+    return complete;
+}
+
+trail_t* observe_steps(trail_t* trail, const program_t* program) {
+    for (int i_step = 0; i_step < program->n_steps; i_step++) {
+        trail = observe_filter(trail, program->steps[i_step].filter);
+        trail = observe_transform(trail, program->steps[i_step].transform);
+        next_choice(trail);
+        trail = observe_choice(trail, i_step + 1 < program->n_steps);
+    }
+    return trail;
+}
+
+bool run_program(const program_t* program, const grid_t* input, raster_t* output) {
+    graph_t* graph = program->abstraction->func(input);
+    if (unlikely(!graph)) {
+        return false;
+    }
+    transform_graph(program, graph);
+    bool rendered = render_abstraction(graph, output);
+    free_graph(graph);
+    return rendered;
+}
+
+int program_mismatches(const program_t* program, const grid_t* input, const raster_t* expected) {
+    color_t pixels[input->width * input->height];
+    raster_t raster = {input->width, input->height, pixels};
+    if (!run_program(program, input, &raster)) {
+        return expected->width * expected->height;
+    }
+    return count_mismatches(&raster, expected);
+}
+
+prefix_cache_t* new_prefix_cache() {
+    prefix_cache_t* cache = malloc(sizeof(prefix_cache_t));
+    cache->n_hits = 0;
+    cache->n_misses = 0;
+    for (int idx = 0; idx < PREFIX_CACHE_SIZE; idx++) {
+        cache->entries[idx].graph = NULL;
+    }
+    return cache;
+}
+
+void free_prefix_cache(prefix_cache_t* cache) {
+    for (int idx = 0; idx < PREFIX_CACHE_SIZE; idx++) {
+        if (cache->entries[idx].graph) {
+            free_graph(cache->entries[idx].graph);
+        }
+    }
+    free(cache);
+}
+
+static inline prefix_entry_t* _prefix_slot(
+    prefix_cache_t* cache, const program_key_t* key, int example) {
+    return &cache->entries[(key->hash + example * 0x9e3779b97f4a7c15ul) % PREFIX_CACHE_SIZE];
+}
+
+static inline bool _is_prefix(const prefix_entry_t* entry, const program_key_t* key, int example) {
+    return entry->graph && entry->example == example && _keys_equal(&entry->key, key);
+}
+
+static void _store_prefix(
+    prefix_cache_t* cache, const program_key_t* key, int example, graph_t* graph) {
+    prefix_entry_t* entry = _prefix_slot(cache, key, example);
+    if (entry->graph) {
+        free_graph(entry->graph);
+    }
+    entry->key = *key;
+    entry->example = example;
+    entry->graph = graph;
+}
+
+/**
+ * Graph of the example after the abstraction and the first n_steps of the
+ * program, owned by the cache.  It continues from the longest prefix in the
+ * cache, and caches the prefixes that it runs itself.  Returns NULL when the
+ * prefix does not fit in a key or the abstraction fails.
+ */
+static const graph_t* cached_prefix(
+    const task_t* task,
+    const program_t* program,
+    int n_steps,
+    int example,
+    prefix_cache_t* cache) {
+    program_key_t keys[n_steps + 1];
+    for (int i_step = 0; i_step <= n_steps; i_step++) {
+        if (!encode_prefix(program, i_step, &keys[i_step])) {
+            return NULL;
+        }
+    }
+
+    graph_t* graph = NULL;
+    int n_done = n_steps;
+    for (; n_done >= 0; n_done--) {
+        const prefix_entry_t* entry = _prefix_slot(cache, &keys[n_done], example);
+        if (_is_prefix(entry, &keys[n_done], example)) {
+            cache->n_hits++;
+            if (n_done == n_steps) {
+                return entry->graph;
+            }
+            graph = copy_graph(entry->graph);
+            break;
+        }
+    }
+    if (!graph) {
+        cache->n_misses++;
+        graph = program->abstraction->func(&task->train_input[example]);
+        if (unlikely(!graph)) {
+            return NULL;
+        }
+    }
+
+    // n_done is -1 when even the abstraction was not cached
+    for (int i_step = n_done < 0 ? 0 : n_done;; i_step++) {
+        if (i_step == n_steps) {
+            _store_prefix(cache, &keys[i_step], example, graph);
+            return graph;
+        }
+        if (i_step > n_done) {
+            _store_prefix(cache, &keys[i_step], example, copy_graph(graph));
+        }
+        apply_step(&program->steps[i_step], graph);
+    }
+}
+
+// graph of the example after all steps of the program, NULL when the abstraction fails
+static graph_t* run_cached_steps(
+    const task_t* task, const program_t* program, int example, prefix_cache_t* cache) {
+    const graph_t* prefix = cached_prefix(task, program, program->n_steps - 1, example, cache);
+    graph_t* graph = prefix ? copy_graph(prefix)
+                            : program->abstraction->func(&task->train_input[example]);
+    if (unlikely(!graph)) {
+        return NULL;
+    }
+    if (prefix) {
+        apply_step(&program->steps[program->n_steps - 1], graph);
+    } else {
+        transform_graph(program, graph);
+    }
+    return graph;
+}
+
+static int cached_mismatches(
+    const task_t* task, const program_t* program, int example, prefix_cache_t* cache) {
+    const raster_t* expected = task->train_output_raster[example];
+    graph_t* graph = run_cached_steps(task, program, example, cache);
+    if (unlikely(!graph)) {
+        return expected->width * expected->height;
+    }
+    color_t pixels[graph->width * graph->height];
+    raster_t raster = {graph->width, graph->height, pixels};
+    bool rendered = render_abstraction(graph, &raster);
+    free_graph(graph);
+    if (!rendered) {
+        return expected->width * expected->height;
+    }
+    return count_mismatches(&raster, expected);
+}
+
+bool evaluate_program(
+    const task_t* task,
+    const program_t* program,
+    int first_example,
+    prefix_cache_t* cache,
+    program_evaluation_t* evaluation) {
+    evaluation->correct = true;
+    evaluation->n_evaluated = 0;
+    for (int i_train = 0; i_train < task->n_train; i_train++) {
+        evaluation->mismatches[i_train] = NOT_EVALUATED;
+    }
+    for (int i = 0; i < task->n_train; i++) {
+        int i_train = (first_example + i) % task->n_train;
+        int n_mismatches =
+            cache ? cached_mismatches(task, program, i_train, cache)
+                  : program_mismatches(
+                        program, &task->train_input[i_train], task->train_output_raster[i_train]);
+        evaluation->mismatches[i_train] = n_mismatches;
+        evaluation->n_evaluated++;
+        if (n_mismatches > 0) {
+            evaluation->correct = false;
+            break;
+        }
+    }
+    return evaluation->correct;
+}
+
+void free_program(task_t* task, program_t* program) {
+    for (int i_step = 0; i_step < program->n_steps; i_step++) {
+        program_step_t* step = &program->steps[i_step];
+        if (step->transform) {
+            free_transform(task, step->transform);
+            step->transform = NULL;
+        }
+        if (step->filter) {
+            free_item(task->_mem_filter_calls, step->filter);
+            step->filter = NULL;
+        }
+    }
+    program->n_steps = 0;
+}
+
+static inline bool _put_key(program_key_t* key, int value) {
+    if (unlikely(key->size == PROGRAM_KEY_SIZE)) {
+        return false;
+    }
+    key->bytes[key->size++] = value;
+    return true;
+}
+
+static bool encode_binding(const binding_call_t* call, program_key_t* key) {
+    const binding_func_t* func = call->binding;
+    bool fits = _put_key(key, func - binding_funcs);
+    fits &= !func->size || _put_key(key, call->args.size);
+    fits &= !func->degree || _put_key(key, call->args.degree);
+    fits &= !func->exclude || _put_key(key, call->args.exclude);
+    fits &= !func->color || _put_key(key, call->args.color);
+    return fits;
+}
+
+// a static value, or -1 followed by the binding that provides it
+static bool encode_argument(const binding_call_t* binding, int value, program_key_t* key) {
+    if (binding) {
+        return _put_key(key, -1) && encode_binding(binding, key);
+    }
+    return _put_key(key, value);
+}
+
+static bool encode_step(const program_step_t* step, program_key_t* key) {
+    bool fits = true;
+    for (const filter_call_t* call = step->filter; call; call = call->next_in_multi) {
+        const filter_func_t* func = call->filter;
+        fits &= _put_key(key, func - filter_funcs);
+        fits &= !func->size || _put_key(key, call->args.size);
+        fits &= !func->degree || _put_key(key, call->args.degree);
+        fits &= !func->exclude || _put_key(key, call->args.exclude);
+        fits &= !func->color || _put_key(key, call->args.color);
+    }
+    fits &= _put_key(key, -1);
+
+    const transform_call_t* call = step->transform;
+    const transform_func_t* func = call->transform;
+    fits &= _put_key(key, func - transformations);
+    if (func->color) {
+        fits &= encode_argument(call->dynamic.color, call->arguments.color, key);
+    }
+    if (func->direction) {
+        fits &= encode_argument(call->dynamic.direction, call->arguments.direction, key);
+    }
+    fits &= !func->rotation_dir || _put_key(key, call->arguments.rotation_dir);
+    fits &= !func->overlap || _put_key(key, call->arguments.overlap);
+    return fits;
+}
+
+bool encode_prefix(const program_t* program, int n_steps, program_key_t* key) {
+    key->size = 0;
+    bool fits = _put_key(key, program->abstraction - abstractions);
+    // the transformation determines its number of arguments, which delimits the steps
+    for (int i_step = 0; i_step < n_steps && fits; i_step++) {
+        fits &= encode_step(&program->steps[i_step], key);
+    }
+    if (!fits) {
+        return false;
+    }
+    hash_key(key);
+    return true;
+}
+
+bool encode_program(const program_t* program, program_key_t* key) {
+    return encode_prefix(program, program->n_steps, key);
+}
+
+program_set_t* new_program_set() {
+    program_set_t* set = malloc(sizeof(program_set_t));
+    set->n_entries = 0;
+    set->capacity = 256;
+    set->entries = calloc(set->capacity, sizeof(program_entry_t));
+    return set;
+}
+
+void free_program_set(program_set_t* set) {
+    free(set->entries);
+    free(set);
+}
+
+// the slot of the key, or the empty slot where it would go
+static program_entry_t* _program_slot(
+    program_entry_t* entries, int capacity, const program_key_t* key) {
+    unsigned int idx = key->hash & (capacity - 1);
+    for (;;) {
+        program_entry_t* entry = &entries[idx];
+        if (entry->key.size == 0 || _keys_equal(&entry->key, key)) {
+            return entry;
+        }
+        idx = (idx + 1) & (capacity - 1);
+    }
+}
+
+const program_entry_t* find_program(const program_set_t* set, const program_key_t* key) {
+    const program_entry_t* entry = _program_slot(set->entries, set->capacity, key);
+    return entry->key.size ? entry : NULL;
+}
+
+void add_program(program_set_t* set, const program_key_t* key, bool correct) {
+    // keep the load below a half
+    if (2 * (set->n_entries + 1) > set->capacity) {
+        int capacity = 2 * set->capacity;
+        program_entry_t* entries = calloc(capacity, sizeof(program_entry_t));
+        for (int idx = 0; idx < set->capacity; idx++) {
+            if (set->entries[idx].key.size) {
+                *_program_slot(entries, capacity, &set->entries[idx].key) = set->entries[idx];
+            }
+        }
+        free(set->entries);
+        set->entries = entries;
+        set->capacity = capacity;
+    }
+    program_entry_t* entry = _program_slot(set->entries, set->capacity, key);
+    if (!entry->key.size) {
+        entry->key = *key;
+        set->n_entries++;
+    }
+    entry->correct = correct;
+}
+
+static output_entry_t* _output_slot(output_entry_t* entries, int capacity, unsigned long hash) {
+    unsigned int idx = hash & (capacity - 1);
+    while (entries[idx].hash && entries[idx].hash != hash) {
+        idx = (idx + 1) & (capacity - 1);
+    }
+    return &entries[idx];
+}
+
+bool record_output(
+    output_table_t* table, unsigned long hash, int cost, const program_key_t* program) {
+    // 0 marks empty slots
+    hash |= 1;
+    if (2 * (table->n_entries + 1) > table->capacity) {
+        int capacity = table->capacity ? 2 * table->capacity : 64;
+        output_entry_t* entries = calloc(capacity, sizeof(output_entry_t));
+        for (int idx = 0; idx < table->capacity; idx++) {
+            if (table->entries[idx].hash) {
+                *_output_slot(entries, capacity, table->entries[idx].hash) = table->entries[idx];
+            }
+        }
+        free(table->entries);
+        table->entries = entries;
+        table->capacity = capacity;
+    }
+    output_entry_t* entry = _output_slot(table->entries, table->capacity, hash);
+    if (entry->hash) {
+        if (entry->cost <= cost) {
+            return false;
+        }
+    } else {
+        entry->hash = hash;
+        table->n_entries++;
+    }
+    entry->cost = cost;
+    entry->program = *program;
+    return true;
+}
+
+const output_entry_t* find_output(const output_table_t* table, unsigned long hash) {
+    if (!table->capacity) {
+        return NULL;
+    }
+    const output_entry_t* entry = _output_slot(table->entries, table->capacity, hash | 1);
+    return entry->hash ? entry : NULL;
+}
+
+transposition_table_t* new_transposition_table() {
+    transposition_table_t* table = malloc(sizeof(transposition_table_t));
+    table->n_entries = 0;
+    table->lru_head = table->lru_tail = -1;
+    for (int idx = 0; idx < TRANSPOSITION_BUCKETS; idx++) {
+        table->buckets[idx] = -1;
+    }
+    return table;
+}
+
+void free_transposition_table(transposition_table_t* table) { free(table); }
+
+static void _unlink_lru(transposition_table_t* table, int idx) {
+    transposition_t* entry = &table->entries[idx];
+    if (entry->lru_prev >= 0) {
+        table->entries[entry->lru_prev].lru_next = entry->lru_next;
+    } else {
+        table->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next >= 0) {
+        table->entries[entry->lru_next].lru_prev = entry->lru_prev;
+    } else {
+        table->lru_tail = entry->lru_prev;
+    }
+}
+
+static void _push_lru(transposition_table_t* table, int idx) {
+    transposition_t* entry = &table->entries[idx];
+    entry->lru_prev = -1;
+    entry->lru_next = table->lru_head;
+    if (table->lru_head >= 0) {
+        table->entries[table->lru_head].lru_prev = idx;
+    } else {
+        table->lru_tail = idx;
+    }
+    table->lru_head = idx;
+}
+
+transposition_t* find_transposition(transposition_table_t* table, unsigned long state) {
+    int idx = table->buckets[state & (TRANSPOSITION_BUCKETS - 1)];
+    while (idx >= 0 && table->entries[idx].state != state) {
+        idx = table->entries[idx].next;
+    }
+    if (idx < 0) {
+        return NULL;
+    }
+    if (idx != table->lru_head) {
+        _unlink_lru(table, idx);
+        _push_lru(table, idx);
+    }
+    return &table->entries[idx];
+}
+
+transposition_t* add_transposition(transposition_table_t* table, unsigned long state) {
+    int idx;
+    if (table->n_entries < TRANSPOSITION_TABLE_SIZE) {
+        idx = table->n_entries++;
+    } else {
+        // evict the least recently used state
+        idx = table->lru_tail;
+        _unlink_lru(table, idx);
+        int* p_idx = &table->buckets[table->entries[idx].state & (TRANSPOSITION_BUCKETS - 1)];
+        while (*p_idx != idx) {
+            p_idx = &table->entries[*p_idx].next;
+        }
+        *p_idx = table->entries[idx].next;
+    }
+    transposition_t* entry = &table->entries[idx];
+    entry->state = state;
+    entry->n_steps = 0;
+    entry->prefix.size = 0;
+    int* bucket = &table->buckets[state & (TRANSPOSITION_BUCKETS - 1)];
+    entry->next = *bucket;
+    *bucket = idx;
+    _push_lru(table, idx);
+    return entry;
+}
+
+// the graphs of the evaluated train inputs after the first n_steps of the program
+static bool prefix_state(
+    const task_t* task,
+    const program_t* program,
+    const program_evaluation_t* evaluation,
+    int n_steps,
+    prefix_cache_t* cache,
+    unsigned long* state) {
+    *state = 0;
+    for (int i_train = 0; i_train < task->n_train; i_train++) {
+        if (evaluation->mismatches[i_train] == NOT_EVALUATED) {
+            continue;
+        }
+        const graph_t* graph = cached_prefix(task, program, n_steps, i_train, cache);
+        if (!graph) {
+            return false;
+        }
+        *state = (*state + i_train + 1) * 1099511628211ul + hash_graph(graph);
+    }
+    return true;
+}
+
+static inline bool _append_key(program_key_t* key, const program_key_t* from, int start, int end) {
+    if (key->size + end - start > PROGRAM_KEY_SIZE) {
+        return false;
+    }
+    memcpy(key->bytes + key->size, from->bytes + start, end - start);
+    key->size += end - start;
+    return true;
+}
+
+int transpose_program(
+    const task_t* task,
+    const program_t* program,
+    const program_evaluation_t* evaluation,
+    prefix_cache_t* cache,
+    transposition_table_t* table,
+    program_key_t* key) {
+    // the prefix so far with transpositions applied
+    program_key_t canonical = {.size = 0};
+    int n_canonical = -1;
+    int n_transposed = -1;
+    int offset = 0;
+    for (int n_steps = 0; n_steps < program->n_steps; n_steps++) {
+        program_key_t prefix;
+        unsigned long state;
+        if (!encode_prefix(program, n_steps, &prefix) ||
+            !_append_key(&canonical, &prefix, offset, prefix.size) ||
+            !prefix_state(task, program, evaluation, n_steps, cache, &state)) {
+            return -1;
+        }
+        offset = prefix.size;
+        n_canonical++;
+        hash_key(&canonical);
+
+        transposition_t* entry = find_transposition(table, state);
+        if (!entry) {
+            entry = add_transposition(table, state);
+        } else if (entry->n_steps <= n_canonical) {
+            if (!_keys_equal(&entry->prefix, &canonical)) {
+                canonical = entry->prefix;
+                n_canonical = entry->n_steps;
+                n_transposed = n_steps;
+            }
+            continue;
+        }
+        // the prefix is the best known for the state
+        entry->prefix = canonical;
+        entry->n_steps = n_canonical;
+    }
+    if (!_append_key(&canonical, key, offset, key->size)) {
+        return -1;
+    }
+    hash_key(&canonical);
+    *key = canonical;
+    return n_transposed;
+}
@@ -0,0 +1,227 @@
+#ifndef __PROGRAM_H__
+#define __PROGRAM_H__
+
+#include "filter.h"
+#include "graph.h"
+#include "image.h"
+#include "raster.h"
+#include "task.h"
+#include "transform.h"
+
+#define MAX_PROGRAM_STEPS 3
+
+// a filter that selects the nodes to operate on and the transformation that is applied to each
+typedef struct _program_step {
+    filter_call_t* filter;
+    transform_call_t* transform;
+} program_step_t;
+
+/**
+ * A program is the combination of an abstraction and a sequence of steps,
+ * each of which operates on the graph that the previous ones produced.
+ */
+typedef struct _program {
+    abstraction_t* abstraction;
+    int n_steps;
+    program_step_t steps[MAX_PROGRAM_STEPS];
+} program_t;
+
+// apply a single step to a graph, returns true when any node changed
+bool apply_step(const program_step_t* step, graph_t* graph);
+
+// apply the steps to an abstracted graph, returns true when any node changed
+bool transform_graph(const program_t* program, graph_t* graph);
+
+void init_program(guide_builder_t* builder);
+
+/**
+ * Sample the steps of a program on its abstracted graph, which is not
+ * changed: the steps after the first are sampled on a copy, transformed by
+ * the steps before them.  Returns false when a step could not be completed,
+ * what was sampled is kept in the program to be freed with it.
+ */
+bool sample_steps(task_t* task, const graph_t* graph, program_t* program, trail_t** p_trail);
+
+trail_t* observe_steps(trail_t* trail, const program_t* program);
+
+/**
+ * Run the full program on an input and render the result into the output
+ * raster, which must have the dimensions of the input.  Returns false when
+ * no output could be produced.
+ */
+bool run_program(const program_t* program, const grid_t* input, raster_t* output);
+
+/**
+ * Number of pixels in which the output of the program on the input differs
+ * from the expected raster (see count_mismatches).  A program that fails to
+ * produce an output mismatches every pixel.
+ */
+int program_mismatches(const program_t* program, const grid_t* input, const raster_t* expected);
+
+#define PROGRAM_KEY_SIZE 64
+
+/**
+ * Canonical encoding of a program: the functions with only the arguments that
+ * they use, so programs that differ in unused arguments (or in how they were
+ * sampled) get the same key.
+ */
+typedef struct _program_key {
+    int size;
+    unsigned long hash;
+    signed char bytes[PROGRAM_KEY_SIZE];
+} program_key_t;
+
+// returns false when the program does not fit in a key
+bool encode_program(const program_t* program, program_key_t* key);
+
+// key of the abstraction and the first n_steps of the program
+bool encode_prefix(const program_t* program, int n_steps, program_key_t* key);
+
+#define NOT_EVALUATED -1
+
+/**
+ * Outcome of running a program over the train pairs of a task.  Examples are
+ * run in order, starting with the first_example, and evaluation stops at the
+ * first example that is not reproduced.
+ */
+typedef struct _program_evaluation {
+    bool correct;
+    int n_evaluated;
+    // mismatching pixels per train example, NOT_EVALUATED after an early exit
+    int mismatches[MAX_TRAIN_EXAMPLES];
+} program_evaluation_t;
+
+#define PREFIX_CACHE_SIZE 32
+
+typedef struct _prefix_entry {
+    program_key_t key;
+    int example;
+    graph_t* graph;
+} prefix_entry_t;
+
+/**
+ * Graphs of the train inputs after the abstraction and the first steps of a
+ * program.  Programs that share such a prefix continue from a copy of the
+ * graph instead of running it again.  The cache is direct-mapped, a prefix
+ * replaces the one it collides with.
+ */
+typedef struct _prefix_cache {
+    long n_hits;
+    long n_misses;
+    prefix_entry_t entries[PREFIX_CACHE_SIZE];
+} prefix_cache_t;
+
+prefix_cache_t* new_prefix_cache();
+void free_prefix_cache(prefix_cache_t* cache);
+
+// the cache is optional, without one every example is run from its abstraction
+bool evaluate_program(
+    const task_t* task,
+    const program_t* program,
+    int first_example,
+    prefix_cache_t* cache,
+    program_evaluation_t* evaluation);
+
+void free_program(task_t* task, program_t* program);
+
+typedef struct _program_entry {
+    program_key_t key;
+    bool correct;
+} program_entry_t;
+
+/**
+ * Open-addressed set of the programs that were evaluated on a task, with
+ * their outcome.
+ */
+typedef struct _program_set {
+    int n_entries;
+    int capacity;
+    program_entry_t* entries;
+} program_set_t;
+
+program_set_t* new_program_set();
+void free_program_set(program_set_t* set);
+
+// the entry of an evaluated program, NULL when it is not in the set
+const program_entry_t* find_program(const program_set_t* set, const program_key_t* key);
+
+void add_program(program_set_t* set, const program_key_t* key, bool correct);
+
+// an output in the output_table_t of an example
+typedef struct _output_entry {
+    // hash_raster of the output, 0 for an empty slot
+    unsigned long hash;
+    int cost;
+    // the cheapest program that produced the output, of size 0 when it did not fit a key
+    program_key_t program;
+} output_entry_t;
+
+/**
+ * Record that a program of the cost produced an output with the hash.
+ * Returns false when the output was produced before by a program that was at
+ * least as cheap.
+ */
+bool record_output(
+    output_table_t* table, unsigned long hash, int cost, const program_key_t* program);
+
+// the entry of an output, NULL when no program produced it
+const output_entry_t* find_output(const output_table_t* table, unsigned long hash);
+
+#define TRANSPOSITION_TABLE_SIZE 4096
+#define TRANSPOSITION_BUCKETS (2 * TRANSPOSITION_TABLE_SIZE)
+
+typedef struct _transposition {
+    unsigned long state;
+    // the best known prefix that reaches the state (the one with the fewest steps)
+    program_key_t prefix;
+    int n_steps;
+    // next in the bucket and the order of use, as indices of entries (-1 at the end)
+    int next;
+    int lru_prev;
+    int lru_next;
+} transposition_t;
+
+/**
+ * States that prefixes of programs reach, i.e. the graphs of the evaluated
+ * train inputs (see hash_graph), with the best known prefix for each.  Memory is bounded,
+ * when the table is full the least recently used state is evicted.
+ */
+typedef struct _transposition_table {
+    int n_entries;
+    int lru_head;
+    int lru_tail;
+    int buckets[TRANSPOSITION_BUCKETS];
+    transposition_t entries[TRANSPOSITION_TABLE_SIZE];
+} transposition_table_t;
+
+transposition_table_t* new_transposition_table();
+void free_transposition_table(transposition_table_t* table);
+
+// the entry of a state, which becomes the most recently used, NULL when it is not known
+transposition_t* find_transposition(transposition_table_t* table, unsigned long state);
+
+// add a state that is not in the table, with an empty prefix
+transposition_t* add_transposition(transposition_table_t* table, unsigned long state);
+
+/**
+ * Rewrite the key of the program (see encode_program) into that of a program
+ * that is equivalent on the examples of the evaluation, replacing its
+ * prefixes by the best known ones that reach the same states.  Those
+ * examples decided the outcome, so it carries over.  Other programs that
+ * continue from a replaced prefix only behave the same when all train
+ * examples were evaluated.  Steps that commute, or that undo each other, then
+ * give the same key.  Only prefixes of the evaluated examples are run, they
+ * are usually still in the cache.  The
+ * states of the prefixes are added to the table.  Returns the number of
+ * steps of the longest prefix that was replaced, -1 when there was none (or
+ * the key could not be rewritten).
+ */
+int transpose_program(
+    const task_t* task,
+    const program_t* program,
+    const program_evaluation_t* evaluation,
+    prefix_cache_t* cache,
+    transposition_table_t* table,
+    program_key_t* key);
+
+#endif  // __PROGRAM_H__
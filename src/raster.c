@@ -0,0 +1,88 @@
+#include "raster.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// compare 16 pixels at a time, the remainder is handled pixel by pixel
+
+int diff_rasters(const raster_t* raster, const raster_t* expected, unsigned char* diff) {
+    int size = raster->width * raster->height;
+    if (raster->width != expected->width || raster->height != expected->height) {
+        int expected_size = expected->width * expected->height;
+        return size > expected_size ? size : expected_size;
+    }
+    const color_t* a = raster->pixels;
+    const color_t* b = expected->pixels;
+    int n_mismatches = 0;
+    int idx = 0;
+#ifdef __SSE2__
+    const __m128i ones = _mm_set1_epi8(1);
+    for (; idx + 16 <= size; idx += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)&a[idx]);
+        __m128i vb = _mm_loadu_si128((const __m128i*)&b[idx]);
+        __m128i eq = _mm_cmpeq_epi8(va, vb);
+        unsigned int mask = ~_mm_movemask_epi8(eq) & 0xffff;
+        n_mismatches += __builtin_popcount(mask);
+        if (diff) {
+            _mm_storeu_si128((__m128i*)&diff[idx], _mm_andnot_si128(eq, ones));
+        }
+    }
+#endif
+    for (; idx < size; idx++) {
+        unsigned char mismatch = a[idx] != b[idx];
+        n_mismatches += mismatch;
+        if (diff) {
+            diff[idx] = mismatch;
+        }
+    }
+    return n_mismatches;
+}
+
+bool rasters_equal(const raster_t* raster, const raster_t* expected) {
+    if (raster->width != expected->width || raster->height != expected->height) {
+        return false;
+    }
+    int size = raster->width * raster->height;
+    const color_t* a = raster->pixels;
+    const color_t* b = expected->pixels;
+    int idx = 0;
+#ifdef __SSE2__
+    for (; idx + 16 <= size; idx += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)&a[idx]);
+        __m128i vb = _mm_loadu_si128((const __m128i*)&b[idx]);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff) {
+            return false;
+        }
+    }
+#endif
+    for (; idx < size; idx++) {
+        if (a[idx] != b[idx]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+unsigned long hash_raster(const raster_t* raster) {
+    unsigned long hash = _zobrist_key(-1, 0) * (raster->width << 16 | raster->height);
+    int size = raster->width * raster->height;
+    for (int idx = 0; idx < size; idx++) {
+        hash ^= _zobrist_key(idx, raster->pixels[idx]);
+    }
+    return hash;
+}
+
+unsigned long rehash_raster(const raster_t* raster, const raster_t* base, unsigned long base_hash) {
+    if (raster->width != base->width || raster->height != base->height) {
+        return hash_raster(raster);
+    }
+    unsigned long hash = base_hash;
+    int size = raster->width * raster->height;
+    for (int idx = 0; idx < size; idx++) {
+        if (raster->pixels[idx] != base->pixels[idx]) {
+            hash = update_raster_hash(hash, idx, base->pixels[idx], raster->pixels[idx]);
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,76 @@
+#ifndef __RASTER_H__
+#define __RASTER_H__
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "graph.h"
+
+/**
+ * A flat, row-major grid of colors - the cheapest representation of an image
+ * for comparing (reconstructed) outputs.
+ */
+typedef struct _raster {
+    unsigned short width;
+    unsigned short height;
+    color_t* pixels;
+} raster_t;
+
+static inline raster_t* new_raster(unsigned short width, unsigned short height) {
+    raster_t* raster = malloc(sizeof(raster_t) + width * height * sizeof(color_t));
+    raster->width = width;
+    raster->height = height;
+    raster->pixels = (color_t*)((void*)raster + sizeof(raster_t));
+    return raster;
+}
+
+static inline void free_raster(raster_t* raster) { free(raster); }
+
+static inline color_t get_pixel(const raster_t* raster, int x, int y) {
+    return raster->pixels[y * raster->width + x];
+}
+
+/**
+ * Compare the rasters pixel by pixel and return the number of mismatching
+ * pixels.  When the dimensions differ, every pixel of the largest raster is
+ * counted as a mismatch.  When diff is not NULL and the dimensions match, it
+ * receives a mask with 1 for each mismatching pixel and 0 otherwise.
+ */
+int diff_rasters(const raster_t* raster, const raster_t* expected, unsigned char* diff);
+
+// like diff_rasters, but stops at the first mismatch
+bool rasters_equal(const raster_t* raster, const raster_t* expected);
+
+// random key of a color at a position, see hash_raster
+static inline unsigned long _zobrist_key(int idx, color_t color) {
+    // splitmix64 finalizer, instead of a table of keys
+    unsigned long z = (unsigned long)(idx * 16 + (unsigned char)color + 1) * 0x9e3779b97f4a7c15ul;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ul;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebul;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Zobrist hash: the xor of a key per (position, color), together with the
+ * dimensions.  Equal rasters hash the same, and a changed pixel can be folded
+ * in without going over the raster again (update_raster_hash).
+ */
+unsigned long hash_raster(const raster_t* raster);
+
+static inline unsigned long update_raster_hash(
+    unsigned long hash, int idx, color_t from, color_t to) {
+    return hash ^ _zobrist_key(idx, from) ^ _zobrist_key(idx, to);
+}
+
+/**
+ * hash_raster of the raster, from the hash of a base raster.  When the
+ * dimensions are the same, every pixel is still compared with the base, but
+ * only the ones that differ are mixed into the hash.
+ */
+unsigned long rehash_raster(const raster_t* raster, const raster_t* base, unsigned long base_hash);
+
+static inline int count_mismatches(const raster_t* raster, const raster_t* expected) {
+    return diff_rasters(raster, expected, NULL);
+}
+
+#endif  // __RASTER_H__
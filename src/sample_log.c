@@ -0,0 +1,260 @@
+#include "sample_log.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define SAMPLE_LOG_BUFFER_SIZE (1 << 16)
+
+// task id, example, correct, n_choices, loss, micros
+#define SAMPLE_RECORD_HEADER_SIZE (SAMPLE_TASK_ID_SIZE + 3 + sizeof(float) + sizeof(unsigned int))
+
+/**
+ * Double buffering: log_sample fills the active buffer, when it is full it is
+ * handed to the writer thread and the spare buffer becomes active.
+ */
+struct _sample_log {
+    FILE* file;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    char* buffer;
+    size_t used;
+
+    // buffer handed to the writer, NULL when the writer is idle
+    char* pending;
+    size_t n_pending;
+    char* spare;
+
+    bool closing;
+};
+
+static void* run_writer(void* arg) {
+    sample_log_t* log = arg;
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        while (!log->pending && !log->closing) {
+            pthread_cond_wait(&log->cond, &log->lock);
+        }
+        if (!log->pending) {
+            break;
+        }
+        char* data = log->pending;
+        size_t n_data = log->n_pending;
+        pthread_mutex_unlock(&log->lock);
+
+        fwrite(data, 1, n_data, log->file);
+        fflush(log->file);
+
+        pthread_mutex_lock(&log->lock);
+        log->spare = data;
+        log->pending = NULL;
+        pthread_cond_broadcast(&log->cond);
+    }
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+// must be called with the lock held
+static void hand_off(sample_log_t* log) {
+    while (log->pending) {
+        pthread_cond_wait(&log->cond, &log->lock);
+    }
+    log->pending = log->buffer;
+    log->n_pending = log->used;
+    log->buffer = log->spare;
+    log->spare = NULL;
+    log->used = 0;
+    pthread_cond_broadcast(&log->cond);
+}
+
+sample_log_t* open_sample_log(const char* filename, const guide_item_t* items) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        return NULL;
+    }
+
+    fwrite(SAMPLE_LOG_MAGIC, 1, sizeof(SAMPLE_LOG_MAGIC), file);
+    unsigned short n_items = 0;
+    for (const guide_item_t* item = items; item; item = item->next) {
+        n_items++;
+    }
+    fwrite(&n_items, sizeof(n_items), 1, file);
+    for (const guide_item_t* item = items; item; item = item->next) {
+        unsigned char len = strlen(item->name);
+        fwrite(&len, 1, 1, file);
+        fwrite(item->name, 1, len, file);
+    }
+
+    sample_log_t* log = malloc(sizeof(sample_log_t));
+    log->file = file;
+    log->buffer = malloc(SAMPLE_LOG_BUFFER_SIZE);
+    log->used = 0;
+    log->pending = NULL;
+    log->n_pending = 0;
+    log->spare = malloc(SAMPLE_LOG_BUFFER_SIZE);
+    log->closing = false;
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->cond, NULL);
+    pthread_create(&log->writer, NULL, run_writer, log);
+    return log;
+}
+
+void log_sample(sample_log_t* log, const sample_record_t* record) {
+    size_t size = SAMPLE_RECORD_HEADER_SIZE + record->n_choices * (1 + sizeof(unsigned short));
+    pthread_mutex_lock(&log->lock);
+    if (log->used + size > SAMPLE_LOG_BUFFER_SIZE) {
+        hand_off(log);
+    }
+    char* cursor = log->buffer + log->used;
+    memcpy(cursor, record->task, SAMPLE_TASK_ID_SIZE);
+    cursor += SAMPLE_TASK_ID_SIZE;
+    *cursor++ = record->example;
+    *cursor++ = record->correct;
+    *cursor++ = record->n_choices;
+    memcpy(cursor, &record->loss, sizeof(float));
+    cursor += sizeof(float);
+    memcpy(cursor, &record->micros, sizeof(unsigned int));
+    cursor += sizeof(unsigned int);
+    memcpy(cursor, record->choices, record->n_choices);
+    cursor += record->n_choices;
+    memcpy(cursor, record->items, record->n_choices * sizeof(unsigned short));
+    log->used += size;
+    pthread_mutex_unlock(&log->lock);
+}
+
+void close_sample_log(sample_log_t* log) {
+    pthread_mutex_lock(&log->lock);
+    if (log->used > 0) {
+        hand_off(log);
+    }
+    log->closing = true;
+    pthread_cond_broadcast(&log->cond);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->writer, NULL);
+
+    fclose(log->file);
+    pthread_cond_destroy(&log->cond);
+    pthread_mutex_destroy(&log->lock);
+    free(log->buffer);
+    free(log->spare);
+    free(log);
+}
+
+sample_log_reader_t* open_sample_log_reader(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return NULL;
+    }
+    char magic[sizeof(SAMPLE_LOG_MAGIC)];
+    unsigned short n_items;
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, SAMPLE_LOG_MAGIC, sizeof(magic)) ||
+        fread(&n_items, sizeof(n_items), 1, file) != 1) {
+        fclose(file);
+        return NULL;
+    }
+
+    sample_log_reader_t* reader = malloc(sizeof(sample_log_reader_t));
+    reader->file = file;
+    reader->n_items = n_items;
+    reader->names = malloc(n_items * sizeof(char*));
+    for (int i = 0; i < n_items; i++) {
+        unsigned char len = 0;
+        if (fread(&len, 1, 1, file) != 1) {
+            len = 0;
+        }
+        reader->names[i] = malloc(len + 1);
+        len = fread(reader->names[i], 1, len, file);
+        reader->names[i][len] = '\0';
+    }
+    return reader;
+}
+
+bool read_sample(sample_log_reader_t* reader, sample_record_t* record) {
+    char header[SAMPLE_RECORD_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header)) {
+        return false;
+    }
+    const char* cursor = header;
+    memcpy(record->task, cursor, SAMPLE_TASK_ID_SIZE);
+    cursor += SAMPLE_TASK_ID_SIZE;
+    record->example = *cursor++;
+    record->correct = *cursor++;
+    record->n_choices = *cursor++;
+    memcpy(&record->loss, cursor, sizeof(float));
+    cursor += sizeof(float);
+    memcpy(&record->micros, cursor, sizeof(unsigned int));
+    return fread(record->choices, 1, record->n_choices, reader->file) == record->n_choices &&
+           fread(record->items, sizeof(unsigned short), record->n_choices, reader->file) ==
+               record->n_choices;
+}
+
+void close_sample_log_reader(sample_log_reader_t* reader) {
+    for (int i = 0; i < reader->n_items; i++) {
+        free(reader->names[i]);
+    }
+    free(reader->names);
+    fclose(reader->file);
+    free(reader);
+}
+
+// a new step starts when the sequence of guide items starts over
+static int count_steps(const sample_record_t* record) {
+    int n_steps = record->n_choices > 0;
+    for (int i = 1; i < record->n_choices; i++) {
+        n_steps += record->items[i] <= record->items[i - 1];
+    }
+    return n_steps;
+}
+
+void sample_log_to_csv(sample_log_reader_t* reader, FILE* out) {
+    sample_record_t record;
+    long start = ftell(reader->file);
+    int max_steps = 1;
+    while (read_sample(reader, &record)) {
+        int n_steps = count_steps(&record);
+        if (n_steps > max_steps) {
+            max_steps = n_steps;
+        }
+    }
+    fseek(reader->file, start, SEEK_SET);
+
+    fprintf(out, "task,example,loss,reconstructed,micros");
+    for (int k = 0; k < max_steps; k++) {
+        for (int i = 0; i < reader->n_items; i++) {
+            fprintf(out, ",step%d:%s", k, reader->names[i]);
+        }
+    }
+    fprintf(out, "\n");
+
+    int n_cells = max_steps * reader->n_items;
+    int cells[n_cells];
+    while (read_sample(reader, &record)) {
+        fprintf(
+            out,
+            "%.*s, %d, %.12e, %d, %u",
+            SAMPLE_TASK_ID_SIZE,
+            record.task,
+            record.example,
+            record.loss,
+            record.correct,
+            record.micros);
+        for (int i = 0; i < n_cells; i++) {
+            cells[i] = -1;
+        }
+        int step = 0;
+        for (int i = 0; i < record.n_choices; i++) {
+            if (i > 0 && record.items[i] <= record.items[i - 1]) {
+                step++;
+            }
+            if (record.items[i] < reader->n_items) {
+                cells[step * reader->n_items + record.items[i]] = record.choices[i];
+            }
+        }
+        for (int i = 0; i < n_cells; i++) {
+            fprintf(out, ", %d", cells[i]);
+        }
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef __SAMPLE_LOG_H__
+#define __SAMPLE_LOG_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "guide.h"
+
+/**
+ * Compact binary log of training samples.  The file starts with a header
+ * listing the names of the guide items, followed by one record per sample
+ * holding the full choice vector and the guide item of each choice - so that
+ * the sampled program can be replayed later on.
+ *
+ * Records are buffered and written to disk by a background thread.
+ */
+
+#define SAMPLE_LOG_MAGIC "ARCLOG2"
+#define SAMPLE_TASK_ID_SIZE 16
+#define SAMPLE_MAX_CHOICES 255
+
+typedef struct _sample_record {
+    // task name, zero-padded
+    char task[SAMPLE_TASK_ID_SIZE];
+    unsigned char example;
+    bool correct;
+    float loss;
+    // time spent on sampling, executing and training
+    unsigned int micros;
+    unsigned char n_choices;
+    // choices in the order they were made, with the index of their guide item;
+    // items repeat for programs with multiple steps
+    signed char choices[SAMPLE_MAX_CHOICES];
+    unsigned short items[SAMPLE_MAX_CHOICES];
+} sample_record_t;
+
+typedef struct _sample_log sample_log_t;
+
+sample_log_t* open_sample_log(const char* filename, const guide_item_t* items);
+
+void log_sample(sample_log_t* log, const sample_record_t* record);
+
+// flushes all buffered records
+void close_sample_log(sample_log_t* log);
+
+typedef struct _sample_log_reader {
+    FILE* file;
+    int n_items;
+    char** names;
+} sample_log_reader_t;
+
+sample_log_reader_t* open_sample_log_reader(const char* filename);
+
+bool read_sample(sample_log_reader_t* reader, sample_record_t* record);
+
+void close_sample_log_reader(sample_log_reader_t* reader);
+
+/**
+ * Convert all remaining records to CSV.  The sequence of guide items starts
+ * over for every step of a program, there is a group of columns per step
+ * ("step<k>:<item>") up to the longest program.  Unused items are -1.
+ */
+void sample_log_to_csv(sample_log_reader_t* reader, FILE* out);
+
+#endif  // __SAMPLE_LOG_H__
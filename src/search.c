@@ -0,0 +1,526 @@
+#include "search.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binding.h"
+#include "filter.h"
+#include "image.h"
+#include "transform.h"
+
+#define MAX_FILTER_CALLS 1024
+#define MAX_BINDING_CALLS 256
+#define MAX_TRANSFORM_CALLS 4096
+
+// a choice of a decoded trail, with its valid alternatives in order of probability
+struct _branch {
+    // network state before the choice
+    void* state;
+    // of the choices before it
+    double log_p;
+    int n_ranked;
+    signed char ranked[MAX_CHOICES];
+    // conditional on the choices before it
+    double log_p_ranked[MAX_CHOICES];
+    // program steps that its alternatives share, -1 when they do not share the abstraction
+    int n_steps;
+    int n_prefix;
+    signed char prefix[];
+};
+
+// branches of the program being decoded, queued once it is known whether they are needed
+typedef struct _decoding {
+    int n_pending;
+    int capacity;
+    branch_t** pending;
+} decoding_t;
+
+static bool any_filter_matches(graph_t** graphs, int n_graphs, const filter_call_t* filter) {
+    for (int i = 0; i < n_graphs; i++) {
+        if (graphs[i] && filter_matches(graphs[i], filter)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool any_binding_matches(
+    graph_t** graphs, int n_graphs, const filter_call_t* filter, const binding_call_t* binding) {
+    for (int i = 0; i < n_graphs; i++) {
+        if (graphs[i] && binding_matches(graphs[i], filter, binding)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void search_task(task_t* task, const solve_options_t* options, solve_result_t* result) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    init_solve_result(task, result);
+    if (task->n_train == 0) {
+        return;
+    }
+
+    filter_call_t filters[MAX_FILTER_CALLS];
+    int n_filters = enumerate_filters(filters, MAX_FILTER_CALLS);
+    binding_call_t bindings[MAX_BINDING_CALLS];
+    int n_bindings = enumerate_bindings(bindings, MAX_BINDING_CALLS);
+    transform_call_t* transforms = malloc(MAX_TRANSFORM_CALLS * sizeof(transform_call_t));
+
+    bool exhausted = false;
+    for (int pass = 0; pass < 2 && !exhausted && !result->found; pass++) {
+        bool dynamic = pass == 1;
+        for (abstraction_t* abstraction = abstractions;
+             abstraction->func && !exhausted && !result->found;
+             abstraction++) {
+            graph_t* graphs[task->n_train];
+            for (int i_train = 0; i_train < task->n_train; i_train++) {
+                graphs[i_train] = abstraction->func(&task->train_input[i_train]);
+            }
+
+            for (int i_filter = 0; i_filter < n_filters && !exhausted && !result->found;
+                 i_filter++) {
+                filter_call_t* filter = &filters[i_filter];
+                if (!any_filter_matches(graphs, task->n_train, filter)) {
+                    continue;
+                }
+                binding_call_t matching[n_bindings + 1];
+                int n_matching = 0;
+                for (int i_binding = 0; dynamic && i_binding < n_bindings; i_binding++) {
+                    if (any_binding_matches(graphs, task->n_train, filter, &bindings[i_binding])) {
+                        matching[n_matching++] = bindings[i_binding];
+                    }
+                }
+                int n_transforms = enumerate_transforms(
+                    matching, n_matching, dynamic, transforms, MAX_TRANSFORM_CALLS);
+
+                for (int i_transform = 0; i_transform < n_transforms; i_transform++) {
+                    if (result->n_samples >= options->sample_budget ||
+                        elapsed_seconds(&start) >= options->time_budget) {
+                        exhausted = true;
+                        break;
+                    }
+                    result->n_samples++;
+
+                    program_t program = {abstraction, 1, {{filter, &transforms[i_transform]}}};
+                    program_evaluation_t evaluation;
+                    if (evaluate_program(task, &program, 0, NULL, &evaluation)) {
+                        record_solution(task, &program, result);
+                        break;
+                    }
+                }
+            }
+
+            for (int i_train = 0; i_train < task->n_train; i_train++) {
+                if (graphs[i_train]) {
+                    free_graph(graphs[i_train]);
+                }
+            }
+        }
+    }
+    free(transforms);
+    result->seconds = elapsed_seconds(&start);
+}
+
+void push_expansion(frontier_t* frontier, expansion_t expansion) {
+    if (frontier->n_expansions == frontier->capacity) {
+        frontier->capacity = frontier->capacity ? 2 * frontier->capacity : 256;
+        frontier->expansions =
+            realloc(frontier->expansions, frontier->capacity * sizeof(expansion_t));
+    }
+    expansion_t* heap = frontier->expansions;
+    int idx = frontier->n_expansions++;
+    while (idx > 0 && heap[(idx - 1) / 2].log_p < expansion.log_p) {
+        heap[idx] = heap[(idx - 1) / 2];
+        idx = (idx - 1) / 2;
+    }
+    heap[idx] = expansion;
+}
+
+expansion_t pop_expansion(frontier_t* frontier) {
+    expansion_t* heap = frontier->expansions;
+    expansion_t top = heap[0];
+    expansion_t last = heap[--frontier->n_expansions];
+    int idx = 0;
+    for (;;) {
+        int child = 2 * idx + 1;
+        if (child >= frontier->n_expansions) {
+            break;
+        }
+        if (child + 1 < frontier->n_expansions && heap[child + 1].log_p > heap[child].log_p) {
+            child++;
+        }
+        if (heap[child].log_p <= last.log_p) {
+            break;
+        }
+        heap[idx] = heap[child];
+        idx = child;
+    }
+    heap[idx] = last;
+    return top;
+}
+
+// on_branch of the script: keep the second most probable choice, the decoder takes the first
+static void push_alternatives(
+    trail_script_t* script, const trail_t* trail, const categorical_t* dist, long valid_flags) {
+    signed char ranked[MAX_CHOICES];
+    int n_ranked = 0;
+    double sum = 0.0;
+    for (int i = 0; i < dist->size; i++) {
+        if (valid_flags & (1l << i)) {
+            sum += dist->p[i];
+            // ties keep their order, like choose_from
+            int pos = n_ranked++;
+            for (; pos > 0 && dist->p[ranked[pos - 1]] < dist->p[i]; pos--) {
+                ranked[pos] = ranked[pos - 1];
+            }
+            ranked[pos] = i;
+        }
+    }
+    if (n_ranked < 2) {
+        return;
+    }
+
+    branch_t* branch = malloc(sizeof(branch_t) + trail->depth);
+    branch->n_prefix = get_trail_choices(trail, branch->prefix, trail->depth);
+    branch->state = fork_trail_state(trail);
+    branch->log_p = script->log_p;
+    branch->n_ranked = n_ranked;
+    for (int rank = 0; rank < n_ranked; rank++) {
+        branch->ranked[rank] = ranked[rank];
+        branch->log_p_ranked[rank] = log(dist->p[ranked[rank]] / sum);
+    }
+    // the abstraction is the first choice, each step ends with a repeat
+    branch->n_steps = trail->prev ? 0 : -1;
+    for (const trail_t* prev = trail->prev; prev; prev = prev->prev) {
+        branch->n_steps += prev->cursor->repeat != NULL;
+    }
+
+    decoding_t* decoding = script->context;
+    if (decoding->n_pending == decoding->capacity) {
+        decoding->capacity = decoding->capacity ? 2 * decoding->capacity : 64;
+        decoding->pending =
+            realloc(decoding->pending, decoding->capacity * sizeof(branch_t*));
+    }
+    decoding->pending[decoding->n_pending++] = branch;
+}
+
+void best_first_task(
+    task_t* task, guide_t* guide, const solve_options_t* options, solve_result_t* result) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    init_solve_result(task, result);
+    if (task->n_train == 0) {
+        return;
+    }
+
+    task_memo_t memo;
+    init_task_memo(&memo);
+    frontier_t frontier = {0};
+    decoding_t decoding = {0};
+    push_expansion(&frontier, (expansion_t){0.0, NULL, 0});
+    while (frontier.n_expansions > 0 && result->n_samples < options->sample_budget &&
+           elapsed_seconds(&start) < options->time_budget) {
+        expansion_t expansion = pop_expansion(&frontier);
+        branch_t* branch = expansion.branch;
+        signed char prefix[branch ? branch->n_prefix + 1 : 1];
+        trail_script_t script = {
+            .n_prefix = 0,
+            .prefix = prefix,
+            .state = NULL,
+            .log_p = expansion.log_p,
+            .on_branch = push_alternatives,
+            .context = &decoding,
+        };
+        if (branch) {
+            memcpy(prefix, branch->prefix, branch->n_prefix);
+            prefix[branch->n_prefix] = branch->ranked[expansion.rank];
+            script.n_prefix = branch->n_prefix + 1;
+            int next_rank = expansion.rank + 1;
+            if (next_rank < branch->n_ranked) {
+                script.state = copy_trail_state(guide, branch->state);
+                push_expansion(
+                    &frontier,
+                    (expansion_t){
+                        branch->log_p + branch->log_p_ranked[next_rank], branch, next_rank});
+            } else {
+                // the last alternative takes over the state
+                script.state = branch->state;
+                free(branch);
+            }
+        }
+        result->n_samples++;
+
+        program_t program = {NULL};
+        trail_t* trail = new_scripted_trail(
+            task->train_input_raster[0], task->train_output_raster[0], guide, &script);
+        program.abstraction = sample_abstraction(&trail);
+        graph_t* graph = program.abstraction->func(&task->train_input[0]);
+        bool complete = sample_steps(task, graph, &program, &trail);
+        free_graph(graph);
+        free_trail(guide, trail, false);
+
+        bool correct = complete && try_program(task, &program, 0, &memo, result);
+        free_program(task, &program);
+
+        // alternatives after a transposed prefix are also reached from the prefix it was
+        // replaced by, so they would expand the same states again
+        int n_transposed = complete ? memo.n_transposed : -1;
+        for (int i = 0; i < decoding.n_pending; i++) {
+            branch_t* pending = decoding.pending[i];
+            if (n_transposed >= 0 && pending->n_steps >= n_transposed) {
+                result->n_pruned++;
+                free_trail_state(guide, pending->state);
+                free(pending);
+            } else {
+                push_expansion(
+                    &frontier,
+                    (expansion_t){pending->log_p + pending->log_p_ranked[1], pending, 1});
+            }
+        }
+        decoding.n_pending = 0;
+        if (correct) {
+            break;
+        }
+    }
+    free_task_memo(&memo);
+    free(decoding.pending);
+
+    // each branch is queued with a single alternative at a time
+    for (int idx = 0; idx < frontier.n_expansions; idx++) {
+        branch_t* branch = frontier.expansions[idx].branch;
+        if (branch) {
+            free_trail_state(guide, branch->state);
+            free(branch);
+        }
+    }
+    free(frontier.expansions);
+    result->seconds = elapsed_seconds(&start);
+}
+
+// a partial program in the beam
+typedef struct _beam_member {
+    double log_p;
+    // network state before the last prefix choice, see trail_script_t
+    void* state;
+    int n_prefix;
+    signed char* prefix;
+} beam_member_t;
+
+// the choice a member stopped at when it was replayed
+typedef struct _beam_probe {
+    int n_choices;
+    long valid_flags;
+    // choices before it, including the unused ones that follow the prefix
+    int n_prefix;
+    signed char* prefix;
+} beam_probe_t;
+
+typedef struct _beam_candidate {
+    double log_p;
+    int member;
+    int choice;
+} beam_candidate_t;
+
+typedef enum _probe_status {
+    PROBE_STOPPED,
+    PROBE_COMPLETE,
+    PROBE_FAILED,
+} probe_status_t;
+
+static void stop_probe(
+    trail_script_t* script, const trail_t* trail, const categorical_t* dist, long valid_flags) {
+    beam_probe_t* probe = script->context;
+    probe->n_choices = dist->size;
+    probe->valid_flags = valid_flags & ((1l << dist->size) - 1);
+    probe->n_prefix = get_trail_choices(trail, probe->prefix, trail->depth);
+}
+
+// replay the member up to its next choice, the program is complete when the prefix covers it
+static probe_status_t probe_member(
+    task_t* task,
+    guide_t* guide,
+    graph_t** graphs,
+    beam_member_t* member,
+    beam_probe_t* probe,
+    program_t* program) {
+    trail_script_t script = {
+        .n_prefix = member->n_prefix,
+        .prefix = member->prefix,
+        .state = member->state,
+        .log_p = member->log_p,
+        .probe = true,
+        .stopped = false,
+        .on_branch = stop_probe,
+        .context = probe,
+    };
+    trail_t* trail = new_scripted_trail(
+        task->train_input_raster[0], task->train_output_raster[0], guide, &script);
+    program->abstraction = sample_abstraction(&trail);
+    const graph_t* graph = graphs[program->abstraction - abstractions];
+    bool complete = sample_steps(task, graph, program, &trail);
+    free_trail(guide, trail, false);
+    // the first probe creates the network state
+    member->state = script.state;
+
+    if (script.stopped) {
+        return PROBE_STOPPED;
+    }
+    return complete ? PROBE_COMPLETE : PROBE_FAILED;
+}
+
+/**
+ * Probe a new member of the beam.  A complete program is evaluated, returns
+ * whether the member stopped at a choice and stays in the beam.
+ */
+static bool advance_member(
+    task_t* task,
+    guide_t* guide,
+    graph_t** graphs,
+    beam_member_t* member,
+    beam_probe_t* probe,
+    const solve_options_t* options,
+    task_memo_t* memo,
+    solve_result_t* result) {
+    program_t program = {NULL};
+    probe_status_t status = probe_member(task, guide, graphs, member, probe, &program);
+    if (status == PROBE_COMPLETE && result->n_samples < options->sample_budget) {
+        result->n_samples++;
+        try_program(task, &program, 0, memo, result);
+    }
+    free_program(task, &program);
+    if (status != PROBE_STOPPED) {
+        free_trail_state(guide, member->state);
+        member->state = NULL;
+        return false;
+    }
+    return true;
+}
+
+static int compare_candidates(const void* a, const void* b) {
+    const beam_candidate_t* first = a;
+    const beam_candidate_t* second = b;
+    if (first->log_p != second->log_p) {
+        return first->log_p < second->log_p ? 1 : -1;
+    }
+    if (first->member != second->member) {
+        return first->member - second->member;
+    }
+    return first->choice - second->choice;
+}
+
+void beam_task(
+    task_t* task, guide_t* guide, const solve_options_t* options, solve_result_t* result) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    init_solve_result(task, result);
+    if (task->n_train == 0) {
+        return;
+    }
+
+    int width = options->beam_width > 0 ? options->beam_width : 1;
+    if (width > MAX_BEAM_WIDTH) {
+        width = MAX_BEAM_WIDTH;
+    }
+    int n_items = max_trail_length(guide);
+    int n_abstractions = 0;
+    while (abstractions[n_abstractions].func) {
+        n_abstractions++;
+    }
+    graph_t* graphs[n_abstractions];
+    for (int i = 0; i < n_abstractions; i++) {
+        graphs[i] = abstractions[i].func(&task->train_input[0]);
+    }
+
+    // prefixes of the current and next beam, and those found by probing them
+    signed char (*prefixes)[width][n_items] = malloc(2 * sizeof(*prefixes));
+    signed char (*probe_prefixes)[width][n_items] = malloc(2 * sizeof(*probe_prefixes));
+    beam_member_t members[width];
+    beam_member_t next_members[width];
+    beam_probe_t probes[width];
+    beam_probe_t next_probes[width];
+    beam_candidate_t* candidates = malloc(width * MAX_CHOICES * sizeof(beam_candidate_t));
+    task_memo_t memo;
+    init_task_memo(&memo);
+
+    int current = 0;
+    members[0] = (beam_member_t){0.0, NULL, 0, prefixes[current][0]};
+    probes[0].prefix = probe_prefixes[current][0];
+    int n_members =
+        advance_member(task, guide, graphs, &members[0], &probes[0], options, &memo, result);
+    while (n_members > 0 && !result->found && result->n_samples < options->sample_budget &&
+           elapsed_seconds(&start) < options->time_budget) {
+        // one pass over the network for the next choice of all members
+        void* states[width];
+        categorical_t dists[width];
+        for (int i = 0; i < n_members; i++) {
+            states[i] = members[i].state;
+            dists[i].size = probes[i].n_choices;
+        }
+        next_choices(guide, states, n_members, dists);
+        int n_candidates = 0;
+        for (int i = 0; i < n_members; i++) {
+            const beam_probe_t* probe = &probes[i];
+            double sum = 0.0;
+            for (int choice = 0; choice < dists[i].size; choice++) {
+                if (probe->valid_flags & (1l << choice)) {
+                    sum += dists[i].p[choice];
+                }
+            }
+            for (int choice = 0; choice < dists[i].size; choice++) {
+                if (probe->valid_flags & (1l << choice)) {
+                    double log_p = members[i].log_p + log(dists[i].p[choice] / sum);
+                    candidates[n_candidates++] = (beam_candidate_t){log_p, i, choice};
+                }
+            }
+        }
+        qsort(candidates, n_candidates, sizeof(beam_candidate_t), compare_candidates);
+
+        // candidates are probed in order, those that fail (e.g. a filter that selects no
+        // node) or complete a program do not take a place in the next beam
+        int next = 1 - current;
+        int n_next = 0;
+        for (int i = 0; i < n_candidates && n_next < width && !result->found &&
+                        result->n_samples < options->sample_budget;
+             i++) {
+            const beam_member_t* member = &members[candidates[i].member];
+            const beam_probe_t* probe = &probes[candidates[i].member];
+            beam_member_t* child = &next_members[n_next];
+            child->log_p = candidates[i].log_p;
+            child->prefix = prefixes[next][n_next];
+            memcpy(child->prefix, probe->prefix, probe->n_prefix);
+            child->prefix[probe->n_prefix] = candidates[i].choice;
+            child->n_prefix = probe->n_prefix + 1;
+            child->state = copy_trail_state(guide, member->state);
+            next_probes[n_next].prefix = probe_prefixes[next][n_next];
+            n_next += advance_member(
+                task, guide, graphs, child, &next_probes[n_next], options, &memo, result);
+        }
+        for (int i = 0; i < n_members; i++) {
+            free_trail_state(guide, members[i].state);
+        }
+        for (int i = 0; i < n_next; i++) {
+            members[i] = next_members[i];
+            probes[i] = next_probes[i];
+        }
+        n_members = n_next;
+        current = next;
+    }
+    for (int i = 0; i < n_members; i++) {
+        free_trail_state(guide, members[i].state);
+    }
+
+    free_task_memo(&memo);
+    free(candidates);
+    free(probe_prefixes);
+    free(prefixes);
+    for (int i = 0; i < n_abstractions; i++) {
+        free_graph(graphs[i]);
+    }
+    result->seconds = elapsed_seconds(&start);
+}
@@ -0,0 +1,62 @@
+#ifndef __SEARCH_H__
+#define __SEARCH_H__
+
+#include "solve.h"
+
+/**
+ * Guide-free baseline: enumerate (abstraction, filter, transform) programs in
+ * a fixed order until one reproduces all train pairs or the budget of the
+ * options runs out.  Programs with static arguments are tried before those
+ * that bind arguments to other nodes.  Filters that select no node in any
+ * train input and bindings that never resolve are skipped, and a program is
+ * dropped as soon as it fails on the first train example.  The number of
+ * evaluated programs is reported as the samples of the result.
+ */
+void search_task(task_t* task, const solve_options_t* options, solve_result_t* result);
+
+/**
+ * Guided search: programs are decoded from the guide for the first train
+ * pair, most probable first.  An expansion replays a prefix of choices,
+ * resuming the network from the state saved at its end, and completes it with
+ * the most probable valid choices.  The next alternative of each of those
+ * choices goes on a priority queue of prefixes, ordered by log-probability,
+ * so no program is decoded twice.  The sample budget bounds the number of
+ * expansions.
+ */
+void best_first_task(
+    task_t* task, guide_t* guide, const solve_options_t* options, solve_result_t* result);
+
+typedef struct _branch branch_t;
+
+// prefix up to and including an alternative of the branch, NULL for the empty prefix
+typedef struct _expansion {
+    double log_p;
+    branch_t* branch;
+    int rank;
+} expansion_t;
+
+// max-heap on the log-probability, the frontier of best_first_task
+typedef struct _frontier {
+    int n_expansions;
+    int capacity;
+    expansion_t* expansions;
+} frontier_t;
+
+void push_expansion(frontier_t* frontier, expansion_t expansion);
+
+// the most probable expansion, the frontier must not be empty
+expansion_t pop_expansion(frontier_t* frontier);
+
+/**
+ * Beam search over the choices of the guide for the first train pair.  Each
+ * step computes the distributions of the next choice of all members of the
+ * beam in one pass over the network.  The continuations are replayed up to
+ * their next choice, most probable first, until beam_width of them stopped
+ * at one.  Continuations that complete a program are evaluated, those that
+ * fail are dropped, neither takes a place in the beam.  The sample budget
+ * bounds the number of evaluated programs.
+ */
+void beam_task(
+    task_t* task, guide_t* guide, const solve_options_t* options, solve_result_t* result);
+
+#endif  // __SEARCH_H__
@@ -0,0 +1,288 @@
+#include "solve.h"
+
+#include <pthread.h>
+
+#include "filter.h"
+#include "image.h"
+#include "search.h"
+#include "transform.h"
+
+double elapsed_seconds(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+void init_solve_result(const task_t* task, solve_result_t* result) {
+    *result = (solve_result_t){
+        .found = false,
+    };
+    // test outputs are not known for all task sets
+    for (int i_test = 0; i_test < task->n_test; i_test++) {
+        if (task->test_output_raster[i_test]) {
+            result->n_test++;
+        }
+    }
+}
+
+void record_solution(const task_t* task, const program_t* program, solve_result_t* result) {
+    result->found = true;
+    result->abstraction = program->abstraction->name;
+    result->filter = program->steps[0].filter->filter->name;
+    result->transform = program->steps[0].transform->transform->name;
+    result->n_steps = program->n_steps;
+    for (int i_test = 0; i_test < task->n_test; i_test++) {
+        const grid_t* test_input = &task->test_input[i_test];
+        const raster_t* test_output = task->test_output_raster[i_test];
+        if (test_output && program_mismatches(program, test_input, test_output) == 0) {
+            result->n_test_correct++;
+        }
+    }
+}
+
+void init_task_memo(task_memo_t* memo) {
+    memo->evaluated = new_program_set();
+    memo->prefixes = new_prefix_cache();
+    memo->transpositions = new_transposition_table();
+    memo->n_transposed = -1;
+}
+
+void free_task_memo(task_memo_t* memo) {
+    free_transposition_table(memo->transpositions);
+    free_prefix_cache(memo->prefixes);
+    free_program_set(memo->evaluated);
+}
+
+bool try_program(
+    const task_t* task,
+    const program_t* program,
+    int first_example,
+    task_memo_t* memo,
+    solve_result_t* result) {
+    program_key_t key;
+    bool has_key = encode_program(program, &key);
+    memo->n_transposed = -1;
+    if (has_key) {
+        const program_entry_t* entry = find_program(memo->evaluated, &key);
+        if (entry) {
+            result->n_duplicates++;
+            return entry->correct;
+        }
+    }
+    program_evaluation_t evaluation;
+    bool correct = evaluate_program(task, program, first_example, memo->prefixes, &evaluation);
+    if (has_key) {
+        add_program(memo->evaluated, &key, correct);
+    }
+    // after the evaluation, so that only the examples it reached are transposed
+    if (has_key && program->n_steps > 1) {
+        int n_transposed = transpose_program(
+            task, program, &evaluation, memo->prefixes, memo->transpositions, &key);
+        if (n_transposed >= 0 && !find_program(memo->evaluated, &key)) {
+            add_program(memo->evaluated, &key, correct);
+        }
+        // on the other examples the prefixes may differ, so their continuations may too
+        if (evaluation.n_evaluated == task->n_train) {
+            memo->n_transposed = n_transposed;
+        }
+    }
+    if (correct) {
+        record_solution(task, program, result);
+    }
+    return correct;
+}
+
+void solve_task(
+    task_t* task, guide_t* guide, const solve_options_t* options, solve_result_t* result) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    init_solve_result(task, result);
+    if (task->n_train == 0) {
+        return;
+    }
+
+    task_memo_t memo;
+    init_task_memo(&memo);
+    while (result->n_samples < options->sample_budget &&
+           elapsed_seconds(&start) < options->time_budget) {
+        int i_train = result->n_samples % task->n_train;
+        const grid_t* input = &task->train_input[i_train];
+        result->n_samples++;
+
+        program_t program = {NULL};
+        trail_t* trail = new_trail(
+            task->train_input_raster[i_train], task->train_output_raster[i_train], guide);
+        program.abstraction = sample_abstraction(&trail);
+        graph_t* graph = program.abstraction->func(input);
+        bool complete = sample_steps(task, graph, &program, &trail);
+        free_graph(graph);
+        free_trail(guide, trail, false);
+
+        if (complete && try_program(task, &program, i_train, &memo, result)) {
+            free_program(task, &program);
+            break;
+        }
+        free_program(task, &program);
+    }
+    free_task_memo(&memo);
+    result->seconds = elapsed_seconds(&start);
+}
+
+typedef struct _solve_pool {
+    task_def_t** tasks;
+    int n_tasks;
+    int next_task;
+    const solve_options_t* options;
+    solve_result_t* results;
+} solve_pool_t;
+
+typedef struct _solve_worker {
+    pthread_t thread;
+    solve_pool_t* pool;
+    guide_t* guide;
+} solve_worker_t;
+
+static void* run_worker(void* arg) {
+    solve_worker_t* worker = arg;
+    solve_pool_t* pool = worker->pool;
+    for (;;) {
+        int i_task = __atomic_fetch_add(&pool->next_task, 1, __ATOMIC_RELAXED);
+        if (i_task >= pool->n_tasks) {
+            break;
+        }
+        task_def_t* task_def = pool->tasks[i_task];
+        solve_result_t* result = &pool->results[i_task];
+        task_def->task->rejections = (rejections_t){0, 0, 0, 0};
+        switch (pool->options->mode) {
+            case SOLVE_SAMPLE:
+                solve_task(task_def->task, worker->guide, pool->options, result);
+                break;
+            case SOLVE_ENUMERATE:
+                search_task(task_def->task, pool->options, result);
+                break;
+            case SOLVE_BEST_FIRST:
+                best_first_task(task_def->task, worker->guide, pool->options, result);
+                break;
+            case SOLVE_BEAM:
+                beam_task(task_def->task, worker->guide, pool->options, result);
+                break;
+        }
+        result->rejections = task_def->task->rejections;
+        if (result->found) {
+            fprintf(
+                stderr,
+                "  %s: found program after %ld %s (%.3fs), %d/%d test outputs correct\n",
+                task_def->name,
+                result->n_samples,
+                pool->options->mode == SOLVE_SAMPLE ? "samples" : "programs",
+                result->seconds,
+                result->n_test_correct,
+                result->n_test);
+        }
+    }
+    return NULL;
+}
+
+void solve_tasks(
+    task_def_t** tasks,
+    int n_tasks,
+    guide_t* guide,
+    const solve_options_t* options,
+    solve_result_t* results) {
+    solve_pool_t pool = {
+        .tasks = tasks,
+        .n_tasks = n_tasks,
+        .next_task = 0,
+        .options = options,
+        .results = results,
+    };
+    int n_workers = options->n_workers > 0 ? options->n_workers : 1;
+    solve_worker_t workers[n_workers];
+    for (int i = 0; i < n_workers; i++) {
+        workers[i].pool = &pool;
+        workers[i].guide = fork_guide(guide, 1234l + i);
+        pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]);
+    }
+    for (int i = 0; i < n_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+        free_guide(workers[i].guide);
+    }
+}
+
+void print_solve_report(
+    FILE* out, task_def_t** tasks, int n_tasks, const solve_result_t* results) {
+    int n_found = 0, n_solved = 0;
+    long total_samples = 0, all_samples = 0, all_duplicates = 0, all_pruned = 0;
+    rejections_t all_rejections = {0, 0, 0, 0};
+    double total_seconds = 0.0, all_seconds = 0.0;
+    fprintf(
+        out,
+        "task,found,test_correct,n_test,samples,seconds,abstraction,filter,transform,steps\n");
+    for (int i_task = 0; i_task < n_tasks; i_task++) {
+        const solve_result_t* result = &results[i_task];
+        fprintf(
+            out,
+            "%s, %d, %d, %d, %ld, %.6f, %s, %s, %s, %d\n",
+            tasks[i_task]->name,
+            result->found,
+            result->n_test_correct,
+            result->n_test,
+            result->n_samples,
+            result->seconds,
+            result->found ? result->abstraction : "",
+            result->found ? result->filter : "",
+            result->found ? result->transform : "",
+            result->found ? result->n_steps : 0);
+        all_samples += result->n_samples;
+        all_duplicates += result->n_duplicates;
+        all_pruned += result->n_pruned;
+        all_rejections.filter += result->rejections.filter;
+        all_rejections.binding += result->rejections.binding;
+        all_rejections.transform += result->rejections.transform;
+        all_rejections.resampled += result->rejections.resampled;
+        all_seconds += result->seconds;
+        if (result->found) {
+            n_found++;
+            if (result->n_test > 0 && result->n_test_correct == result->n_test) {
+                n_solved++;
+                total_samples += result->n_samples;
+                total_seconds += result->seconds;
+            }
+        }
+    }
+    fflush(out);
+
+    fprintf(stderr, "Evaluated %d tasks\n", n_tasks);
+    fprintf(stderr, "  reproduced train pairs: %d\n", n_found);
+    fprintf(
+        stderr,
+        "  solved: %d (%.1f%%)\n",
+        n_solved,
+        n_tasks > 0 ? 100.0 * n_solved / n_tasks : 0.0);
+    if (n_solved > 0) {
+        fprintf(stderr, "  mean time-to-solution: %.3fs\n", total_seconds / n_solved);
+        fprintf(
+            stderr, "  mean samples-to-solution: %.1f\n", (double)total_samples / n_solved);
+    }
+    if (all_samples > 0) {
+        fprintf(stderr, "  duplicate programs: %.1f%%\n", 100.0 * all_duplicates / all_samples);
+    }
+    if (all_pruned > 0) {
+        fprintf(stderr, "  pruned alternatives: %ld\n", all_pruned);
+    }
+    if (all_rejections.filter + all_rejections.binding + all_rejections.transform > 0) {
+        fprintf(
+            stderr,
+            "  rejected samples: %ld filter, %ld binding, %ld transform\n",
+            all_rejections.filter,
+            all_rejections.binding,
+            all_rejections.transform);
+    }
+    if (all_rejections.resampled > 0) {
+        fprintf(stderr, "  resampled filters and bindings: %ld\n", all_rejections.resampled);
+    }
+    if (all_seconds > 0.0) {
+        fprintf(stderr, "  throughput: %.0f programs/s\n", all_samples / all_seconds);
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef __SOLVE_H__
+#define __SOLVE_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "guide.h"
+#include "io.h"
+#include "program.h"
+#include "task.h"
+
+/**
+ * Evaluation mode: for each task, sample programs from the guide until one
+ * reproduces all training pairs (or the budget runs out), then apply that
+ * program to the test inputs.
+ */
+
+typedef enum _solve_mode {
+    // sample programs from the guide
+    SOLVE_SAMPLE,
+    // enumerate programs without the guide (see search_task)
+    SOLVE_ENUMERATE,
+    // decode programs from the guide in order of probability (see best_first_task)
+    SOLVE_BEST_FIRST,
+    // decode the most probable programs from the guide in lockstep (see beam_task)
+    SOLVE_BEAM,
+} solve_mode_t;
+
+// the members of a beam are kept on the stack
+#define MAX_BEAM_WIDTH 1024
+
+typedef struct _solve_options {
+    // wall-clock budget per task, in seconds
+    double time_budget;
+    // maximum number of sampled programs (or expansions) per task
+    long sample_budget;
+    // number of worker threads that tasks are spread over
+    int n_workers;
+    solve_mode_t mode;
+    // number of partial programs that are kept in beam mode, at most MAX_BEAM_WIDTH
+    int beam_width;
+} solve_options_t;
+
+typedef struct _solve_result {
+    // a program was found that reproduces all training pairs
+    bool found;
+    int n_test;
+    int n_test_correct;
+    // samples (or enumerated programs) and time spent, up to and including the solution
+    long n_samples;
+    // samples that repeated an evaluated program, these are not run again
+    long n_duplicates;
+    // alternatives that were not decoded as they would reach known states again
+    long n_pruned;
+    // partial programs that were dropped as no valid choice was left, by cause
+    rejections_t rejections;
+    double seconds;
+
+    // the first step of the program that was found, and the number of steps
+    const char* abstraction;
+    const char* filter;
+    const char* transform;
+    int n_steps;
+} solve_result_t;
+
+double elapsed_seconds(const struct timespec* start);
+
+// an empty result, counting the test outputs that are known
+void init_solve_result(const task_t* task, solve_result_t* result);
+
+// store a program that reproduces the train pairs and check it against the test outputs
+void record_solution(const task_t* task, const program_t* program, solve_result_t* result);
+
+// what is remembered of the programs that were tried on a task
+typedef struct _task_memo {
+    program_set_t* evaluated;
+    prefix_cache_t* prefixes;
+    transposition_table_t* transpositions;
+    // steps of the last tried program that were replaced by a prefix reaching the same state on
+    // every train example, -1 for none
+    int n_transposed;
+} task_memo_t;
+
+void init_task_memo(task_memo_t* memo);
+void free_task_memo(task_memo_t* memo);
+
+/**
+ * Evaluate a program on the train pairs unless the same program was evaluated
+ * before, in which case its outcome is reused.  Programs of several steps
+ * are also stored under their transposed key (see transpose_program), so
+ * that the equivalent program is not evaluated again.  Graphs of program
+ * prefixes are reused from the prefix cache.  Solutions are
+ * recorded in the result.  Returns whether the program reproduces the train
+ * pairs.
+ */
+bool try_program(
+    const task_t* task,
+    const program_t* program,
+    int first_example,
+    task_memo_t* memo,
+    solve_result_t* result);
+
+void solve_task(
+    task_t* task, guide_t* guide, const solve_options_t* options, solve_result_t* result);
+
+// solve all tasks on a pool of workers, results are stored at the index of the task
+void solve_tasks(
+    task_def_t** tasks,
+    int n_tasks,
+    guide_t* guide,
+    const solve_options_t* options,
+    solve_result_t* results);
+
+void print_solve_report(
+    FILE* out, task_def_t** tasks, int n_tasks, const solve_result_t* results);
+
+#endif  // __SOLVE_H__
@@ -2,26 +2,65 @@
 #define __TASK_H__
 
 #include "graph.h"
+#include "grid.h"
 #include "mem.h"
+#include "raster.h"
 
 #define MAX_TRAIN_EXAMPLES 10
 #define MAX_TEST_INPUT 5
 
+/**
+ * Outputs that programs produced for an example, by their hash, with the
+ * cheapest program that produced each (see record_output).
+ */
+typedef struct _output_table {
+    // hash_raster of the input, the outputs are hashed relative to it; 0 until known
+    unsigned long input_hash;
+    int n_entries;
+    int capacity;
+    struct _output_entry* entries;
+} output_table_t;
+
+// samples that were rejected, by the part of the program that could not be completed
+typedef struct _rejections {
+    // no argument value left for which the filter selects a node
+    long filter;
+    // no argument value left for which the binding resolves for a selected node
+    long binding;
+    // no transformation applies to the selected nodes
+    long transform;
+    // failed filters or bindings that were sampled again, see resample_from
+    long resampled;
+} rejections_t;
+
 typedef struct _task {
     int n_train;
     int n_test;
-    const graph_t* train_input[MAX_TRAIN_EXAMPLES];
-    const graph_t* train_output[MAX_TRAIN_EXAMPLES];
-    const graph_t* test_input[MAX_TEST_INPUT];
-    const graph_t* test_output[MAX_TEST_INPUT];
+    const raster_t* train_input_raster[MAX_TRAIN_EXAMPLES];
+    const raster_t* train_output_raster[MAX_TRAIN_EXAMPLES];
+    const raster_t* test_input_raster[MAX_TEST_INPUT];
+    const raster_t* test_output_raster[MAX_TEST_INPUT];
+
+    // the inputs as pixel graphs, on top of the rasters
+    grid_t train_input[MAX_TRAIN_EXAMPLES];
+    grid_t test_input[MAX_TEST_INPUT];
 
     // workspace
     mem_block_t* _mem_filter_calls;
     mem_block_t* _mem_binding_calls;
     mem_block_t* _mem_transform_calls;
+    rejections_t rejections;
+    // reconstructions of the train outputs seen while training
+    output_table_t _train_outputs[MAX_TRAIN_EXAMPLES];
 } task_t;
 
 task_t* new_task();
 void free_task(task_t* task);
 
+// add an example to the task, which takes ownership of the rasters
+void add_train_example(task_t* task, raster_t* input, raster_t* output);
+// the output of a test example may be NULL when it is not known
+void add_test_example(task_t* task, raster_t* input, raster_t* output);
+void set_test_output(task_t* task, int i_test, raster_t* output);
+
 #endif  // __TASK_H__
\ No newline at end of file
@@ -4,7 +4,7 @@
 #include <string.h>
 
 #include "binding.h"
-#include "collection.h"
+#include "bitboard.h"
 
 typedef struct _dcoord {
     signed short dx;
@@ -31,68 +31,52 @@ int rotations[3][4] = {
     {-1, 0, 0, -1},
 };
 
-typedef struct _subnode_iter {
-    int n_subnodes;
-    int i;
-    const subnode_block_t* block;
-} subnode_iter_t;
-
-coordinate_t init_subnode_iter(
-    subnode_iter_t* iter, const subnode_block_t* subnodes, int n_subnodes) {
-    iter->n_subnodes = n_subnodes;
-    iter->block = subnodes;
-    iter->i = 0;
-    return iter->block->subnode[0];
+static inline bool check_bounds(const graph_t* graph, coordinate_t coord) {
+    return coord.pri >= 0 && coord.sec >= 0 && coord.pri < graph->width &&
+           coord.sec < graph->height;
 }
 
-static inline bool is_valid_subnode(const subnode_iter_t* iter) {
-    return iter->i < iter->n_subnodes;
+static void translate_node(node_t* node, int dx, int dy) {
+    for (int i = 0; i < node->n_subnodes; i++) {
+        node->subnode_coords[i].pri += dx;
+        node->subnode_coords[i].sec += dy;
+    }
 }
 
-coordinate_t next_coordinate(subnode_iter_t* iter) {
-    if (iter->i == SUBNODE_BLOCK_SIZE - 1) {
-        iter->block = iter->block->next;
-    }
-    iter->i++;
-    if (is_valid_subnode(iter)) {
-        return iter->block->subnode[iter->i % SUBNODE_BLOCK_SIZE];
-    } else {
-        return (coordinate_t){-1, -1};
+// bitset of the colors of the subnodes
+static int node_colors(const node_t* node) {
+    int colors = 0;
+    for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+        color_t color = next_subnode(&iter).color;
+        if (color >= 0 && color < 10) {
+            colors |= 1 << color;
+        }
     }
+    return colors;
 }
 
-static inline bool check_bounds(const graph_t* graph, coordinate_t coord) {
-    return coord.pri >= 0 && coord.sec >= 0 && coord.pri < graph->width &&
-           coord.sec < graph->height;
+// false when some pixels of the node are not on the board
+static bool node_bitboard(const node_t* node, int color, bitboard_t* board) {
+    clear_bitboard(board);
+    return add_node_pixels(board, node, color);
 }
 
-bool check_collision(
-    const graph_t* graph, node_t* node, subnode_block_t* subnodes, int n_subnodes) {
-    int size = bitset_size(graph);
-    long bitset[size];
-    for (int i = 0; i < size; i++) {
-        bitset[i] = 0;
-    }
-    subnode_iter_t iter;
-    for (coordinate_t coord = init_subnode_iter(&iter, subnodes, n_subnodes);
-         is_valid_subnode(&iter);
-         coord = next_coordinate(&iter)) {
-        if (!check_bounds(graph, coord)) {
-            printf("NOOO!!!\n");
-        }
-        add_coordinate(graph, bitset, coord);
-    }
+// add a node with the pixels of the board, nothing is changed on failure
+static bool add_bitboard_node(graph_t* graph, const bitboard_t* board, color_t color) {
+    int max_pri = -1;
     for (const node_t* other = graph->nodes; other; other = other->next) {
-        if (other == node) {
-            continue;
-        }
-        for (int i = 0; i < other->n_subnodes; i++) {
-            subnode_t other_subnode = get_subnode(other, i);
-            if (coordinate_in_set(graph, bitset, other_subnode.coord)) {
-                return false;
-            }
+        if (other->coord.pri > max_pri) {
+            max_pri = other->coord.pri;
         }
     }
+    node_t* node = add_node(graph, (coordinate_t){max_pri + 1, 0}, 0);
+    if (!node) {
+        return false;
+    }
+    if (!append_bitboard(graph, node, board, color)) {
+        remove_node(graph, node);
+        return false;
+    }
     return true;
 }
 
@@ -114,9 +98,7 @@ color_t get_color(const graph_t* graph, color_t color) {
 bool update_color(graph_t* graph, node_t* node, transform_arguments_t* args) {
     color_t color = get_color(graph, args->color);
     for (int i = 0; i < node->n_subnodes; i++) {
-        subnode_t subnode = get_subnode(node, i);
-        subnode.color = color;
-        set_subnode(node, i, subnode);
+        node->subnode_colors[i] = color;
     }
     return true;
 }
@@ -127,12 +109,7 @@ bool update_color(graph_t* graph, node_t* node, transform_arguments_t* args) {
 bool move_node(
     __attribute__((unused)) graph_t* graph, node_t* node, transform_arguments_t* args) {
     dcoord_t delta = deltas[args->direction];
-    for (int i = 0; i < node->n_subnodes; i++) {
-        subnode_t subnode = get_subnode(node, i);
-        subnode.coord.pri += delta.dx;
-        subnode.coord.sec += delta.dy;
-        set_subnode(node, i, subnode);
-    }
+    translate_node(node, delta.dx, delta.dy);
     return true;
 }
 
@@ -142,31 +119,47 @@ bool move_node(
  * if overlap is false, stop extending before it overlaps with another node
  */
 bool extend_node(graph_t* graph, node_t* node, transform_arguments_t* args) {
+    if (unlikely(!fits_bitboard(graph))) {
+        return false;
+    }
     dcoord_t delta = deltas[args->direction];
-    int max_range = graph->width > graph->height ? graph->width : graph->height;
-    subnode_block_t block = {NULL};
-    int n_new_subnodes = 0;
-    subnode_block_t* new_subnodes = new_subnode_block(graph);
-    for (int i = 0; i < node->n_subnodes; i++) {
-        subnode_t subnode = get_subnode(node, i);
-        coordinate_t new_coord = subnode.coord;
-        for (int r = 0; r < max_range; r++) {
-            bool added = add_subnode_to_block(
-                graph, new_subnodes, (subnode_t){new_coord, subnode.color}, &n_new_subnodes);
-            assert(added);
-            new_coord.pri += delta.dx;
-            new_coord.sec += delta.dy;
-            block.subnode[0] = new_coord;
-            if (!check_bounds(graph, new_coord)) {
-                // stop at edge of image
-                break;
-            } else if (!args->overlap && !check_collision(graph, node, &block, 1)) {
-                // stop when colliding
-                break;
-            }
+    bitboard_t free;
+    bounds_bitboard(graph, &free);
+    if (!args->overlap) {
+        bitboard_t others;
+        graph_bitboard(graph, node, &others);
+        and_not_bitboard(&free, &others);
+    }
+
+    // existing pixels keep their place; colors are extended in ascending order, so where the rays
+    // of several colors overlap the new pixel takes the lowest color
+    bitboard_t written, extended[10];
+    int n_extended = 0;
+    node_bitboard(node, -1, &written);
+    int colors = node_colors(node);
+    for (int color = 0; color < 10; color++) {
+        clear_bitboard(&extended[color]);
+        if (!(colors & (1 << color))) {
+            continue;
         }
+        bitboard_t front;
+        node_bitboard(node, color, &front);
+        while (!is_empty_bitboard(&front)) {
+            shift_bitboard(&front, delta.dx, delta.dy, &front);
+            and_bitboard(&front, &free);
+            or_bitboard(&extended[color], &front);
+        }
+        and_not_bitboard(&extended[color], &written);
+        or_bitboard(&written, &extended[color]);
+        n_extended += count_bitboard(&extended[color]);
+    }
+
+    if (unlikely(!reserve_subnodes(graph, node, node->n_subnodes + n_extended))) {
+        return false;
+    }
+    for (int color = 0; color < 10; color++) {
+        append_bitboard(graph, node, &extended[color], color);
     }
-    set_subnodes(graph, node, new_subnodes, n_new_subnodes);
     return true;
 }
 
@@ -174,36 +167,35 @@ bool extend_node(graph_t* graph, node_t* node, transform_arguments_t* args) {
  * move node in a given direction until it hits another node or the edge of the image
  */
 bool move_node_max(graph_t* graph, node_t* node, transform_arguments_t* args) {
+    if (unlikely(!fits_bitboard(graph))) {
+        return false;
+    }
     dcoord_t delta = deltas[args->direction];
-    subnode_block_t block = {NULL};
+    bitboard_t pixels, free;
+    if (!node_bitboard(node, -1, &pixels)) {
+        return false;
+    }
+    bounds_bitboard(graph, &free);
+    bitboard_t others;
+    graph_bitboard(graph, node, &others);
+    and_not_bitboard(&free, &others);
+
+    // the first distance at which a pixel leaves the free area
+    int n_pixels = count_bitboard(&pixels);
     int n = 0;
     for (; n < 1000; n++) {
-        bool hit = false;
-        for (int i = 0; !hit && i < node->n_subnodes; i++) {
-            subnode_t subnode = get_subnode(node, i);
-            coordinate_t new_coord = subnode.coord;
-            new_coord.pri += n * delta.dx;
-            new_coord.sec += n * delta.dy;
-            block.subnode[0] = new_coord;
-            if (!check_bounds(graph, new_coord) || !check_collision(graph, node, &block, 1)) {
-                hit = true;
-                break;
-            }
-        }
-        if (hit) {
-            n--;
+        bitboard_t moved;
+        shift_bitboard(&pixels, n * delta.dx, n * delta.dy, &moved);
+        and_bitboard(&moved, &free);
+        if (count_bitboard(&moved) < n_pixels) {
             break;
         }
     }
+    n--;
     if (n <= 0) {
         return false;
     }
-    for (int i = 0; i < node->n_subnodes; i++) {
-        subnode_t subnode = get_subnode(node, i);
-        subnode.coord.pri += n * delta.dx;
-        subnode.coord.sec += n * delta.dy;
-        set_subnode(node, i, subnode);
-    }
+    translate_node(node, n * delta.dx, n * delta.dy);
     return true;
 }
 
@@ -213,8 +205,8 @@ bool move_node_max(graph_t* graph, node_t* node, transform_arguments_t* args) {
 bool rotate_node(graph_t* graph, node_t* node, transform_arguments_t* args) {
     int* r = rotations[args->rotation_dir];
     int sum_x = 0, sum_y = 0;
-    for (int i = 0; i < node->n_subnodes; i++) {
-        const subnode_t subnode = get_subnode(node, i);
+    for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+        const subnode_t subnode = next_subnode(&iter);
         sum_x += subnode.coord.pri;
         sum_y += subnode.coord.sec;
     }
@@ -246,130 +238,49 @@ bool rotate_node(graph_t* graph, node_t* node, transform_arguments_t* args) {
  * add a border with thickness 1 and border_color around the given node
  */
 bool add_border(graph_t* graph, node_t* node, transform_arguments_t* args) {
-    int size = bitset_size(graph);
-    long bitset[size];
-    for (int i = 0; i < size; i++) {
-        bitset[i] = 0;
-    }
-    int max_pri = -1;
-    for (const node_t* other = graph->nodes; other; other = other->next) {
-        if (other->coord.pri > max_pri) {
-            max_pri = other->coord.pri;
-        }
-        subnode_iter_t iter;
-        for (coordinate_t coord = init_subnode_iter(&iter, other->subnodes, other->n_subnodes);
-             is_valid_subnode(&iter);
-             coord = next_coordinate(&iter)) {
-            add_coordinate(graph, bitset, coord);
-        }
-    }
-
-    color_t color = get_color(graph, args->color);
-    int n_new_subnodes = 0;
-    subnode_block_t* new_subnodes = new_subnode_block(graph);
-    for (int i = 0; i < node->n_subnodes; i++) {
-        subnode_t subnode = get_subnode(node, i);
-        for (int dx = -1; dx <= 1; dx++) {
-            for (int dy = -1; dy <= 1; dy++) {
-                coordinate_t coord = {
-                    subnode.coord.pri + dx,
-                    subnode.coord.sec + dy,
-                };
-                if (!check_bounds(graph, coord) || coordinate_in_set(graph, bitset, coord)) {
-                    continue;
-                }
-                add_coordinate(graph, bitset, coord);
-                bool added = add_subnode_to_block(
-                    graph, new_subnodes, (subnode_t){coord, color}, &n_new_subnodes);
-                if (!added) {
-                    goto fail;
-                }
-            }
-        }
+    if (unlikely(!fits_bitboard(graph))) {
+        return false;
     }
-    if (n_new_subnodes > 0) {
-        node_t* new_node = add_node(graph, (coordinate_t){max_pri + 1, 0}, 0);
-        if (new_node) {
-            set_subnodes(graph, new_node, new_subnodes, n_new_subnodes);
-            return true;
-        }
+    bitboard_t pixels, border, occupied;
+    node_bitboard(node, -1, &pixels);
+    dilate_bitboard(&pixels, &border);
+    bitboard_t bounds;
+    bounds_bitboard(graph, &bounds);
+    and_bitboard(&border, &bounds);
+    graph_bitboard(graph, NULL, &occupied);
+    and_not_bitboard(&border, &occupied);
+    if (is_empty_bitboard(&border)) {
+        return false;
     }
-
-fail:
-    free_subnode_block(graph, new_subnodes);
-    return false;
+    return add_bitboard_node(graph, &border, get_color(graph, args->color));
 }
 
 bool fill_rectangle(graph_t* graph, node_t* node, transform_arguments_t* args) {
-    color_t color = get_color(graph, args->color);
-    bool overlap = args->overlap;
-
-    int size = bitset_size(graph);
-    long bitset[size];
-    for (int i = 0; i < size; i++) {
-        bitset[i] = 0;
-    }
-    int max_pri = -1;
-    for (const node_t* other = graph->nodes; other; other = other->next) {
-        if (other->coord.pri > max_pri) {
-            max_pri = other->coord.pri;
-        }
-        // always add pixels for node itself, when overlap is not allowed add others too
-        if (other == node || !overlap) {
-            subnode_iter_t iter;
-            for (coordinate_t coord =
-                     init_subnode_iter(&iter, other->subnodes, other->n_subnodes);
-                 is_valid_subnode(&iter);
-                 coord = next_coordinate(&iter)) {
-                add_coordinate(graph, bitset, coord);
-            }
-        }
+    if (unlikely(!fits_bitboard(graph))) {
+        return false;
     }
-
-    int min_x = graph->width, max_x = 0, min_y = graph->height, max_y = 0;
-    for (int i = 0; i < node->n_subnodes; i++) {
-        subnode_t subnode = get_subnode(node, i);
-        if (subnode.coord.pri < min_x) {
-            min_x = subnode.coord.pri;
-        }
-        if (subnode.coord.pri > max_x) {
-            max_x = subnode.coord.pri;
-        }
-        if (subnode.coord.sec < min_y) {
-            min_y = subnode.coord.sec;
-        }
-        if (subnode.coord.sec > max_y) {
-            max_y = subnode.coord.sec;
-        }
+    // nodes outside of the image can't be rendered anyway
+    bitboard_t pixels, bounds;
+    coordinate_t min, max;
+    bounds_bitboard(graph, &bounds);
+    if (!node_bitboard(node, -1, &pixels) || !bitboard_bounding_box(&pixels, &min, &max)) {
+        return false;
     }
 
-    int n_new_subnodes = 0;
-    subnode_block_t* new_subnodes = new_subnode_block(graph);
-    for (int x = min_x; x <= max_x; x++) {
-        for (int y = min_y; y <= max_y; y++) {
-            coordinate_t coord = {x, y};
-            if (coordinate_in_set(graph, bitset, coord)) {
-                continue;
-            }
-            bool added = add_subnode_to_block(
-                graph, new_subnodes, (subnode_t){coord, color}, &n_new_subnodes);
-            if (!added) {
-                goto fail;
-            }
-        }
+    // always exclude pixels of node itself, when overlap is not allowed exclude others too
+    bitboard_t fill, occupied;
+    rectangle_bitboard(min, max, &fill);
+    and_bitboard(&fill, &bounds);
+    if (args->overlap) {
+        occupied = pixels;
+    } else {
+        graph_bitboard(graph, NULL, &occupied);
     }
-
-    if (n_new_subnodes > 0) {
-        node_t* new_node = add_node(graph, (coordinate_t){max_pri + 1, 0}, 0);
-        if (new_node) {
-            set_subnodes(graph, new_node, new_subnodes, n_new_subnodes);
-            return true;
-        }
+    and_not_bitboard(&fill, &occupied);
+    if (is_empty_bitboard(&fill)) {
+        return false;
     }
-
-fail:
-    free_subnode_block(graph, new_subnodes);
-    return false;
+    return add_bitboard_node(graph, &fill, get_color(graph, args->color));
 }
 
 transform_func_t transformations[] = {
@@ -387,27 +298,33 @@ transform_func_t transformations[] = {
         .func = extend_node,
         .direction = true,
         .overlap = true,
+        .bitboard = true,
         .name = "extend_node",
     },
     {
         .func = move_node_max,
         .direction = true,
+        .bitboard = true,
         .name = "move_node_max",
     },
     {
         .func = rotate_node,
         .rotation_dir = true,
+        .min_size = 2,
         .name = "rotate_node",
     },
     {
         .func = add_border,
         .color = true,
+        .bitboard = true,
         .name = "add_border",
     },
     {
         .func = fill_rectangle,
         .color = true,
         .overlap = true,
+        .bitboard = true,
+        .min_size = 2,
         .name = "fill_rectangle",
     },
     {
@@ -416,10 +333,10 @@ transform_func_t transformations[] = {
 };
 
 bool get_relative_pos(const node_t* node, const node_t* other, direction_t* direction) {
-    for (int i = 0; i < node->n_subnodes; i++) {
-        subnode_t sub_node = get_subnode(node, i);
-        for (int j = 0; j < other->n_subnodes; j++) {
-            subnode_t sub_other = get_subnode(other, j);
+    for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+        subnode_t sub_node = next_subnode(&iter);
+        for (subnode_iter_t other_iter = subnodes_of(other); has_subnode(&other_iter);) {
+            subnode_t sub_other = next_subnode(&other_iter);
             if (sub_node.coord.pri == sub_other.coord.pri) {
                 if (sub_node.coord.sec < sub_other.coord.sec) {
                     *direction = RIGHT;
@@ -445,8 +362,8 @@ bool get_relative_pos(const node_t* node, const node_t* other, direction_t* dire
 coordinate_t get_centroid(const node_t* node) {
     int sum_pri = node->n_subnodes / 2;
     int sum_sec = node->n_subnodes / 2;
-    for (int i = 0; i < node->n_subnodes; i++) {
-        subnode_t subnode = get_subnode(node, i);
+    for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter);) {
+        subnode_t subnode = next_subnode(&iter);
         sum_pri += subnode.coord.pri;
         sum_sec += subnode.coord.sec;
     }
@@ -492,7 +409,7 @@ bool apply_binding(
     transform_arguments_t* args) {
     if (dynamic->color) {
         binding_call_t* binding = dynamic->color;
-        node_t* target = get_binding_node(graph, node, binding);
+        node_t* target = resolve_binding(graph, node, binding);
         if (target) {
             args->color = get_subnode(target, 0).color;
         } else {
@@ -501,14 +418,14 @@ bool apply_binding(
     }
     if (dynamic->direction) {
         binding_call_t* binding = dynamic->direction;
-        node_t* target = get_binding_node(graph, node, binding);
+        node_t* target = resolve_binding(graph, node, binding);
         if (!target || !get_relative_pos(node, target, &args->direction)) {
             return false;
         }
     }
     if (dynamic->mirror_axis) {
         binding_call_t* binding = dynamic->mirror_axis;
-        node_t* target = get_binding_node(graph, node, binding);
+        node_t* target = resolve_binding(graph, node, binding);
         if (target) {
             args->mirror_axis = get_mirror_axis(node, target);
         } else {
@@ -591,20 +508,53 @@ void init_transform(guide_builder_t* builder) {
     add_choice(builder, 2, "transform:overlap");
 }
 
+// bit per transformation that can change some node selected by the filter
+long applicable_transforms(const graph_t* graph, const filter_call_t* filter) {
+    const node_table_t* table = get_node_table(graph);
+    unsigned long matches[NODE_MASK_WORDS(table->n_nodes)];
+    if (!apply_filter_batch(table, filter, matches)) {
+        return 0;
+    }
+    int max_size = 0;
+    for (int idx = 0; idx < table->n_nodes; idx++) {
+        if (is_node_matched(matches, idx) && table->size[idx] > max_size) {
+            max_size = table->size[idx];
+        }
+    }
+    long valid = 0;
+    for (int i_func = 0; transformations[i_func].func; i_func++) {
+        const transform_func_t* func = &transformations[i_func];
+        if ((!func->bitboard || fits_bitboard(graph)) && max_size >= func->min_size) {
+            valid |= 1l << i_func;
+        }
+    }
+    return valid;
+}
+
 transform_call_t* sample_transform(
     task_t* task, const graph_t* graph, filter_call_t* filter, trail_t** p_trail) {
     transform_call_t* call = new_item(task->_mem_transform_calls);
+    call->dynamic = (transform_dynamic_arguments_t){NULL};
     trail_t* trail = *p_trail;
 
     const categorical_t* func_dist = next_choice(trail);
-    int i_func = choose(func_dist);
+    long valid_funcs = applicable_transforms(graph, filter);
+    if (!valid_funcs) {
+        task->rejections.transform++;
+        goto fail;
+    }
+    int i_func = choose_from(func_dist, valid_funcs);
     transform_func_t* func = &transformations[i_func];
     call->transform = func;
     trail = observe_choice(trail, i_func);
 
+    // the first value of color and direction is dynamic, which needs a binding that can resolve
+    long dynamic = (func->color || func->direction) && get_binding_funcs(graph, filter);
+
     const categorical_t* color_dist = next_choice(trail);
     if (call->transform->color) {
-        int i_color = choose(color_dist);
+        long valid = ((1l << transform_argument_values.n_color) - 2) | dynamic;
+        int i_color = choose_from(color_dist, valid);
         trail = observe_choice(trail, i_color);
         if (i_color == 0) {
             binding_call_t* binding = sample_binding(task, graph, filter, &trail);
@@ -623,7 +573,8 @@ transform_call_t* sample_transform(
 
     const categorical_t* direction_dist = next_choice(trail);
     if (call->transform->direction) {
-        int i_direction = choose(direction_dist);
+        long valid = ((1l << transform_argument_values.n_direction) - 2) | dynamic;
+        int i_direction = choose_from(direction_dist, valid);
         trail = observe_choice(trail, i_direction);
         if (i_direction == 0) {
             binding_call_t* binding = sample_binding(task, graph, filter, &trail);
@@ -676,6 +627,62 @@ fail:
     return NULL;
 }
 
+int enumerate_transforms(
+    binding_call_t* bindings,
+    int n_bindings,
+    bool dynamic,
+    transform_call_t* calls,
+    int max_calls) {
+    // the first n_bindings values of color and direction are dynamic, then the static ones
+    int n_calls = 0;
+    for (int i_func = 0; transformations[i_func].func; i_func++) {
+        const transform_func_t* func = &transformations[i_func];
+        int n_color = func->color ? n_bindings + transform_argument_values.n_color - 1 : 1;
+        int n_direction =
+            func->direction ? n_bindings + transform_argument_values.n_direction - 1 : 1;
+        int n_rotation = func->rotation_dir ? transform_argument_values.n_rotation : 1;
+        int n_overlap = func->overlap ? transform_argument_values.n_overlap : 1;
+        for (int i_color = 0; i_color < n_color; i_color++) {
+            bool dynamic_color = func->color && i_color < n_bindings;
+            for (int i_direction = 0; i_direction < n_direction; i_direction++) {
+                bool dynamic_direction = func->direction && i_direction < n_bindings;
+                if (dynamic != (dynamic_color || dynamic_direction)) {
+                    continue;
+                }
+                for (int i_rotation = 0; i_rotation < n_rotation; i_rotation++) {
+                    for (int i_overlap = 0; i_overlap < n_overlap; i_overlap++) {
+                        if (n_calls == max_calls) {
+                            return n_calls;
+                        }
+                        transform_call_t* call = &calls[n_calls++];
+                        *call = (transform_call_t){.transform = func};
+                        if (dynamic_color) {
+                            call->dynamic.color = &bindings[i_color];
+                        } else if (func->color) {
+                            call->arguments.color =
+                                transform_argument_values.color[i_color - n_bindings + 1];
+                        }
+                        if (dynamic_direction) {
+                            call->dynamic.direction = &bindings[i_direction];
+                        } else if (func->direction) {
+                            call->arguments.direction =
+                                transform_argument_values.direction[i_direction - n_bindings + 1];
+                        }
+                        if (func->rotation_dir) {
+                            call->arguments.rotation_dir =
+                                transform_argument_values.rotation[i_rotation];
+                        }
+                        if (func->overlap) {
+                            call->arguments.overlap = transform_argument_values.overlap[i_overlap];
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return n_calls;
+}
+
 trail_t* observe_transform(trail_t* trail, const transform_call_t* call) {
     /* const categorical_t* func_dist = */ next_choice(trail);
     transform_func_t* func;
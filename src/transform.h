@@ -97,6 +97,10 @@ typedef struct _transform_func {
     bool object_id;
     bool point;
     bool relative_pos;
+    // works on bitboards, so the graph has to fit one
+    bool bitboard;
+    // pixels that a selected node needs for the transformation to change anything
+    int min_size;
     const char * name;
 } transform_func_t;
 
@@ -116,6 +120,19 @@ void init_transform(guide_builder_t* guide);
 transform_call_t* sample_transform(
     task_t* task, const graph_t* graph, filter_call_t* filter, trail_t** p_trail);
 
+/**
+ * All transform calls over the argument values of init_transform, in a fixed
+ * order.  Dynamic arguments take each of the bindings in turn; when dynamic is
+ * set only the calls that use at least one binding are stored.  Stores at most
+ * max_calls and returns the number stored.
+ */
+int enumerate_transforms(
+    binding_call_t* bindings,
+    int n_bindings,
+    bool dynamic,
+    transform_call_t* calls,
+    int max_calls);
+
 trail_t* observe_transform(trail_t* trail, const transform_call_t* call);
 
 void free_transform(task_t * task, transform_call_t * call);
@@ -6,6 +6,11 @@ extern bool test_filter();
 extern bool test_transform();
 extern bool test_mem();
 extern bool test_io();
+extern bool test_program();
+extern bool test_raster();
+extern bool test_sample_log();
+extern bool test_search();
+extern bool test_guide();
 
 int main() {
     bool result = true;
@@ -16,6 +21,11 @@ int main() {
         result &= test_transform();
         result &= test_mem();
         result &= test_io();
+        result &= test_program();
+        result &= test_raster();
+        result &= test_sample_log();
+        result &= test_search();
+        result &= test_guide();
     // }
     if (result) {
         return 0;
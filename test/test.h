@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "raster.h"
+#include "task.h"
+
 #define ASSERT(stmt, msg)                      \
     if (!(stmt)) {                             \
         printf("%s (line %d)", msg, __LINE__); \
@@ -32,3 +35,9 @@
             return false;               \
         }                               \
     }
+
+// a raster of the given dimensions with a copy of the pixels
+raster_t* raster_from(const color_t* pixels, int width, int height);
+
+// a task that recolors the blue (1) component to red (2), with two train examples and a test one
+task_t* recolor_task();
@@ -1,6 +1,8 @@
+#include "binding.h"
 #include "filter.h"
 #include "graph.h"
 #include "image.h"
+#include "io.h"
 #include "test.h"
 #include "transform.h"
 
@@ -10,6 +12,29 @@ extern bool filter_by_size(
     const graph_t* graph, const node_t* node, const filter_arguments_t* args);
 extern bool filter_by_degree(
     const graph_t* graph, const node_t* node, const filter_arguments_t* args);
+extern long matching_excludes(const graph_t* graph, filter_call_t* call);
+extern long matching_colors(const graph_t* graph, filter_call_t* call);
+extern long resolving_excludes(
+    const graph_t* graph, const filter_call_t* filter, binding_call_t* call);
+extern long resolving_colors(
+    const graph_t* graph, const filter_call_t* filter, binding_call_t* call);
+extern long applicable_transforms(const graph_t* graph, const filter_call_t* filter);
+
+// the argument values are set up while adding the choices to a guide
+static guide_builder_t builder = {NULL};
+
+static void init_arguments() {
+    if (!builder.items) {
+        init_guide(&builder);
+        init_filter(&builder);
+        init_binding(&builder);
+    }
+}
+
+// the values of the last arguments, in the order of init_filter and init_binding
+static const bool exclude_values[] = {true, false};
+static const color_t color_values[] = {
+    MOST_COMMON_COLOR, LEAST_COMMON_COLOR, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
 
 BEGIN_TEST(test_filter_by_color) {
     color_t grid[] = {2, 2, 1, 1};
@@ -66,9 +91,9 @@ END_TEST()
 
 BEGIN_TEST(test_filter_by_size) {
     color_t grid[] = {2, 2, 0, 1};
-    graph_t* graph = graph_from_grid(grid, 2, 2);
+    grid_t pixels = {.width = 2, .height = 2, .pixels = grid};
 
-    graph_t* connected = get_connected_components_graph(graph);
+    graph_t* connected = get_connected_components_graph(&pixels);
     ASSERT(connected->n_nodes == 3, "incorrect number of components");
 
     filter_arguments_t args = {
@@ -93,15 +118,14 @@ BEGIN_TEST(test_filter_by_size) {
     ASSERT(matches, "node does not match");
 
     free_graph(connected);
-    free_graph(graph);
 }
 END_TEST()
 
 BEGIN_TEST(test_filter_by_degree) {
     color_t grid[] = {2, 2, 0, 1};
-    graph_t* graph = graph_from_grid(grid, 2, 2);
+    grid_t pixels = {.width = 2, .height = 2, .pixels = grid};
 
-    graph_t* connected = get_connected_components_graph(graph);
+    graph_t* connected = get_connected_components_graph(&pixels);
     ASSERT(connected->n_nodes == 3, "incorrect number of components");
 
     filter_arguments_t args = {
@@ -113,6 +137,259 @@ BEGIN_TEST(test_filter_by_degree) {
     ASSERT(matches, "node does not match");
 
     free_graph(connected);
+}
+END_TEST()
+
+BEGIN_TEST(test_apply_filter_batch) {
+    const char* source = read_task("007bbfb7.json");
+    task_t* task = parse_task(source);
+    free((char*)source);
+
+    int sizes[] = {MAX_SIZE, MIN_SIZE, ODD_SIZE, 1, 2, 3, 5};
+    color_t colors[] = {MOST_COMMON_COLOR, LEAST_COMMON_COLOR, 0, 2, 7};
+    for (int i_abstraction = 0; abstractions[i_abstraction].func; i_abstraction++) {
+        graph_t* graph = abstractions[i_abstraction].func(&task->train_input[0]);
+        const node_table_t* table = get_node_table(graph);
+        ASSERT(table->n_nodes == graph->n_nodes, "incorrect number of nodes");
+        for (int i_func = 0; filter_funcs[i_func].func; i_func++) {
+            for (int i_arg = 0; i_arg < 7; i_arg++) {
+                for (int exclude = 0; exclude < 2; exclude++) {
+                    filter_call_t call = {
+                        .filter = &filter_funcs[i_func],
+                        .args =
+                            {
+                                .size = sizes[i_arg],
+                                .degree = sizes[i_arg],
+                                .exclude = exclude,
+                                .color = colors[i_arg % 5],
+                            },
+                    };
+                    unsigned long matches[NODE_MASK_WORDS(table->n_nodes)];
+                    int n_matches = apply_filter_batch(table, &call, matches);
+                    int n_expected = 0;
+                    for (int idx = 0; idx < table->n_nodes; idx++) {
+                        bool expected = apply_filter(graph, table->nodes[idx], &call);
+                        ASSERT(is_node_matched(matches, idx) == expected, "batch differs");
+                        n_expected += expected;
+                    }
+                    ASSERT(n_matches == n_expected, "incorrect number of matches");
+                }
+            }
+        }
+        free_graph(graph);
+    }
+    free_task(task);
+}
+END_TEST()
+
+BEGIN_TEST(test_compiled_filter_chain) {
+    const char* source = read_task("007bbfb7.json");
+    task_t* task = parse_task(source);
+    free((char*)source);
+
+    graph_t* graph = get_connected_components_graph(&task->train_input[0]);
+    const node_table_t* table = get_node_table(graph);
+    filter_call_t calls[] = {
+        {.filter = &filter_funcs[1], .args = {.size = ODD_SIZE, .exclude = true}},
+        {.filter = &filter_funcs[5], .args = {.degree = 2, .exclude = false}},
+        {.filter = &filter_funcs[0], .args = {.color = 7, .exclude = false}},
+    };
+    for (int n_calls = 1; n_calls <= 3; n_calls++) {
+        for (int i = 0; i < n_calls - 1; i++) {
+            calls[i].next_in_multi = &calls[i + 1];
+        }
+        calls[n_calls - 1].next_in_multi = NULL;
+
+        compiled_filter_t compiled;
+        compile_filter(table, &calls[0], &compiled);
+        ASSERT(compiled.n_terms == n_calls, "incorrect number of terms");
+        ASSERT(n_calls < 3 || compiled.terms[0].column == table->colors, "color is not first");
+        ASSERT(n_calls < 2 || compiled.terms[n_calls - 1].neighbor, "neighbor is not last");
+
+        unsigned long matches[NODE_MASK_WORDS(table->n_nodes)];
+        run_filter(&compiled, matches);
+        for (int idx = 0; idx < table->n_nodes; idx++) {
+            bool expected = apply_filter(graph, table->nodes[idx], &calls[0]);
+            ASSERT(is_node_matched(matches, idx) == expected, "compiled filter differs");
+        }
+    }
+    free_graph(graph);
+    free_task(task);
+}
+END_TEST()
+
+BEGIN_TEST(test_resolve_binding) {
+    const char* source = read_task("007bbfb7.json");
+    task_t* task = parse_task(source);
+    free((char*)source);
+
+    graph_t* graph = get_connected_components_graph(&task->train_input[0]);
+    binding_arguments_t args[] = {
+        {.size = MAX_SIZE, .degree = MIN_SIZE, .exclude = false, .color = 7},
+        {.size = 1, .degree = 2, .exclude = true, .color = 0},
+    };
+    for (int repeat = 0; repeat < 2; repeat++) {
+        for (int i_func = 0; binding_funcs[i_func].func; i_func++) {
+            for (size_t i_args = 0; i_args < sizeof(args) / sizeof(args[0]); i_args++) {
+                binding_call_t call = {.binding = &binding_funcs[i_func], .args = args[i_args]};
+                for (node_t* node = graph->nodes; node; node = node->next) {
+                    ASSERT(
+                        resolve_binding(graph, node, &call) == get_binding_node(graph, node, &call),
+                        "resolved binding differs");
+                }
+            }
+        }
+    }
+
+    int n_memos = 0;
+    for (node_memo_t* memo = get_node_table(graph)->_memos; memo; memo = memo->next) {
+        n_memos++;
+    }
+    ASSERT(n_memos == 8, "bindings are not memoized once per call");
+
+    free_graph(graph);
+    free_task(task);
+}
+END_TEST()
+
+BEGIN_TEST(test_binding_funcs) {
+    int n_funcs = 0;
+    while (binding_funcs[n_funcs].func) {
+        n_funcs++;
+    }
+
+    // a single pixel has no neighbors, only global bindings can resolve
+    color_t grid[] = {3};
+    graph_t* graph = graph_from_grid(grid, 1, 1);
+    filter_call_t call = {
+        .filter = &filter_funcs[0],
+        .args = {.exclude = false, .color = 3},
+    };
+    long valid = get_binding_funcs(graph, &call);
+    for (int i_func = 0; i_func < n_funcs; i_func++) {
+        ASSERT(((valid >> i_func) & 1) == binding_funcs[i_func].global, "incorrect binding mask");
+    }
+    free_graph(graph);
+
+    const char* source = read_task("007bbfb7.json");
+    task_t* task = parse_task(source);
+    free((char*)source);
+    graph = get_connected_components_graph(&task->train_input[0]);
+    call.args.color = 7;
+    ASSERT(get_binding_funcs(graph, &call) == (1l << n_funcs) - 1, "binding funcs are masked");
+    free_graph(graph);
+    free_task(task);
+}
+END_TEST()
+
+BEGIN_TEST(test_argument_masks) {
+    init_arguments();
+    const char* source = read_task("007bbfb7.json");
+    task_t* task = parse_task(source);
+    free((char*)source);
+
+    // the masks derived from the node table agree with evaluating every value
+    int sizes[] = {MAX_SIZE, MIN_SIZE, ODD_SIZE, 1, 2, 3, 5};
+    for (int i_abstraction = 0; abstractions[i_abstraction].func; i_abstraction++) {
+        graph_t* graph = abstractions[i_abstraction].func(&task->train_input[0]);
+        for (int i_func = 0; filter_funcs[i_func].func; i_func++) {
+            for (int i_arg = 0; i_arg < 7; i_arg++) {
+                filter_call_t call = {
+                    .filter = &filter_funcs[i_func],
+                    .args = {.size = sizes[i_arg], .degree = sizes[i_arg]},
+                };
+                // the color is the last argument of a color filter, else exclude is
+                bool color = filter_funcs[i_func].color;
+                long excludes = color ? 0 : matching_excludes(graph, &call);
+                for (int i = 0; i < 2; i++) {
+                    call.args.exclude = exclude_values[i];
+                    ASSERT(color || ((excludes >> i) & 1) == filter_matches(graph, &call),
+                           "incorrect exclude mask");
+
+                    filter_call_t color_call = call;
+                    long colors = color ? matching_colors(graph, &color_call) : 0;
+                    for (int j = 0; color && j < 12; j++) {
+                        call.args.color = color_values[j];
+                        ASSERT(((colors >> j) & 1) == filter_matches(graph, &call),
+                               "incorrect color mask");
+                    }
+                }
+            }
+        }
+
+        filter_call_t filters[] = {
+            {.filter = &filter_funcs[0], .args = {.color = 7}},
+            {.filter = &filter_funcs[1], .args = {.size = MAX_SIZE}},
+            {.filter = &filter_funcs[0], .args = {.color = 3}},
+        };
+        for (int i_filter = 0; i_filter < 3; i_filter++) {
+            for (int i_func = 0; binding_funcs[i_func].func; i_func++) {
+                for (int i_arg = 0; i_arg < 7; i_arg++) {
+                    binding_call_t call = {
+                        .binding = &binding_funcs[i_func],
+                        .args = {.size = sizes[i_arg], .degree = sizes[i_arg]},
+                    };
+                    bool color = binding_funcs[i_func].color;
+                    long excludes =
+                        color ? 0 : resolving_excludes(graph, &filters[i_filter], &call);
+                    for (int i = 0; i < 2; i++) {
+                        call.args.exclude = exclude_values[i];
+                        bool matches = binding_matches(graph, &filters[i_filter], &call);
+                        ASSERT(color || ((excludes >> i) & 1) == matches,
+                               "incorrect binding exclude mask");
+
+                        binding_call_t color_call = call;
+                        long colors =
+                            color ? resolving_colors(graph, &filters[i_filter], &color_call) : 0;
+                        for (int j = 0; color && j < 12; j++) {
+                            call.args.color = color_values[j];
+                            matches = binding_matches(graph, &filters[i_filter], &call);
+                            ASSERT(((colors >> j) & 1) == matches, "incorrect binding color mask");
+                        }
+                    }
+                }
+            }
+        }
+        free_graph(graph);
+    }
+
+    // without nodes, no value selects any
+    graph_t* empty = new_graph(3, 3);
+    filter_call_t call = {.filter = &filter_funcs[0]};
+    ASSERT(!matching_colors(empty, &call), "color selects a node of an empty graph");
+    call.filter = &filter_funcs[1];
+    ASSERT(!matching_excludes(empty, &call), "size selects a node of an empty graph");
+    free_graph(empty);
+    free_task(task);
+}
+END_TEST()
+
+BEGIN_TEST(test_applicable_transforms) {
+    // a pixel: nothing to rotate or fill
+    color_t grid[] = {3, 0, 0, 0};
+    grid_t pixels = {.width = 2, .height = 2, .pixels = grid};
+    graph_t* graph = get_connected_components_graph_background_removed(&pixels);
+    filter_call_t call = {.filter = &filter_funcs[0], .args = {.color = 3}};
+    long valid = applicable_transforms(graph, &call);
+    for (int i_func = 0; transformations[i_func].func; i_func++) {
+        ASSERT(((valid >> i_func) & 1) == (transformations[i_func].min_size <= 1),
+               "incorrect transform mask for a pixel");
+    }
+    call.args.color = 5;
+    ASSERT(applicable_transforms(graph, &call) == 0, "transform without a selected node");
+    free_graph(graph);
+
+    // larger than a bitboard: only transformations that work on the nodes
+    color_t large[40 * 40] = {0};
+    large[0] = large[1] = 3;
+    pixels = (grid_t){.width = 40, .height = 40, .pixels = large};
+    graph = get_connected_components_graph_background_removed(&pixels);
+    call.args.color = 3;
+    valid = applicable_transforms(graph, &call);
+    for (int i_func = 0; transformations[i_func].func; i_func++) {
+        ASSERT(((valid >> i_func) & 1) == !transformations[i_func].bitboard,
+               "incorrect transform mask for a large graph");
+    }
     free_graph(graph);
 }
 END_TEST()
@@ -122,4 +399,10 @@ DEFINE_SUITE(test_filter, ({
               RUN_TEST(test_filter_by_size);
               RUN_TEST(test_filter_by_degree);
               RUN_TEST(test_filter_by_derived_colors);
+              RUN_TEST(test_apply_filter_batch);
+              RUN_TEST(test_compiled_filter_chain);
+              RUN_TEST(test_resolve_binding);
+              RUN_TEST(test_binding_funcs);
+              RUN_TEST(test_argument_masks);
+              RUN_TEST(test_applicable_transforms);
           }))
\ No newline at end of file
@@ -51,15 +51,98 @@ BEGIN_TEST(test_mutate_graph) {
 }
 END_TEST()
 
+BEGIN_TEST(test_remove_nodes) {
+    color_t grid[30 * 30] = {0};
+    graph_t* graph = graph_from_grid(grid, 30, 30);
+    ASSERT(graph->_edges_available < EDGES_ALLOC, "no edges added");
+
+    node_t* node = get_node(graph, (coordinate_t){10, 10});
+    ASSERT(node->n_edges == 4, "incorrect degree");
+    for (const edge_t* edge = node->edges; edge; edge = edge->next) {
+        const edge_t* partner = edge_partner(edge);
+        ASSERT(partner->peer == node && edge_partner(partner) == edge, "incorrect partner");
+    }
+    remove_edge(graph, node->edges);
+    ASSERT(node->n_edges == 3, "edge not removed");
+
+    // remove every other node, then the rest
+    for (int pass = 0; pass < 2; pass++) {
+        for (int x = 0; x < 30; x++) {
+            for (int y = (x + pass) % 2; y < 30; y += 2) {
+                remove_node(graph, get_node(graph, (coordinate_t){x, y}));
+            }
+        }
+    }
+    ASSERT(graph->n_nodes == 0 && !graph->nodes, "nodes not removed");
+    ASSERT(graph->_nodes_available == NODES_ALLOC, "nodes not freed");
+    ASSERT(graph->_edges_available == EDGES_ALLOC, "edges not freed");
+
+    // freed edges are handed out again as pairs
+    node_t* from = add_node(graph, (coordinate_t){0, 0}, 0);
+    node_t* to = add_node(graph, (coordinate_t){1, 0}, 0);
+    edge_t* edge = add_edge(graph, from, to, EDGE_HORIZONTAL);
+    ASSERT(edge_partner(edge) == to->edges && has_edge(to, from), "incorrect edge pair");
+
+    free_graph(graph);
+}
+END_TEST()
+
+BEGIN_TEST(test_subnode_storage) {
+    graph_t* graph = new_graph(30, 30);
+    node_t* node = add_node(graph, (coordinate_t){0, 0}, 0);
+    for (int i = 0; i < 100; i++) {
+        ASSERT(append_subnode(graph, node, (subnode_t){{i % 30, i / 30}, i % 10}), "append failed");
+    }
+    ASSERT(graph->_subnodes_used == node->_subnodes_capacity, "last node not grown in place");
+
+    // growing a node that is not the last allocation moves its subnodes
+    node_t* other = add_node(graph, (coordinate_t){1, 0}, 1);
+    set_subnode(other, 0, (subnode_t){{0, 0}, 1});
+    for (int i = 100; i < 200; i++) {
+        ASSERT(append_subnode(graph, node, (subnode_t){{i % 30, i / 30}, i % 10}), "append failed");
+    }
+
+    int n_subnodes = 0;
+    for (subnode_iter_t iter = subnodes_of(node); has_subnode(&iter); n_subnodes++) {
+        subnode_t subnode = next_subnode(&iter);
+        ASSERT(subnode.coord.pri == n_subnodes % 30 && subnode.coord.sec == n_subnodes / 30,
+               "incorrect coordinate");
+        ASSERT(subnode.color == n_subnodes % 10, "incorrect color");
+    }
+    ASSERT(n_subnodes == 200, "incorrect number of subnodes");
+    ASSERT(get_subnode(other, 0).color == 1, "other node overwritten");
+
+    // space at the end of the arena is reclaimed
+    unsigned int used = graph->_subnodes_used;
+    int capacity = node->_subnodes_capacity;
+    remove_node(graph, node);
+    ASSERT(graph->_subnodes_used == used - capacity, "arena not reclaimed");
+
+    free_graph(graph);
+}
+END_TEST()
+
+BEGIN_TEST(test_grid_neighbors) {
+    color_t grid[] = {0, 1, 2, 3, 4, 5};
+    grid_t pixels = {.width = 3, .height = 2, .pixels = grid};
+    int neighbors[4];
+    ASSERT(grid_neighbors(&pixels, 0, neighbors) == 2, "corner has two neighbors");
+    ASSERT(neighbors[0] == 1 && neighbors[1] == 3, "incorrect neighbors");
+    ASSERT(grid_neighbors(&pixels, 4, neighbors) == 3, "edge has three neighbors");
+    coordinate_t coord = grid_coord(&pixels, 5);
+    ASSERT(coord.pri == 2 && coord.sec == 1, "incorrect coordinate");
+    ASSERT(grid_color(&pixels, grid_index(&pixels, coord)) == 5, "incorrect color");
+}
+END_TEST()
+
 BEGIN_TEST(test_no_abstraction) {
     color_t grid[] = {2, 2, 1, 1};
-    graph_t* graph = graph_from_grid(grid, 2, 2);
-    graph_t* no_abstract = get_no_abstraction_graph(graph);
+    grid_t pixels = {.width = 2, .height = 2, .pixels = grid};
+    graph_t* no_abstract = get_no_abstraction_graph(&pixels);
     ASSERT(no_abstract->n_nodes == 1, "n_nodes incorrect");
 
     node_t* node = get_node(no_abstract, (coordinate_t){0, 0});
     ASSERT(node->n_subnodes == 4, "n_subnodes incorrect");
-    free_graph(graph);
     free_graph(no_abstract);
 }
 END_TEST()
@@ -92,9 +175,9 @@ BEGIN_TEST(test_connected_components) {
       2, 0, 2,
     };
     // clang-format on
-    graph_t* graph = graph_from_grid(grid, 3, 3);
+    grid_t pixels = {.width = 3, .height = 3, .pixels = grid};
 
-    graph_t* connected = get_connected_components_graph(graph);
+    graph_t* connected = get_connected_components_graph(&pixels);
     ASSERT(connected->n_nodes == 3, "incorrect number of components");
 
     node_t* first_component = get_node(connected, (coordinate_t){2, 0});
@@ -113,8 +196,6 @@ BEGIN_TEST(test_connected_components) {
     ASSERT(linked, "components are not linked");
     ASSERT(direction == EDGE_HORIZONTAL, "orientation is incorrect");
     free_graph(connected);
-
-    free_graph(graph);
 }
 END_TEST()
 
@@ -127,9 +208,10 @@ BEGIN_TEST(test_undo_abstraction) {
     };
     // clang-format on
     graph_t* graph = graph_from_grid(grid, 3, 3);
+    grid_t pixels = {.width = 3, .height = 3, .pixels = grid};
 
     for (int i_abstraction = 0; abstractions[i_abstraction].func; i_abstraction++) {
-        graph_t* out = abstractions[i_abstraction].func(graph);
+        graph_t* out = abstractions[i_abstraction].func(&pixels);
         graph_t* reconstructed = undo_abstraction(out);
         for (int x = 0; x < graph->width; x++) {
             for (int y = 0; y < graph->height; y++) {
@@ -152,11 +234,114 @@ BEGIN_TEST(test_undo_abstraction) {
 }
 END_TEST()
 
+BEGIN_TEST(test_render_abstraction) {
+    // clang-format off
+    color_t grid[] = {
+      2, 2, 0,
+      2, 0, 0,
+      2, 0, 2,
+    };
+    // clang-format on
+    grid_t pixels = {.width = 3, .height = 3, .pixels = grid};
+
+    for (int i_abstraction = 0; abstractions[i_abstraction].func; i_abstraction++) {
+        graph_t* out = abstractions[i_abstraction].func(&pixels);
+        raster_t* raster = new_raster(3, 3);
+        ASSERT(render_abstraction(out, raster), "Rendering failed");
+        for (int idx = 0; idx < 9; idx++) {
+            ASSERT(raster->pixels[idx] == grid[idx], "Color is incorrect");
+        }
+
+        // move a node out of the image
+        node_t* node = out->nodes;
+        subnode_t subnode = get_subnode(node, 0);
+        subnode.coord.pri = 3;
+        set_subnode(node, 0, subnode);
+        ASSERT(!render_abstraction(out, raster), "Out of bounds subnode not detected");
+
+        free_raster(raster);
+        free_graph(out);
+    }
+}
+END_TEST()
+
+BEGIN_TEST(test_copy_graph) {
+    color_t grid[] = {2, 2, 1, 1};
+    graph_t* graph = graph_from_grid(grid, 2, 2);
+    graph_t* copy = copy_graph(graph);
+    ASSERT(copy->n_nodes == 4, "n_nodes incorrect");
+
+    // changes to the copy are not seen in the original
+    node_t* node = get_node(copy, (coordinate_t){0, 0});
+    ASSERT(node && node != get_node(graph, (coordinate_t){0, 0}), "node not copied");
+    set_subnode(node, 0, (subnode_t){node->coord, 5});
+    remove_node(copy, get_node(copy, (coordinate_t){1, 1}));
+    ASSERT(copy->n_nodes == 3 && graph->n_nodes == 4, "node removed from original");
+    ASSERT(get_subnode(get_node(graph, (coordinate_t){0, 0}), 0).color == 2,
+           "subnode changed in original");
+    for (const node_t* n = first_node(copy); n; n = next_node(n)) {
+        for (const edge_t* edge = n->edges; edge; edge = edge->next) {
+            ASSERT(edge->peer != get_node(graph, edge->peer->coord), "edge into original");
+            ASSERT(edge_partner(edge)->peer == n, "partner does not point back");
+        }
+    }
+
+    // the free lists are carried over
+    node_t* added = add_node(copy, (coordinate_t){1, 1}, 1);
+    ASSERT(added && added >= copy->_all_nodes && added < copy->_all_nodes + NODES_ALLOC,
+           "node not allocated from the copy");
+    ASSERT(add_edge(copy, node, added, EDGE_VERTICAL), "no edge added");
+
+    // only the used part of the arenas is carried over, the remainder is allocated on demand
+    for (int i = copy->n_nodes; i < NODES_ALLOC; i++) {
+        ASSERT(add_node(copy, (coordinate_t){2, i}, 0), "arena exhausted early");
+    }
+    ASSERT(!add_node(copy, (coordinate_t){3, 0}, 0), "more nodes than the arena holds");
+
+    free_graph(graph);
+    free_graph(copy);
+}
+END_TEST()
+
+BEGIN_TEST(test_hash_graph) {
+    color_t grid[] = {2, 2, 1, 1};
+    graph_t* graph = graph_from_grid(grid, 2, 2);
+    graph_t* copy = copy_graph(graph);
+    ASSERT(hash_graph(graph) == hash_graph(copy), "copies hash differently");
+    node_t* node = get_node(copy, (coordinate_t){0, 0});
+    remove_edge(copy, node->edges);
+    ASSERT(hash_graph(graph) != hash_graph(copy), "edges are not hashed");
+    free_graph(copy);
+    free_graph(graph);
+
+    // the same nodes, in a different order
+    coordinate_t coords[] = {{0, 0}, {1, 0}};
+    graph_t* ordered[2];
+    for (int i = 0; i < 2; i++) {
+        ordered[i] = new_graph(2, 1);
+        for (int j = 0; j < 2; j++) {
+            coordinate_t coord = coords[(i + j) % 2];
+            node = add_node(ordered[i], coord, 1);
+            set_subnode(node, 0, (subnode_t){coord, 3});
+        }
+    }
+    ASSERT(hash_graph(ordered[0]) != hash_graph(ordered[1]), "node order is not hashed");
+    free_graph(ordered[0]);
+    free_graph(ordered[1]);
+}
+END_TEST()
+
 DEFINE_SUITE(test_graph, {
     RUN_TEST(test_image);
     RUN_TEST(test_mutate_graph);
+    RUN_TEST(test_copy_graph);
+    RUN_TEST(test_hash_graph);
+    RUN_TEST(test_remove_nodes);
+    RUN_TEST(test_subnode_storage);
+    RUN_TEST(test_grid_neighbors);
     RUN_TEST(test_no_abstraction);
     RUN_TEST(test_subgraph_by_color);
     RUN_TEST(test_connected_components);
     RUN_TEST(test_undo_abstraction);
+    RUN_TEST(test_render_abstraction);
 })
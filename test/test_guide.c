@@ -0,0 +1,87 @@
+#include <math.h>
+#include <string.h>
+
+#include "guide.h"
+#include "raster.h"
+#include "test.h"
+
+// the network is shared by the tests, it lives as long as the process
+static guide_builder_t builder = {NULL};
+static guide_t* guide = NULL;
+
+static guide_t* get_guide() {
+    if (!guide) {
+        init_guide(&builder);
+        add_choice(&builder, 3, "first");
+        add_choice(&builder, 4, "second");
+        add_choice(&builder, 5, "third");
+        guide = build_guide(&builder);
+    }
+    return guide;
+}
+
+// the distribution after the choices, which are observed on a new trail
+static trail_t* follow(guide_t* guide, const raster_t* input, const int* choices, int n_choices) {
+    trail_t* trail = new_trail(input, input, guide);
+    for (int i = 0; i < n_choices; i++) {
+        next_choice(trail);
+        trail = observe_choice(trail, choices[i]);
+    }
+    next_choice(trail);
+    return trail;
+}
+
+static bool same_distribution(const categorical_t* dist, const categorical_t* other) {
+    if (dist->size != other->size) {
+        return false;
+    }
+    for (int i = 0; i < dist->size; i++) {
+        if (fabs(dist->p[i] - other->p[i]) > 1e-6) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BEGIN_TEST(test_dist_cache) {
+    color_t pixels[] = {1, 0, 0, 2};
+    raster_t* input = raster_from(pixels, 2, 2);
+    guide_t* cached = fork_guide(get_guide(), 1);
+    cached->inference = true;
+    cached->cache_distributions = true;
+
+    // the first trail fills the cache, the second one finds its distributions in there
+    int choices[] = {2, 1};
+    trail_t* first = follow(cached, input, choices, 2);
+    ASSERT(cached->_dist_cache && cached->_dist_cache->n_nodes == 3, "distributions not cached");
+    trail_t* second = follow(cached, input, choices, 2);
+    ASSERT(second->_dist_node && second->_dist_node == first->_dist_node, "cache not hit");
+    ASSERT(same_distribution(&first->dist, &second->dist), "cached distribution differs");
+    ASSERT(cached->_dist_cache->n_nodes == 3, "hit added to the cache");
+    free_trail(cached, second, false);
+
+    // a trail that leaves the trie continues from the state of the node it left
+    int other[] = {2, 3};
+    trail_t* left = follow(cached, input, other, 2);
+    ASSERT(cached->_dist_cache->n_nodes == 4, "distribution after leaving the trie not cached");
+    trail_t* uncached = follow(get_guide(), input, other, 2);
+    ASSERT(same_distribution(&left->dist, &uncached->dist), "state not resumed");
+    free_trail(get_guide(), uncached, false);
+    free_trail(cached, left, false);
+    free_trail(cached, first, false);
+
+    // updating the weights clears the cache, once no trail uses it
+    for (int i = 0; i < 10; i++) {
+        trail_t* trail = follow(get_guide(), input, choices, 2);
+        free_trail(get_guide(), trail, true);
+    }
+    trail_t* after = follow(cached, input, choices, 0);
+    ASSERT(cached->_dist_cache->n_nodes == 1, "cache not cleared after training");
+    free_trail(cached, after, false);
+
+    free_guide(cached);
+    free_raster(input);
+}
+END_TEST()
+
+DEFINE_SUITE(test_guide, { RUN_TEST(test_dist_cache); })
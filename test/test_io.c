@@ -1,4 +1,9 @@
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "io.h"
+#include "parser.h"
 #include "test.h"
 
 BEGIN_TEST(test_read_task) {
@@ -11,10 +16,13 @@ BEGIN_TEST(test_read_task) {
         "{\"train\":[{\"input\":[[0, 1, 2], [2, 1, 0]],\"output\":[[1, 2], [2, "
         "1]]}],\"test\":[]}");
     ASSERT(task->n_train == 1, "Incorrect number of training examples");
-    const graph_t* input = task->train_input[0];
+    const grid_t* input = &task->train_input[0];
     ASSERT(input->width == 3, "Incorrect width of grid");
     ASSERT(input->height == 2, "Incorrect height of grid");
-    const graph_t* output = task->train_output[0];
+    const raster_t* output = task->train_output_raster[0];
+    ASSERT(output->width == 2, "Incorrect width of raster");
+    ASSERT(output->height == 2, "Incorrect height of raster");
+    ASSERT(output->pixels[1] == 2 && output->pixels[2] == 2, "Incorrect raster pixels");
     ASSERT(task->n_test == 0, "Incorrect number of test examples");
     free_task(task);
 }
@@ -23,6 +31,137 @@ END_TEST()
 BEGIN_TEST(test_list_tasks) {
     task_def_t* tasks = list_tasks();
     ASSERT(tasks, "No tasks found")
+    for (task_def_t* task_def = tasks; task_def->next; task_def = task_def->next) {
+        ASSERT(strcmp(task_def->name, task_def->next->name) < 0, "Tasks are not sorted");
+    }
+    free_task_list(tasks);
+}
+END_TEST()
+
+BEGIN_TEST(test_task_cache) {
+    task_def_t def = {
+        .next = NULL,
+        .name = "test.json",
+        .task = parse_task(
+            "{\"train\":[{\"input\":[[0, 1, 2], [2, 1, 0]],\"output\":[[1, 2], [2, "
+            "1]]}],\"test\":[{\"input\":[[3]],\"output\":[[4]]}]}"),
+    };
+    task_def_t* tasks[] = {&def};
+
+    char filename[] = "/tmp/arga_task_cache_XXXXXX";
+    int fd = mkstemp(filename);
+    ASSERT(fd >= 0, "unable to create temporary file");
+    ASSERT(write_task_cache(filename, tasks, 1), "unable to write cache");
+
+    task_def_t* loaded = load_task_cache(filename);
+    ASSERT(loaded && !loaded->next, "incorrect number of tasks");
+    ASSERT(!strcmp(loaded->name, "test.json"), "incorrect task name");
+    task_t* task = loaded->task;
+    ASSERT(task->n_train == 1 && task->n_test == 1, "incorrect number of examples");
+    const raster_t* input = task->train_input_raster[0];
+    ASSERT(input->width == 3 && input->height == 2, "incorrect dimensions");
+    ASSERT(rasters_equal(input, def.task->train_input_raster[0]), "incorrect pixels");
+    ASSERT(task->train_input[0].pixels == input->pixels, "grid not on top of raster");
+    ASSERT(task->test_output_raster[0]->pixels[0] == 4, "incorrect test output");
+    free_task_defs(loaded);
+
+    // names are terminated, even when the file does not do so
+    char name[32];
+    memset(name, 'x', sizeof(name));
+    ASSERT(pwrite(fd, name, sizeof(name), 12) == sizeof(name), "unable to overwrite name");
+    loaded = load_task_cache(filename);
+    ASSERT(loaded && strlen(loaded->name) < sizeof(name), "name not terminated");
+    free_task_defs(loaded);
+
+    // truncated files are rejected, wherever they end
+    struct stat st;
+    fstat(fd, &st);
+    for (off_t size = st.st_size - 1; size > 0; size -= 5) {
+        ASSERT(ftruncate(fd, size) == 0, "unable to truncate cache");
+        ASSERT(!load_task_cache(filename), "truncated cache loaded");
+    }
+    close(fd);
+    remove(filename);
+    free_task(def.task);
+}
+END_TEST()
+
+BEGIN_TEST(test_load_tasks) {
+    // only load the first few tasks
+    task_def_t* tasks = list_tasks();
+    int n_tasks = 1;
+    task_def_t* last = tasks;
+    for (; n_tasks < 8 && last->next; n_tasks++) {
+        last = last->next;
+    }
+    if (last->next) {
+        free_task_list(last->next);
+        last->next = NULL;
+    }
+    int n_loaded = load_tasks(tasks, 3);
+    ASSERT(n_loaded == n_tasks, "Not all tasks were loaded");
+    for (task_def_t* task_def = tasks; task_def; task_def = task_def->next) {
+        ASSERT(task_def->task && task_def->task->n_train > 0, "Task not parsed");
+        free_task(task_def->task);
+    }
+    free_task_list(tasks);
+}
+END_TEST()
+
+BEGIN_TEST(test_parse_task_json) {
+    task_t* task = new_task();
+    ASSERT(
+        parse_task_json(
+            "{\"train\": [{\"input\": [[0, 1, 2], [2, 1, 0]], \"output\": [[1, 2], [2, 1]]}],\n"
+            " \"test\": [{\"input\": [[3]]}], \"name\": {\"x\": [1, \"]\"]}}",
+            task),
+        "task not parsed");
+    ASSERT(task->n_train == 1 && task->n_test == 1, "incorrect number of examples");
+    const raster_t* input = task->train_input_raster[0];
+    ASSERT(input->width == 3 && input->height == 2, "incorrect dimensions");
+    ASSERT(input->pixels[2] == 2 && input->pixels[3] == 2, "incorrect pixels");
+    ASSERT(task->test_output_raster[0] == NULL, "unknown test output");
+    free_task(task);
+
+    // ragged grids are rejected
+    task = new_task();
+    ASSERT(
+        !parse_task_json("{\"train\": [{\"input\": [[0, 1], [2]], \"output\": [[1]]}]}", task),
+        "ragged grid accepted");
+    free_task(task);
+    task = new_task();
+    ASSERT(
+        !parse_task_json(
+            "{\"train\": [{\"input\": [[1, 2], [3, 4, 5], [6]], \"output\": [[1]]}]}", task),
+        "grid with rows of different lengths accepted");
+    free_task(task);
+
+    // colors are single digits
+    task = new_task();
+    ASSERT(
+        !parse_task_json("{\"train\": [{\"input\": [[300, 1]], \"output\": [[1]]}]}", task),
+        "color out of range accepted");
+    free_task(task);
+}
+END_TEST()
+
+BEGIN_TEST(test_parse_task_collection) {
+    task_def_t* tasks = parse_task_collection(
+        "{\"a\": {\"train\": [{\"input\": [[1]], \"output\": [[2]]}], "
+        "\"test\": [{\"input\": [[3]]}, {\"input\": [[4]]}]},\n"
+        " \"b\": {\"train\": [], \"test\": [{\"input\": [[5, 6]]}]}}",
+        "{\"b\": [[[7, 8]]], \"a\": [[[9]], [[0]]]}");
+    ASSERT(tasks && tasks->next && !tasks->next->next, "incorrect number of tasks");
+    ASSERT(!strcmp(tasks->name, "a") && !strcmp(tasks->next->name, "b"), "incorrect names");
+    task_t* a = tasks->task;
+    ASSERT(a->n_train == 1 && a->n_test == 2, "incorrect number of examples");
+    ASSERT(a->test_output_raster[1]->pixels[0] == 0, "incorrect test output");
+    task_t* b = tasks->next->task;
+    ASSERT(b->test_output_raster[0]->width == 2, "incorrect test output");
+
+    for (task_def_t* task_def = tasks; task_def; task_def = task_def->next) {
+        free_task(task_def->task);
+    }
     free_task_list(tasks);
 }
 END_TEST()
@@ -30,4 +169,8 @@ END_TEST()
 DEFINE_SUITE(test_io, {
     RUN_TEST(test_read_task);
     RUN_TEST(test_list_tasks);
+    RUN_TEST(test_load_tasks);
+    RUN_TEST(test_task_cache);
+    RUN_TEST(test_parse_task_json);
+    RUN_TEST(test_parse_task_collection);
 })
\ No newline at end of file
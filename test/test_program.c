@@ -0,0 +1,269 @@
+#include <string.h>
+
+#include "filter.h"
+#include "image.h"
+#include "program.h"
+#include "raster.h"
+#include "solve.h"
+#include "task.h"
+#include "test.h"
+#include "transform.h"
+
+BEGIN_TEST(test_evaluate_program) {
+    color_t input_3[] = {1, 1, 0, 0};
+    color_t output_3[] = {3, 3, 0, 0};
+
+    task_t* task = recolor_task();
+    ASSERT(task->n_train == 2, "examples not added");
+
+    filter_call_t filter = {
+        .filter = &filter_funcs[0],
+        .args = {.color = 1, .exclude = false},
+    };
+    transform_call_t transform = {
+        .transform = &transformations[0],
+        .arguments = {.color = 2},
+    };
+    program_t program = {&abstractions[0], 1, {{&filter, &transform}}};
+
+    program_evaluation_t evaluation;
+    bool correct = evaluate_program(task, &program, 1, NULL, &evaluation);
+    ASSERT(correct, "program does not reproduce train pairs");
+    ASSERT(evaluation.n_evaluated == 2, "not all examples evaluated");
+    ASSERT(evaluation.mismatches[0] == 0 && evaluation.mismatches[1] == 0, "mismatches found");
+
+    add_train_example(task, raster_from(input_3, 2, 2), raster_from(output_3, 2, 2));
+    correct = evaluate_program(task, &program, 2, NULL, &evaluation);
+    ASSERT(!correct, "program should fail on third example");
+    ASSERT(evaluation.n_evaluated == 1, "evaluation did not stop at first failure");
+    ASSERT(evaluation.mismatches[2] == 2, "incorrect number of mismatches");
+    ASSERT(evaluation.mismatches[0] == NOT_EVALUATED, "first example should not be evaluated");
+
+    free_task(task);
+}
+END_TEST()
+
+BEGIN_TEST(test_multi_step_program) {
+    // recolor blue (1) to red (2), then red to green (3)
+    color_t input_1[] = {1, 0, 0, 2};
+    color_t output_1[] = {3, 0, 0, 3};
+    color_t input_2[] = {0, 1, 1, 0};
+    color_t output_2[] = {0, 3, 3, 0};
+
+    task_t* task = new_task();
+    add_train_example(task, raster_from(input_1, 2, 2), raster_from(output_1, 2, 2));
+    add_train_example(task, raster_from(input_2, 2, 2), raster_from(output_2, 2, 2));
+
+    filter_call_t blue = {.filter = &filter_funcs[0], .args = {.color = 1}};
+    filter_call_t red = {.filter = &filter_funcs[0], .args = {.color = 2}};
+    transform_call_t to_red = {.transform = &transformations[0], .arguments = {.color = 2}};
+    transform_call_t to_green = {.transform = &transformations[0], .arguments = {.color = 3}};
+    program_t program = {&abstractions[0], 2, {{&blue, &to_red}, {&red, &to_green}}};
+    program_t first_step = {&abstractions[0], 1, {{&blue, &to_red}}};
+
+    program_evaluation_t evaluation;
+    ASSERT(evaluate_program(task, &program, 0, NULL, &evaluation), "program is not correct");
+    ASSERT(!evaluate_program(task, &first_step, 0, NULL, &evaluation), "first step is correct");
+
+    program_key_t key, prefix_key;
+    ASSERT(encode_program(&program, &key), "program does not fit");
+    ASSERT(encode_prefix(&program, 1, &prefix_key), "prefix does not fit");
+    ASSERT(prefix_key.size < key.size && !memcmp(prefix_key.bytes, key.bytes, prefix_key.size),
+           "prefix is not a prefix of the program");
+
+    // siblings continue from the graph after the shared first step
+    prefix_cache_t* cache = new_prefix_cache();
+    ASSERT(evaluate_program(task, &program, 0, cache, &evaluation), "cached program not correct");
+    ASSERT(cache->n_hits == 0 && cache->n_misses == 2, "nothing should be cached");
+    program_t sibling = {&abstractions[0], 2, {{&blue, &to_red}, {&red, &to_red}}};
+    ASSERT(!evaluate_program(task, &sibling, 0, cache, &evaluation), "sibling is correct");
+    ASSERT(cache->n_hits == 1, "prefix not reused");
+    ASSERT(evaluation.mismatches[0] == 2, "incorrect number of mismatches");
+    ASSERT(evaluate_program(task, &program, 1, cache, &evaluation), "cache changed the outcome");
+    ASSERT(cache->n_hits == 3, "prefix not reused");
+    free_prefix_cache(cache);
+
+    free_task(task);
+}
+END_TEST()
+
+BEGIN_TEST(test_transpose_program) {
+    color_t input[] = {1, 3, 0, 0};
+    color_t output[] = {2, 4, 0, 0};
+    // no program reproduces the second example
+    color_t other_input[] = {3, 3, 1, 1};
+    color_t other_output[] = {5, 5, 5, 5};
+    task_t* task = new_task();
+    add_train_example(task, raster_from(input, 2, 2), raster_from(output, 2, 2));
+    add_train_example(task, raster_from(other_input, 2, 2), raster_from(other_output, 2, 2));
+
+    // recoloring blue (1) and green (3) commutes
+    filter_call_t blue = {.filter = &filter_funcs[0], .args = {.color = 1}};
+    filter_call_t green = {.filter = &filter_funcs[0], .args = {.color = 3}};
+    filter_call_t red = {.filter = &filter_funcs[0], .args = {.color = 2}};
+    transform_call_t to_red = {.transform = &transformations[0], .arguments = {.color = 2}};
+    transform_call_t to_yellow = {.transform = &transformations[0], .arguments = {.color = 4}};
+    program_t first = {
+        &abstractions[0], 3, {{&blue, &to_red}, {&green, &to_yellow}, {&red, &to_red}}};
+    program_t swapped = {
+        &abstractions[0], 3, {{&green, &to_yellow}, {&blue, &to_red}, {&red, &to_red}}};
+
+    prefix_cache_t* cache = new_prefix_cache();
+    transposition_table_t* table = new_transposition_table();
+    program_key_t first_key, swapped_key;
+    encode_program(&first, &first_key);
+    encode_program(&swapped, &swapped_key);
+    ASSERT(first_key.hash != swapped_key.hash, "different programs have the same key");
+    program_evaluation_t evaluation;
+    evaluate_program(task, &first, 0, cache, &evaluation);
+    ASSERT(transpose_program(task, &first, &evaluation, cache, table, &first_key) == -1,
+           "transposition in an empty table");
+    evaluate_program(task, &swapped, 0, cache, &evaluation);
+    ASSERT(transpose_program(task, &swapped, &evaluation, cache, table, &swapped_key) == 2,
+           "commuting steps not transposed");
+    ASSERT(first_key.size == swapped_key.size && first_key.hash == swapped_key.hash &&
+               !memcmp(first_key.bytes, swapped_key.bytes, first_key.size),
+           "transposed keys differ");
+    free_prefix_cache(cache);
+
+    // the least recently used state is evicted
+    for (unsigned long state = 0; state < TRANSPOSITION_TABLE_SIZE; state++) {
+        add_transposition(table, state << 20);
+    }
+    ASSERT(find_transposition(table, 0), "state evicted early");
+    unsigned long last = (unsigned long)TRANSPOSITION_TABLE_SIZE << 20;
+    add_transposition(table, last);
+    ASSERT(find_transposition(table, 0), "recently used state evicted");
+    ASSERT(!find_transposition(table, 1ul << 20), "least recently used state not evicted");
+    ASSERT(find_transposition(table, last), "state not added");
+    free_transposition_table(table);
+
+    free_task(task);
+}
+END_TEST()
+
+BEGIN_TEST(test_partial_transposition) {
+    // recoloring blue (1) to red (2) and back is a no-op on the first input only
+    color_t input_1[] = {1, 0, 0, 0};
+    color_t output_1[] = {3, 0, 0, 0};
+    color_t input_2[] = {1, 0, 0, 2};
+    color_t output_2[] = {3, 0, 0, 3};
+    task_t* task = new_task();
+    add_train_example(task, raster_from(input_1, 2, 2), raster_from(output_1, 2, 2));
+    add_train_example(task, raster_from(input_2, 2, 2), raster_from(output_2, 2, 2));
+
+    filter_call_t blue = {.filter = &filter_funcs[0], .args = {.color = 1}};
+    filter_call_t red = {.filter = &filter_funcs[0], .args = {.color = 2}};
+    transform_call_t to_red = {.transform = &transformations[0], .arguments = {.color = 2}};
+    transform_call_t to_blue = {.transform = &transformations[0], .arguments = {.color = 1}};
+    transform_call_t to_green = {.transform = &transformations[0], .arguments = {.color = 3}};
+    transform_call_t to_yellow = {.transform = &transformations[0], .arguments = {.color = 4}};
+    program_t failing = {
+        &abstractions[0], 3, {{&blue, &to_red}, {&red, &to_blue}, {&blue, &to_yellow}}};
+    program_t sibling = {
+        &abstractions[0], 3, {{&blue, &to_red}, {&red, &to_blue}, {&blue, &to_green}}};
+    program_t failing_suffix = {&abstractions[0], 1, {{&blue, &to_yellow}}};
+    program_t sibling_suffix = {&abstractions[0], 1, {{&blue, &to_green}}};
+
+    task_memo_t memo;
+    init_task_memo(&memo);
+    solve_result_t result;
+    init_solve_result(task, &result);
+
+    // the failing program is only evaluated on the first example, where its prefix is a no-op
+    program_key_t key, suffix_key;
+    encode_program(&failing, &key);
+    encode_program(&failing_suffix, &suffix_key);
+    ASSERT(!try_program(task, &failing, 0, &memo, &result), "failing program is correct");
+    ASSERT(memo.n_transposed == -1, "prefix transposed on a subset of the examples");
+    program_evaluation_t evaluation;
+    evaluate_program(task, &failing, 0, memo.prefixes, &evaluation);
+    ASSERT(transpose_program(task, &failing, &evaluation, memo.prefixes, memo.transpositions,
+                             &key) == 2,
+           "prefix not transposed on the evaluated example");
+    ASSERT(key.size == suffix_key.size && !memcmp(key.bytes, suffix_key.bytes, key.size),
+           "failed outcome not stored under the transposed key");
+
+    // so the sibling after the same prefix still has to be tried, unlike its own suffix
+    ASSERT(!evaluate_program(task, &sibling_suffix, 0, NULL, &evaluation), "suffix is correct");
+    ASSERT(try_program(task, &sibling, 0, &memo, &result), "sibling is not correct");
+    ASSERT(result.found && result.n_duplicates == 0, "sibling not evaluated");
+
+    free_task_memo(&memo);
+    free_task(task);
+}
+END_TEST()
+
+BEGIN_TEST(test_program_key) {
+    // filter_by_color (0) does not use its size
+    filter_call_t filter = {
+        .filter = &filter_funcs[0],
+        .args = {.size = 3, .color = 1},
+    };
+    filter_call_t other_size = filter;
+    other_size.args.size = 5;
+    filter_call_t other_color = filter;
+    other_color.args.color = 2;
+    // update_color (0) does not use its direction
+    transform_call_t transform = {
+        .transform = &transformations[0],
+        .arguments = {.color = 2, .direction = UP},
+    };
+    transform_call_t other_direction = transform;
+    other_direction.arguments.direction = DOWN;
+
+    program_t program = {&abstractions[0], 1, {{&filter, &transform}}};
+    program_t unused_args = {&abstractions[0], 1, {{&other_size, &other_direction}}};
+    program_t used_arg = {&abstractions[0], 1, {{&other_color, &transform}}};
+    program_t other_abstraction = {&abstractions[1], 1, {{&filter, &transform}}};
+    program_key_t key, unused_key, used_key, abstraction_key;
+    ASSERT(encode_program(&program, &key), "program does not fit");
+    ASSERT(encode_program(&unused_args, &unused_key), "program does not fit");
+    ASSERT(encode_program(&used_arg, &used_key), "program does not fit");
+    ASSERT(encode_program(&other_abstraction, &abstraction_key), "program does not fit");
+    ASSERT(key.size == unused_key.size && key.hash == unused_key.hash &&
+               !memcmp(key.bytes, unused_key.bytes, key.size),
+           "unused arguments are encoded");
+    ASSERT(key.hash != used_key.hash, "used argument is not encoded");
+    ASSERT(key.hash != abstraction_key.hash, "abstraction is not encoded");
+
+    program_set_t* set = new_program_set();
+    ASSERT(!find_program(set, &key), "empty set contains program");
+    add_program(set, &key, true);
+    add_program(set, &used_key, false);
+    ASSERT(find_program(set, &unused_key) && find_program(set, &unused_key)->correct,
+           "program not found");
+    ASSERT(find_program(set, &used_key) && !find_program(set, &used_key)->correct,
+           "outcome not stored");
+    ASSERT(!find_program(set, &abstraction_key), "program found that was not added");
+
+    // distinct programs with two filters, beyond the initial capacity
+    bool found = true;
+    for (int color = 0; color < 10; color++) {
+        for (int size = 1; size < 50; size++) {
+            filter_call_t chained = {.filter = &filter_funcs[0], .args = {.color = color}};
+            transform_call_t recolor = {.transform = &transformations[0]};
+            recolor.arguments.color = size % 10;
+            chained.next_in_multi = &filter;
+            filter.args.color = size / 10;
+            program_t many = {&abstractions[0], 1, {{&chained, &recolor}}};
+            program_key_t many_key;
+            encode_program(&many, &many_key);
+            add_program(set, &many_key, false);
+            found &= find_program(set, &many_key) != NULL;
+        }
+    }
+    ASSERT(found, "programs lost while growing");
+    ASSERT(set->n_entries == 2 + 10 * 50 - 10, "incorrect number of distinct programs");
+    ASSERT(find_program(set, &used_key) != NULL, "program lost while growing");
+    free_program_set(set);
+}
+END_TEST()
+
+DEFINE_SUITE(test_program, {
+    RUN_TEST(test_evaluate_program);
+    RUN_TEST(test_multi_step_program);
+    RUN_TEST(test_transpose_program);
+    RUN_TEST(test_partial_transposition);
+    RUN_TEST(test_program_key);
+})
@@ -0,0 +1,90 @@
+#include "program.h"
+#include "raster.h"
+#include "task.h"
+#include "test.h"
+
+BEGIN_TEST(test_diff_rasters) {
+    // larger than a single vector, with a remainder
+    raster_t* raster = new_raster(7, 3);
+    raster_t* expected = new_raster(7, 3);
+    for (int idx = 0; idx < 21; idx++) {
+        raster->pixels[idx] = idx % 10;
+        expected->pixels[idx] = idx % 10;
+    }
+    ASSERT(rasters_equal(raster, expected), "rasters should be equal");
+    ASSERT(diff_rasters(raster, expected, NULL) == 0, "no mismatches expected");
+
+    raster->pixels[3] = 9;
+    raster->pixels[20] = 9;
+    unsigned char diff[21];
+    ASSERT(!rasters_equal(raster, expected), "rasters should differ");
+    ASSERT(diff_rasters(raster, expected, diff) == 2, "incorrect number of mismatches");
+    for (int idx = 0; idx < 21; idx++) {
+        ASSERT(diff[idx] == (idx == 3 || idx == 20), "incorrect diff mask");
+    }
+
+    raster_t* other = new_raster(3, 7);
+    ASSERT(!rasters_equal(raster, other), "rasters with other dimensions are equal");
+    ASSERT(diff_rasters(raster, other, NULL) == 21, "all pixels should mismatch");
+
+    free_raster(other);
+    free_raster(expected);
+    free_raster(raster);
+}
+END_TEST()
+
+BEGIN_TEST(test_hash_raster) {
+    raster_t* raster = new_raster(7, 3);
+    raster_t* copy = new_raster(7, 3);
+    for (int idx = 0; idx < 21; idx++) {
+        raster->pixels[idx] = idx % 10;
+        copy->pixels[idx] = idx % 10;
+    }
+    unsigned long hash = hash_raster(raster);
+    ASSERT(hash == hash_raster(copy), "equal rasters hash differently");
+
+    copy->pixels[5] = 0;
+    ASSERT(hash != hash_raster(copy), "changed pixel does not change hash");
+    ASSERT(update_raster_hash(hash, 5, 5, 0) == hash_raster(copy), "incorrect update");
+    ASSERT(rehash_raster(copy, raster, hash) == hash_raster(copy), "incorrect rehash");
+    ASSERT(rehash_raster(raster, raster, hash) == hash, "rehash of an equal raster differs");
+
+    // the same pixels, in other dimensions
+    raster_t* other = new_raster(3, 7);
+    for (int idx = 0; idx < 21; idx++) {
+        other->pixels[idx] = idx % 10;
+    }
+    ASSERT(hash != hash_raster(other), "dimensions are not hashed");
+    ASSERT(rehash_raster(other, raster, hash) == hash_raster(other), "dimensions not rehashed");
+
+    // the cheapest program is kept with its output
+    program_key_t expensive = {.size = 1, .hash = 1, .bytes = {1}};
+    program_key_t cheap = {.size = 1, .hash = 2, .bytes = {2}};
+    output_table_t table = {0, 0, 0, NULL};
+    ASSERT(!find_output(&table, hash), "output found in an empty table");
+    ASSERT(record_output(&table, hash, 5, &expensive), "new output not recorded");
+    ASSERT(!record_output(&table, hash, 5, &cheap), "output recorded twice");
+    ASSERT(!record_output(&table, hash, 6, &cheap), "more expensive program recorded");
+    ASSERT(find_output(&table, hash)->program.hash == expensive.hash, "program replaced");
+    ASSERT(record_output(&table, hash, 4, &cheap), "cheaper program not recorded");
+    ASSERT(find_output(&table, hash)->program.hash == cheap.hash, "cheaper program not kept");
+    // beyond the initial capacity
+    bool recorded = true;
+    for (int i = 0; i < 200; i++) {
+        recorded &= record_output(&table, update_raster_hash(hash, i % 21, i, i + 1), 3, &cheap);
+    }
+    ASSERT(!record_output(&table, hash, 4, &cheap), "output lost while growing");
+    ASSERT(find_output(&table, hash)->cost == 4, "output changed while growing");
+    ASSERT(recorded && table.n_entries == 201, "incorrect number of outputs");
+    free(table.entries);
+
+    free_raster(other);
+    free_raster(copy);
+    free_raster(raster);
+}
+END_TEST()
+
+DEFINE_SUITE(test_raster, {
+    RUN_TEST(test_diff_rasters);
+    RUN_TEST(test_hash_raster);
+})
@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "guide.h"
+#include "sample_log.h"
+#include "test.h"
+
+BEGIN_TEST(test_sample_log_roundtrip) {
+    guide_builder_t builder;
+    init_guide(&builder);
+    add_choice(&builder, 3, "first");
+    add_choice(&builder, 5, "second");
+
+    char filename[] = "/tmp/arga_sample_log_XXXXXX";
+    int fd = mkstemp(filename);
+    ASSERT(fd >= 0, "unable to create temporary file");
+
+    sample_log_t* log = open_sample_log(filename, builder.items);
+    ASSERT(log, "unable to open log");
+    // enough records to fill the buffer more than once
+    for (int i = 0; i < 5000; i++) {
+        sample_record_t record = {
+            .example = i % 3,
+            .correct = i % 7 == 0,
+            .loss = 0.5f * i,
+            .micros = i,
+            .n_choices = 2,
+            .choices = {i % 3, -1},
+            .items = {0, 1},
+        };
+        strncpy(record.task, "007bbfb7.json", SAMPLE_TASK_ID_SIZE);
+        log_sample(log, &record);
+    }
+    close_sample_log(log);
+
+    sample_log_reader_t* reader = open_sample_log_reader(filename);
+    ASSERT(reader, "unable to read log");
+    ASSERT(reader->n_items == 2, "incorrect number of items");
+    ASSERT(!strcmp(reader->names[1], "second"), "incorrect item name");
+
+    sample_record_t record;
+    int n_records = 0;
+    bool valid = true;
+    while (read_sample(reader, &record)) {
+        valid &= !strcmp(record.task, "007bbfb7.json");
+        valid &= record.example == n_records % 3 && record.correct == (n_records % 7 == 0);
+        valid &= record.loss == 0.5f * n_records && record.micros == (unsigned)n_records;
+        valid &= record.n_choices == 2 && record.choices[0] == n_records % 3;
+        valid &= record.choices[1] == -1 && record.items[1] == 1;
+        n_records++;
+    }
+    close_sample_log_reader(reader);
+    remove(filename);
+    free_block(builder._items_mem);
+
+    ASSERT(n_records == 5000, "incorrect number of records");
+    ASSERT(valid, "records do not match");
+}
+END_TEST()
+
+BEGIN_TEST(test_sample_log_csv) {
+    guide_builder_t builder;
+    init_guide(&builder);
+    add_choice(&builder, 3, "first");
+    add_choice(&builder, 5, "second");
+
+    char filename[] = "/tmp/arga_sample_log_XXXXXX";
+    int fd = mkstemp(filename);
+    ASSERT(fd >= 0, "unable to create temporary file");
+
+    sample_log_t* log = open_sample_log(filename, builder.items);
+    ASSERT(log, "unable to open log");
+    sample_record_t single = {.n_choices = 1, .choices = {2}, .items = {0}};
+    strncpy(single.task, "single", SAMPLE_TASK_ID_SIZE);
+    log_sample(log, &single);
+    // two steps, the second one skips the first item
+    sample_record_t multi = {.n_choices = 3, .choices = {1, 4, 3}, .items = {0, 1, 1}};
+    strncpy(multi.task, "multi", SAMPLE_TASK_ID_SIZE);
+    log_sample(log, &multi);
+    close_sample_log(log);
+
+    sample_log_reader_t* reader = open_sample_log_reader(filename);
+    ASSERT(reader, "unable to read log");
+    char* csv = NULL;
+    size_t csv_size = 0;
+    FILE* out = open_memstream(&csv, &csv_size);
+    sample_log_to_csv(reader, out);
+    fclose(out);
+    close_sample_log_reader(reader);
+    remove(filename);
+    free_block(builder._items_mem);
+
+    const char* expected =
+        "task,example,loss,reconstructed,micros,"
+        "step0:first,step0:second,step1:first,step1:second\n"
+        "single, 0, 0.000000000000e+00, 0, 0, 2, -1, -1, -1\n"
+        "multi, 0, 0.000000000000e+00, 0, 0, 1, 4, -1, 3\n";
+    bool matches = !strcmp(csv, expected);
+    free(csv);
+    ASSERT(matches, "incorrect csv");
+}
+END_TEST()
+
+DEFINE_SUITE(test_sample_log, {
+    RUN_TEST(test_sample_log_roundtrip);
+    RUN_TEST(test_sample_log_csv);
+})
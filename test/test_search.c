@@ -0,0 +1,437 @@
+#include <math.h>
+#include <string.h>
+
+#include "binding.h"
+#include "filter.h"
+#include "guide.h"
+#include "image.h"
+#include "search.h"
+#include "task.h"
+#include "test.h"
+#include "transform.h"
+
+// the argument values are set up while building the guide, which keeps the choice names
+static guide_builder_t builder = {NULL};
+
+static void init_arguments() {
+    if (!builder.items) {
+        init_guide(&builder);
+        init_image(&builder);
+        init_filter(&builder);
+        init_binding(&builder);
+        init_transform(&builder);
+        init_program(&builder);
+    }
+}
+
+// the network is shared by the tests, it lives as long as the process
+static guide_t* guide = NULL;
+
+static guide_t* get_guide() {
+    init_arguments();
+    if (!guide) {
+        guide = build_guide(&builder);
+    }
+    return guide;
+}
+
+BEGIN_TEST(test_enumerate_transforms) {
+    init_arguments();
+
+    binding_call_t bindings[256];
+    int n_bindings = enumerate_bindings(bindings, 256);
+    ASSERT(n_bindings > 0 && n_bindings < 256, "unexpected number of bindings");
+
+    transform_call_t transforms[4096];
+    int n_static = enumerate_transforms(bindings, 2, false, transforms, 4096);
+    bool valid = true;
+    for (int i = 0; i < n_static; i++) {
+        valid &= !transforms[i].dynamic.color && !transforms[i].dynamic.direction;
+    }
+    ASSERT(valid, "static transform with a binding");
+    ASSERT(enumerate_transforms(NULL, 0, false, transforms, 4096) == n_static,
+           "static transforms depend on bindings");
+
+    int n_dynamic = enumerate_transforms(bindings, 2, true, transforms, 4096);
+    ASSERT(n_dynamic > 0, "no dynamic transforms");
+    for (int i = 0; i < n_dynamic; i++) {
+        valid &= transforms[i].dynamic.color || transforms[i].dynamic.direction;
+    }
+    ASSERT(valid, "dynamic transform without a binding");
+    ASSERT(enumerate_transforms(bindings, 2, true, transforms, 10) == 10, "limit not respected");
+
+}
+END_TEST()
+
+BEGIN_TEST(test_search_task) {
+    init_arguments();
+    task_t* task = recolor_task();
+
+    solve_options_t options = {
+        .time_budget = 100.0,
+        .sample_budget = 100000,
+        .mode = SOLVE_ENUMERATE,
+    };
+    solve_result_t result;
+    search_task(task, &options, &result);
+    ASSERT(result.found, "no program found");
+    ASSERT(result.n_test == 1 && result.n_test_correct == 1, "test output not reproduced");
+
+    // the order is fixed, so the same number of programs is needed each time
+    long n_samples = result.n_samples;
+    search_task(task, &options, &result);
+    ASSERT(result.found && result.n_samples == n_samples, "search is not deterministic");
+
+    options.sample_budget = n_samples - 1;
+    search_task(task, &options, &result);
+    ASSERT(!result.found && result.n_samples == n_samples - 1, "budget not respected");
+
+    free_task(task);
+}
+END_TEST()
+
+BEGIN_TEST(test_frontier) {
+    frontier_t frontier = {0};
+    // more than the initial capacity
+    for (int i = 0; i < 1000; i++) {
+        push_expansion(&frontier, (expansion_t){-((i * 7919) % 1000) / 10.0, NULL, i});
+    }
+    ASSERT(frontier.n_expansions == 1000, "expansions lost");
+    double log_p = 0.0;
+    bool ordered = true;
+    for (int i = 0; i < 1000; i++) {
+        expansion_t expansion = pop_expansion(&frontier);
+        ordered &= expansion.log_p <= log_p;
+        log_p = expansion.log_p;
+    }
+    ASSERT(ordered, "expansions not popped in order of log-probability");
+    ASSERT(frontier.n_expansions == 0, "expansions left");
+    free(frontier.expansions);
+}
+END_TEST()
+
+typedef struct _branches {
+    int n_branches;
+    int depth;
+    double p[MAX_CHOICES];
+} branches_t;
+
+static void record_branch(
+    trail_script_t* script, const trail_t* trail, const categorical_t* dist, long valid_flags) {
+    (void)valid_flags;
+    branches_t* branches = script->context;
+    branches->n_branches++;
+    branches->depth = trail->depth;
+    memcpy(branches->p, dist->p, dist->size * sizeof(double));
+}
+
+BEGIN_TEST(test_scripted_trail) {
+    guide_t* guide = get_guide();
+    color_t pixels[] = {1, 0, 0, 2};
+    raster_t* input = raster_from(pixels, 2, 2);
+
+    // without a prefix, the most probable choices are taken and their distributions reported
+    branches_t branches = {0};
+    trail_script_t script = {.on_branch = record_branch, .context = &branches};
+    trail_t* trail = new_scripted_trail(input, input, guide, &script);
+    signed char prefix[3];
+    void* state = NULL;
+    int size = 0;
+    for (int depth = 0; depth < 3; depth++) {
+        const categorical_t* dist = next_choice(trail);
+        // the last choice is replayed on the state with its distribution, as push_alternatives does
+        if (depth == 2) {
+            state = fork_trail_state(trail);
+        }
+        size = dist->size;
+        prefix[depth] = choose(dist);
+        ASSERT(branches.n_branches == depth + 1 && branches.depth == depth, "branch not reported");
+        for (int i = 0; i < dist->size; i++) {
+            ASSERT(dist->p[i] <= dist->p[(int)prefix[depth]], "not the most probable choice");
+        }
+        trail = observe_choice(trail, prefix[depth]);
+    }
+    ASSERT(script.log_p <= 0.0, "log-probability not accumulated");
+    free_trail(guide, trail, false);
+
+    // the prefix is replayed, with another alternative for its last choice
+    ASSERT(size > 1, "no alternative");
+    prefix[2] = (prefix[2] + 1) % size;
+    branches.n_branches = 0;
+    trail_script_t replay = {
+        .n_prefix = 3,
+        .prefix = prefix,
+        .state = state,
+        .on_branch = record_branch,
+        .context = &branches,
+    };
+    trail = new_scripted_trail(input, input, guide, &replay);
+    for (int depth = 0; depth < 3; depth++) {
+        ASSERT(choose(next_choice(trail)) == prefix[depth], "prefix not replayed");
+        trail = observe_choice(trail, prefix[depth]);
+    }
+    ASSERT(branches.n_branches == 0, "prefix choice reported");
+    choose(next_choice(trail));
+    ASSERT(branches.n_branches == 1 && branches.depth == 3, "choice after the prefix not reported");
+    free_trail(guide, trail, false);
+
+    // resuming from the saved state gives the distribution of a trail that ran all of it
+    trail = new_trail(input, input, guide);
+    for (int depth = 0; depth < 3; depth++) {
+        next_choice(trail);
+        trail = observe_choice(trail, prefix[depth]);
+    }
+    const categorical_t* dist = next_choice(trail);
+    for (int i = 0; i < dist->size; i++) {
+        ASSERT(fabs(dist->p[i] - branches.p[i]) < 1e-6, "distribution differs after replay");
+    }
+    free_trail(guide, trail, false);
+    free_raster(input);
+}
+END_TEST()
+
+BEGIN_TEST(test_best_first_task) {
+    guide_t* guide = get_guide();
+    task_t* task = recolor_task();
+
+    solve_options_t options = {
+        .time_budget = 100.0,
+        .sample_budget = 50,
+        .mode = SOLVE_BEST_FIRST,
+    };
+    solve_result_t result;
+    best_first_task(task, guide, &options, &result);
+    ASSERT(result.n_samples <= options.sample_budget, "budget not respected");
+    ASSERT(result.found || result.n_samples == options.sample_budget, "search stopped early");
+    ASSERT(result.n_duplicates == 0, "program decoded twice");
+
+    // decoding is deterministic
+    long n_samples = result.n_samples;
+    bool found = result.found;
+    best_first_task(task, guide, &options, &result);
+    ASSERT(result.n_samples == n_samples && result.found == found, "search is not deterministic");
+
+    options.sample_budget = 1;
+    best_first_task(task, guide, &options, &result);
+    ASSERT(result.n_samples == 1, "budget not respected");
+
+    free_task(task);
+}
+END_TEST()
+
+static void count_stop(
+    trail_script_t* script, const trail_t* trail, const categorical_t* dist, long valid_flags) {
+    (void)trail;
+    (void)dist;
+    (void)valid_flags;
+    (*(int*)script->context)++;
+}
+
+BEGIN_TEST(test_next_choices) {
+    guide_t* guide = get_guide();
+    color_t pixels[] = {1, 0, 0, 2};
+    raster_t* input = raster_from(pixels, 2, 2);
+
+    // two probes stop at the first item
+    int n_stops = 0;
+    trail_script_t scripts[3];
+    for (int i = 0; i < 2; i++) {
+        scripts[i] = (trail_script_t){.probe = true, .on_branch = count_stop, .context = &n_stops};
+        trail_t* trail = new_scripted_trail(input, input, guide, &scripts[i]);
+        ASSERT(choose(next_choice(trail)) == 0, "probe does not take the lowest choice");
+        free_trail(guide, trail, false);
+    }
+    ASSERT(n_stops == 2 && scripts[0].stopped && scripts[1].stopped, "probe did not stop");
+
+    // the stopped probes get the distributions of trails that run the same choices
+    categorical_t dists[3];
+    dists[0].size = dists[1].size = guide->items->n_choices;
+    void* states[3] = {scripts[0].state, scripts[1].state, NULL};
+    next_choices(guide, states, 2, dists);
+
+    // a third probe replays a choice from the state after the first distribution (as beam_task
+    // does) and stops at the second item
+    signed char prefix[] = {1};
+    scripts[2] = (trail_script_t){
+        .n_prefix = 1,
+        .prefix = prefix,
+        .state = copy_trail_state(guide, scripts[0].state),
+        .probe = true,
+        .on_branch = count_stop,
+        .context = &n_stops,
+    };
+    trail_t* trail = new_scripted_trail(input, input, guide, &scripts[2]);
+    choose(next_choice(trail));
+    trail = observe_choice(trail, prefix[0]);
+    const categorical_t* dist = next_choice(trail);
+    dists[2].size = dist->size;
+    choose(dist);
+    free_trail(guide, trail, false);
+    ASSERT(n_stops == 3 && scripts[2].stopped, "probe did not stop");
+    states[2] = scripts[2].state;
+    next_choices(guide, &states[2], 1, &dists[2]);
+
+    for (int i = 0; i < 3; i++) {
+        trail = new_trail(input, input, guide);
+        if (i == 2) {
+            next_choice(trail);
+            trail = observe_choice(trail, prefix[0]);
+        }
+        dist = next_choice(trail);
+        ASSERT(dist->size == dists[i].size, "distribution of another item");
+        double sum = 0.0;
+        for (int j = 0; j < dist->size; j++) {
+            ASSERT(fabs(dist->p[j] - dists[i].p[j]) < 1e-6, "distribution differs");
+            sum += dists[i].p[j];
+        }
+        ASSERT(fabs(sum - 1.0) < 1e-6, "distribution does not sum to 1");
+        free_trail(guide, trail, false);
+        free_trail_state(guide, states[i]);
+    }
+    free_raster(input);
+}
+END_TEST()
+
+BEGIN_TEST(test_beam_task) {
+    guide_t* guide = get_guide();
+    task_t* task = recolor_task();
+
+    solve_options_t options = {
+        .time_budget = 100.0,
+        .sample_budget = 20,
+        .mode = SOLVE_BEAM,
+        .beam_width = 1,
+    };
+    solve_result_t result;
+    for (int width = 1; width <= 4; width *= 2) {
+        options.beam_width = width;
+        beam_task(task, guide, &options, &result);
+        ASSERT(result.n_samples <= options.sample_budget, "budget not respected");
+
+        // decoding is deterministic
+        long n_samples = result.n_samples;
+        bool found = result.found;
+        beam_task(task, guide, &options, &result);
+        ASSERT(result.n_samples == n_samples && result.found == found,
+               "search is not deterministic");
+    }
+
+    // wider beams are capped
+    options.beam_width = MAX_BEAM_WIDTH;
+    beam_task(task, guide, &options, &result);
+    long n_samples = result.n_samples;
+    options.beam_width = 4 * MAX_BEAM_WIDTH;
+    beam_task(task, guide, &options, &result);
+    ASSERT(result.n_samples == n_samples, "beam width not capped");
+
+    free_task(task);
+}
+END_TEST()
+
+// a trail at the first filter, after the first abstraction
+static trail_t* filter_trail(guide_t* guide, const raster_t* input) {
+    return observe_abstraction(new_trail(input, input, guide), &abstractions[0]);
+}
+
+BEGIN_TEST(test_resample_filter) {
+    color_t pixels[] = {1, 0, 0, 2};
+    raster_t* input = raster_from(pixels, 2, 2);
+    task_t* task = recolor_task();
+    guide_t* guide = fork_guide(get_guide(), 1);
+
+    // no filter selects a node of an empty graph, each combination fails once before rejecting
+    // (3 sizes and 3 degrees with their functions, 2 excludes with the color function)
+    graph_t* empty = new_graph(2, 2);
+    guide->max_resamples = 100;
+    trail_t* trail = filter_trail(guide, input);
+    trail_t* mark = trail;
+    ASSERT(sample_filter(task, empty, &trail) == NULL, "filter for an empty graph");
+    ASSERT(trail == mark, "trail not returned to the mark");
+    ASSERT(task->rejections.resampled == 10, "failed combination not masked");
+    ASSERT(task->rejections.filter == 1, "rejection not counted");
+
+    // resampling stops at max_resamples
+    guide->max_resamples = 3;
+    ASSERT(sample_filter(task, empty, &trail) == NULL, "filter for an empty graph");
+    ASSERT(task->rejections.resampled == 13, "too many resamples");
+    ASSERT(task->rejections.filter == 2, "rejection not counted");
+
+    // without resampling a failed filter is rejected right away, as before
+    guide->max_resamples = 0;
+    trail_mark_t no_mark = mark_trail(trail);
+    ASSERT(no_mark.state == NULL, "network state forked");
+    ASSERT(sample_filter(task, empty, &trail) == NULL, "filter for an empty graph");
+    ASSERT(trail == mark && task->rejections.resampled == 13, "filter resampled");
+    ASSERT(task->rejections.filter == 3, "rejection not counted");
+    free_graph(empty);
+
+    // with enough resamples, a filter is found whenever some call selects a node
+    graph_t* graph = graph_from_grid(pixels, 2, 2);
+    guide->max_resamples = 100;
+    for (int i = 0; i < 20; i++) {
+        filter_call_t* call = sample_filter(task, graph, &trail);
+        ASSERT(call && filter_matches(graph, call), "no filter sampled");
+        while (trail != mark) {
+            trail = backtrack(trail);
+        }
+    }
+    ASSERT(task->rejections.filter == 3, "filter rejected");
+    free_graph(graph);
+
+    free_trail(guide, trail, false);
+    free_guide(guide);
+    free_task(task);
+    free_raster(input);
+}
+END_TEST()
+
+BEGIN_TEST(test_sample_masks) {
+    color_t pixels[] = {1};
+    raster_t* input = raster_from(pixels, 1, 1);
+    task_t* task = recolor_task();
+    guide_t* guide = fork_guide(get_guide(), 1);
+    guide->max_resamples = 0;
+
+    // a single pixel has no neighbors, so filters and bindings on them are never sampled
+    graph_t* graph = graph_from_grid(pixels, 1, 1);
+    trail_t* trail = filter_trail(guide, input);
+    trail_t* mark = trail;
+    for (int i = 0; i < 20; i++) {
+        filter_call_t* filter = sample_filter(task, graph, &trail);
+        ASSERT(filter && !filter->filter->neighbor, "filter on neighbors sampled");
+        ASSERT(filter_matches(graph, filter), "filter selects no node");
+        binding_call_t* binding = sample_binding(task, graph, filter, &trail);
+        ASSERT(binding && binding->binding->global, "binding on neighbors sampled");
+        while (trail != mark) {
+            trail = backtrack(trail);
+        }
+    }
+    ASSERT(task->rejections.filter == 0 && task->rejections.binding == 0, "sample rejected");
+
+    // without a selected node, nothing binds or transforms
+    filter_call_t none = {.filter = &filter_funcs[0], .args = {.color = 5}};
+    ASSERT(!sample_binding(task, graph, &none, &trail), "binding without a selected node");
+    ASSERT(task->rejections.binding == 1, "binding rejection not counted");
+    ASSERT(!sample_transform(task, graph, &none, &trail), "transform without a selected node");
+    ASSERT(task->rejections.transform == 1, "transform rejection not counted");
+    ASSERT(trail == mark, "trail not backtracked");
+    free_graph(graph);
+
+    free_trail(guide, trail, false);
+    free_guide(guide);
+    free_task(task);
+    free_raster(input);
+}
+END_TEST()
+
+DEFINE_SUITE(test_search, {
+    RUN_TEST(test_enumerate_transforms);
+    RUN_TEST(test_search_task);
+    RUN_TEST(test_frontier);
+    RUN_TEST(test_scripted_trail);
+    RUN_TEST(test_best_first_task);
+    RUN_TEST(test_next_choices);
+    RUN_TEST(test_beam_task);
+    RUN_TEST(test_resample_filter);
+    RUN_TEST(test_sample_masks);
+})
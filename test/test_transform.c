@@ -1,3 +1,4 @@
+#include "bitboard.h"
 #include "filter.h"
 #include "graph.h"
 #include "image.h"
@@ -115,8 +116,8 @@ BEGIN_TEST(test_rotate_node) {
       0, 0, 0,
     };
     // clang-format on
-    graph_t* graph = graph_from_grid(grid, 3, 3);
-    graph_t* abstraction = get_connected_components_graph_background_removed(graph);
+    grid_t pixels = {.width = 3, .height = 3, .pixels = grid};
+    graph_t* abstraction = get_connected_components_graph_background_removed(&pixels);
 
     transform_arguments_t params = {.rotation_dir = CLOCK_WISE};
     node_t* node = get_node(abstraction, (coordinate_t){1, 0});
@@ -132,7 +133,6 @@ BEGIN_TEST(test_rotate_node) {
     ASSERT(subnode.coord.pri == 2 && subnode.coord.sec == 1, "pixel has not moved");
 
     free_graph(abstraction);
-    free_graph(graph);
 }
 END_TEST()
 
@@ -144,21 +144,22 @@ BEGIN_TEST(test_add_border) {
       0, 0, 0,
     };
     // clang-format on
-    graph_t* graph = graph_from_grid(grid, 3, 3);
-    graph_t* abstraction = get_connected_components_graph_background_removed(graph);
+    grid_t pixels = {.width = 3, .height = 3, .pixels = grid};
+    graph_t* abstraction = get_connected_components_graph_background_removed(&pixels);
 
     transform_arguments_t params = {.color = 4};
     node_t* node = get_node(abstraction, (coordinate_t){1, 0});
     ASSERT(node->n_subnodes == 3, "node not found");
 
+    unsigned int subnodes_used = abstraction->_subnodes_used;
     bool added = add_border(abstraction, node, &params);
     ASSERT(added, "adding border failed");
+    ASSERT(abstraction->_subnodes_used == subnodes_used + 6, "subnodes not accounted for");
 
     node_t * border = get_node(abstraction, (coordinate_t){2, 0});
     ASSERT(border && border->n_subnodes == 6, "border not fully drawn");
 
     free_graph(abstraction);
-    free_graph(graph);
 }
 END_TEST()
 
@@ -170,8 +171,8 @@ BEGIN_TEST(test_fill_rectangle) {
       0, 1, 2,
     };
     // clang-format on
-    graph_t* graph = graph_from_grid(grid, 3, 3);
-    graph_t* abstraction = get_connected_components_graph_background_removed(graph);
+    grid_t pixels = {.width = 3, .height = 3, .pixels = grid};
+    graph_t* abstraction = get_connected_components_graph_background_removed(&pixels);
 
     transform_arguments_t params = {.color = 4, .overlap = true};
     node_t* node = get_node(abstraction, (coordinate_t){1, 0});
@@ -184,7 +185,29 @@ BEGIN_TEST(test_fill_rectangle) {
     ASSERT(rect && rect->n_subnodes == 2, "rectangle not fully filled");
 
     free_graph(abstraction);
-    free_graph(graph);
+}
+END_TEST()
+
+BEGIN_TEST(test_bitboard) {
+    bitboard_t board, shifted, dilated;
+    clear_bitboard(&board);
+    set_pixel(&board, (coordinate_t){0, 0});
+    set_pixel(&board, (coordinate_t){31, 5});
+    ASSERT(!set_pixel(&board, (coordinate_t){32, 0}), "pixel outside of board set");
+    ASSERT(count_bitboard(&board) == 2, "incorrect number of pixels");
+
+    shift_bitboard(&board, 1, 1, &shifted);
+    ASSERT(count_bitboard(&shifted) == 1 && shifted.rows[1] == 2, "incorrect shift");
+
+    dilate_bitboard(&board, &dilated);
+    ASSERT(count_bitboard(&dilated) == 4 + 6, "incorrect dilation");
+
+    coordinate_t min, max;
+    ASSERT(bitboard_bounding_box(&board, &min, &max), "no bounding box");
+    ASSERT(min.pri == 0 && min.sec == 0 && max.pri == 31 && max.sec == 5, "wrong bounding box");
+
+    rectangle_bitboard(min, max, &shifted);
+    ASSERT(count_bitboard(&shifted) == 32 * 6, "incorrect rectangle");
 }
 END_TEST()
 
@@ -196,4 +219,5 @@ DEFINE_SUITE(test_transform, ({
               RUN_TEST(test_rotate_node);
               RUN_TEST(test_add_border);
               RUN_TEST(test_fill_rectangle);
+              RUN_TEST(test_bitboard);
           }))
\ No newline at end of file
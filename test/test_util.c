@@ -0,0 +1,24 @@
+#include "test.h"
+
+raster_t* raster_from(const color_t* pixels, int width, int height) {
+    raster_t* raster = new_raster(width, height);
+    for (int idx = 0; idx < width * height; idx++) {
+        raster->pixels[idx] = pixels[idx];
+    }
+    return raster;
+}
+
+task_t* recolor_task() {
+    color_t input_1[] = {1, 0, 0, 0};
+    color_t output_1[] = {2, 0, 0, 0};
+    color_t input_2[] = {0, 1, 1, 0};
+    color_t output_2[] = {0, 2, 2, 0};
+    color_t input_3[] = {0, 0, 1, 0};
+    color_t output_3[] = {0, 0, 2, 0};
+
+    task_t* task = new_task();
+    add_train_example(task, raster_from(input_1, 2, 2), raster_from(output_1, 2, 2));
+    add_train_example(task, raster_from(input_2, 2, 2), raster_from(output_2, 2, 2));
+    add_test_example(task, raster_from(input_3, 2, 2), raster_from(output_3, 2, 2));
+    return task;
+}
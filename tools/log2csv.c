@@ -0,0 +1,21 @@
+#include <stdio.h>
+
+#include "sample_log.h"
+
+/**
+ * Convert a binary sample log (written by `arga -l`) to CSV on stdout.
+ */
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <sample log>\n", argv[0]);
+        return 1;
+    }
+    sample_log_reader_t* reader = open_sample_log_reader(argv[1]);
+    if (!reader) {
+        fprintf(stderr, "unable to read sample log %s\n", argv[1]);
+        return 1;
+    }
+    sample_log_to_csv(reader, stdout);
+    close_sample_log_reader(reader);
+    return 0;
+}